@@ -1,398 +1,147 @@
 'use strict';
 
-const expect = require('chai').expect;
-const mlog = require('mocha-logger');
+/*
+ * Usage: node benchmark/benchmark.js [options]
+ *
+ *   --filter <regexp>     Only run the cases whose names match.
+ *   --sizes <n,n,...>     The text sizes, in characters. (default: 16,1024,65536)
+ *   --mixes <m,m,...>     The character mixes: ascii, latin1, cjk, emoji. (default: all)
+ *   --time <ms>           The minimum sampling time of a case. (default: 100)
+ *   --warmup <ms>         The warmup time of a case. (default: 20)
+ *   --json <file>         Save the results as JSON.
+ *   --compare <file>      Compare the results with a saved JSON file. Exits with 1 if a case is slower.
+ *   --threshold <ratio>   The minimum change of the median to be reported. (default: 0.05)
+ *   --kernels <table>     The kernel table: scalar, sse2, sse4.2, avx2 or neon. (default: the fastest supported)
+ */
+
+const fs = require('fs');
 
 const StringBuilder = require('../index');
-
-describe('Append', function() {
-  this.timeout(15000);
-  var a = 'The first string.'
-  var b = 'The second string.'
-  var c = 'The third string.'
-  var startTime, endTime;
-
-  it('Natively append text 1000000 times', function() {
-    var s = '';
-    startTime = Date.now();
-    var t = a + b + c;
-    for (let i = 0; i < 1000000; ++i) {
-      s += t;
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to append text 1000000 times', function() {
-    var sb = new StringBuilder('', 52000000);
-    startTime = Date.now();
-    for (let i = 0; i < 1000000; ++i) {
-      sb.append(a).append(b).append(c);
+const harness = require('./harness');
+const {mixes, cases, createInput, resetInput, destroyInput, uncoveredMethods} = require('./cases');
+
+function parseArguments(argv) {
+  var options = {
+    filter: null,
+    sizes: [16, 1024, 65536],
+    mixes: Object.keys(mixes),
+    time: 100,
+    warmup: 20,
+    json: null,
+    compare: null,
+    threshold: 0.05,
+    kernels: null
+  };
+  for (let i = 0; i < argv.length; ++i) {
+    let name = argv[i];
+    let value = argv[++i];
+    if (value === undefined) {
+      throw new Error('Missing the value of ' + name + '.');
     }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to insert text 1000000 times at the end', function() {
-    var sb = new StringBuilder('', 52000000);
-    startTime = Date.now();
-    for (let i = 0; i < 1000000; ++i) {
-      sb.insert(sb.length(), a).insert(sb.length(), b).insert(sb.length(), c);
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to append text 1000000 times repeatly', function() {
-    var sb = new StringBuilder('', 52000000);
-    startTime = Date.now();
-    sb.append(a).append(b).append(c).appendRepeat(sb.toString(), 999999);
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
-
-describe('Insert', function() {
-  this.timeout(15000);
-  var a = 'This is a simple example demonstrating how to use this module.';
-  var b = '12345';
-  var startTime, endTime;
-
-  it('Natively insert text 10000 times', function() {
-    var s;
-    var insert = function(index, str1, str2) {
-      return str1.slice(0, index) + str2 + str1.slice(index);
-    };
-    startTime = Date.now();
-    s = a;
-    for (let i = 1; i < 10000; ++i) {
-      s = insert(s.length / 2, s, b);
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to insert text 10000 times', function() {
-    var sb = new StringBuilder('', 50176);
-    startTime = Date.now();
-    sb.insert(a);
-    for (let i = 1; i < 10000; ++i) {
-      sb.insert(sb.length() / 2, b);
+    switch (name) {
+      case '--filter':
+        options.filter = new RegExp(value);
+        break;
+      case '--sizes':
+        options.sizes = value.split(',').map(Number);
+        break;
+      case '--mixes':
+        options.mixes = value.split(',');
+        for (let mix of options.mixes) {
+          if (!mixes[mix]) {
+            throw new Error('Unknown character mix: ' + mix + '.');
+          }
+        }
+        break;
+      case '--time':
+      case '--warmup':
+      case '--threshold':
+        options[name.substring(2)] = Number(value);
+        break;
+      case '--json':
+      case '--compare':
+      case '--kernels':
+        options[name.substring(2)] = value;
+        break;
+      default:
+        throw new Error('Unknown option: ' + name + '.');
     }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
-
-describe('Delete', function() {
-  this.timeout(15000);
-  var a = '';
-  for (let i = 0; i < 10000; ++i) {
-    a += 'This is a simple example demonstrating how to use this module.';
   }
-  var startTime, endTime;
-
-  it('Natively delete text 5000 times', function() {
-    var s = a;
-    var deleteT = function(start, end, str) {
-      return str.slice(0, start) + str.slice(end);
-    };
-    startTime = Date.now();
-    for (let i = 0; i < 5000; ++i) {
-      let l = s.length / 2;
-      s = deleteT(l, l + 10, s);
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to delete text 5000 times', function() {
-    var sb = new StringBuilder(a);
-    startTime = Date.now();
-    for (let i = 0; i < 5000; ++i) {
-      let l = sb.length() / 2;
-      sb.delete(l, l + 10);
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
-
-describe('Replace', function() {
-  this.timeout(15000);
-  var a = '';
-  for (let i = 0; i < 10000; ++i) {
-    a += 'This is a simple example demonstrating how to use this module.';
+  return options;
+}
+
+function pad(s, width, left) {
+  s = String(s);
+  return left ? s.padStart(width) : s.padEnd(width);
+}
+
+async function main() {
+  var options = parseArguments(process.argv.slice(2));
+  if (options.kernels) {
+    StringBuilder.kernels(options.kernels);
   }
-  var b = 'hello, this is a long text';
-  var c = 'short txt';
-  var startTime, endTime;
-
-  it('Natively replace text 5000 times', function() {
-    var s = a;
-    var replace = function(start, end, str1, str2) {
-      return str1.slice(0, start) + str2 + str1.slice(end);
-    };
-    startTime = Date.now();
-    for (let i = 0; i < 5000; ++i) {
-      let l = s.length / 2;
-      s = replace(l, l + 10, s, (i % 2 === 0) ? b : c);
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to replace text 5000 times', function() {
-    var sb = new StringBuilder(a, 657536);
-    startTime = Date.now();
-    for (let i = 0; i < 5000; ++i) {
-      let l = sb.length() / 2;
-      sb.replace(l, l + 10, (i % 2 === 0) ? b : c);
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
 
-describe('Replace Pattern', function() {
-  this.timeout(15000);
-  var a = '';
-  for(let i = 0; i < 1000000; ++i){
-      a += 'This text.';
+  var uncovered = uncoveredMethods();
+  if (uncovered.length > 0) {
+    console.warn('Methods without a benchmark case: ' + uncovered.join(', '));
   }
-  var b = '';
-  for(let i = 0; i < 1000000; ++i){
-      b += 'This text.';
-  }
-  var startTime, endTime;
-
-  it('Natively replace text with the same length by using a RegExp pattern', function() {
-      var s = a;
-      startTime = Date.now();
-      s = s.replace(/This/g, 'this');
-      endTime = Date.now();
-      mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to replace text with the same length by using a pattern', function() {
-      var sb = new StringBuilder(a);
-      startTime = Date.now();
-      sb.replaceAll('This', 'this');
-      endTime = Date.now();
-      mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Natively replace text by using a RegExp pattern', function() {
-      var s = b;
-      startTime = Date.now();
-      s = s.replace(/This/g, 'The');
-      endTime = Date.now();
-      mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to replace text by using a pattern', function() {
-      var sb = new StringBuilder(b);
-      startTime = Date.now();
-      sb.replaceAll('This', 'The');
-      endTime = Date.now();
-      mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
-
-describe('Equals', function() {
-  this.timeout(15000);
-  var a = 'The first string.'
-  var b = 'The second string.'
-  var c = 'The third string.'
-  var d = a + b + c;
-  var startTime, endTime;
-
-  it('Natively check the equal 50000 times', function() {
-    var s = a + b + c;
-    startTime = Date.now();
-    let sum = 0;
-    for (let i = 0; i < 50000; ++i) {
-      let p;
-      switch (i % 4) {
-        case 0:
-          p = a;
-          break;
-        case 1:
-          p = b;
-          break;
-        case 2:
-          p = c;
-          break;
-        case 3:
-          p = d;
-          break;
-      }
-      if (s === p) {
-        ++sum;
-      }
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to check the equal 50000 times', function() {
-    var s = a + b + c;
-    var sb = new StringBuilder(s);
-    startTime = Date.now();
-    let sum = 0;
-    for (let i = 0; i < 50000; ++i) {
-      let p;
-      switch (i % 4) {
-        case 0:
-          p = a;
-          break;
-        case 1:
-          p = b;
-          break;
-        case 2:
-          p = c;
-          break;
-        case 3:
-          p = d;
-          break;
-      }
-      if (sb.equals(p)) {
-        ++sum;
-      }
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
-
-describe('EqualsIgnoreCase', function() {
-  this.timeout(15000);
-  var a = 'The first string.'
-  var b = 'The second string.'
-  var c = 'The third string.'
-  var d = a + b + c;
-  d = d.toLowerCase();
-  var startTime, endTime;
-
-  it('Natively check the equal 50000 times', function() {
-    var s = a + b + c;
-    startTime = Date.now();
-    let sum = 0;
-    for (let i = 0; i < 50000; ++i) {
-      let p;
-      switch (i % 4) {
-        case 0:
-          p = a;
-          break;
-        case 1:
-          p = b;
-          break;
-        case 2:
-          p = c;
-          break;
-        case 3:
-          p = d;
-          break;
-      }
-      if (s.toLowerCase() === p.toLowerCase()) {
-        ++sum;
-      }
-    }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
 
-  it('Use StringBuilder to check the equal 50000 times', function() {
-    var s = a + b + c;
-    var sb = new StringBuilder(s);
-    startTime = Date.now();
-    let sum = 0;
-    for (let i = 0; i < 50000; ++i) {
-      let p;
-      switch (i % 4) {
-        case 0:
-          p = a;
-          break;
-        case 1:
-          p = b;
-          break;
-        case 2:
-          p = c;
-          break;
-        case 3:
-          p = d;
-          break;
-      }
-      if (sb.equalsIgnoreCase(p)) {
-        ++sum;
+  var results = [];
+  console.log(pad('case', 44) + pad('p50', 12, true) + pad('p95', 12, true) + pad('p99', 12, true) + pad('±', 8, true) + pad('ops/sec', 12, true) + pad('bytes/sec', 12, true) + pad('peak rss', 12, true));
+  for (let mix of options.mixes) {
+    for (let size of options.sizes) {
+      let input = createInput(mix, size);
+      for (let c of cases) {
+        let id = c.name + ' [' + mix + ' ' + size + ']';
+        if (options.filter && !options.filter.test(id)) {
+          continue;
+        }
+        resetInput(input);
+        if (global.gc) {
+          global.gc();
+        }
+        let stats = await harness.measure(() => c.run(input), {warmup: options.warmup, time: options.time, async: c.async});
+        let bytes = c.bytes ? c.bytes(input) : input.bytes;
+        let result = Object.assign({id: id, name: c.name, mix: mix, size: size, native: c.native === true, bytesPerSec: stats.opsPerSec * bytes}, stats);
+        results.push(result);
+        console.log(pad(id, 44) + pad(harness.formatTime(result.p50), 12, true) + pad(harness.formatTime(result.p95), 12, true) + pad(harness.formatTime(result.p99), 12, true) + pad(result.rme.toFixed(1) + '%', 8, true) + pad(harness.formatRate(result.opsPerSec, ''), 12, true) + pad(bytes > 0 ? harness.formatRate(result.bytesPerSec, 'B') : '-', 12, true) + pad(harness.formatBytes(result.peakRss), 12, true));
       }
+      destroyInput(input);
     }
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
+  }
 
-describe('IndexOf', function() {
-  this.timeout(15000);
-  var a = '';
-  for (let i = 0; i < 1000000; ++i) {
-    a += 'COO';
+  if (options.json) {
+    fs.writeFileSync(options.json, JSON.stringify({
+      node: process.version,
+      platform: process.platform,
+      arch: process.arch,
+      kernels: StringBuilder.kernels().selected,
+      date: new Date().toISOString(),
+      results: results
+    }, null, 2));
   }
-  var p = 'OOCOO';
-  var startTime, endTime;
 
-  it('Natively search text', function() {
-    var s = a;
-    startTime = Date.now();
-    var sum = 0;
-    var index;
-    var offset = 0;
-    var indexArray = [];
-    while (true) {
-      index = s.indexOf(p, offset);
-      if (index < 0) {
-        break;
+  if (options.compare) {
+    let baseline = JSON.parse(fs.readFileSync(options.compare, 'utf8')).results;
+    let comparisons = harness.compare(results, baseline, options.threshold);
+    let slower = 0;
+    console.log();
+    console.log(pad('case', 44) + pad('baseline', 12, true) + pad('current', 12, true) + pad('change', 10, true) + '  verdict');
+    for (let c of comparisons) {
+      if (c.verdict === 'slower') {
+        ++slower;
       }
-      indexArray.push(index);
-      offset = index + 1;
+      console.log(pad(c.id, 44) + pad(harness.formatTime(c.baseline), 12, true) + pad(harness.formatTime(c.current), 12, true) + pad((c.change >= 0 ? '+' : '') + (c.change * 100).toFixed(1) + '%', 10, true) + '  ' + c.verdict);
+    }
+    if (slower > 0) {
+      console.log();
+      console.log(slower + ' case(s) are slower than the baseline.');
+      process.exitCode = 1;
     }
-    var sum = indexArray.length;
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-
-  it('Use StringBuilder to search text', function() {
-    var sb = new StringBuilder(a);
-    startTime = Date.now();
-    var indexArray = sb.indexOf(p, 0, 400000);
-    var sum = indexArray.length;
-    endTime = Date.now();
-    mlog.log(endTime - startTime, 'milliseconds');
-  });
-});
-
-describe('Reverse', function() {
-  this.timeout(15000);
-  var a = '';
-  for(let i = 0; i < 100000; ++i){
-      a += 'HERE IS A SIMPLE EXAMPLE, WHICH CONTAINS MULTIPLE EXAMPLES. SIXLEE IS A WRONG WORD. EXAMPLEEXAMPLE';
   }
-  var p = 'EXAMPLE';
-  var startTime, endTime;
-
-  it('Natively reverse text', function() {
-      var s = a;
-      startTime = Date.now();
-      var reverse = s.split('').reverse().join('');
-      endTime = Date.now();
-      mlog.log(endTime - startTime, 'milliseconds');
-  });
+}
 
-  it('Use StringBuilder to reverse text', function() {
-      var sb = new StringBuilder(a);
-      startTime = Date.now();
-      var reverse = sb.reverse();
-      endTime = Date.now();
-      mlog.log(endTime - startTime, 'milliseconds');
-  });
+main().catch((err) => {
+  console.error(err.message);
+  process.exitCode = 2;
 });
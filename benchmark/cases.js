@@ -0,0 +1,259 @@
+'use strict';
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+const StringBuilder = require('../index');
+
+const mixes = {
+  ascii: 'The quick brown fox jumps over the lazy dog, 0123456789.\n',
+  latin1: 'Café crème brûlée à la française, naïve façade ÀÉÎÕÜ.\n',
+  cjk: '字串建構器可以快速地串接文字，並且支援搜尋與取代。\n',
+  emoji: 'Emoji 😀 test 🎉 with 🚀 surrogate 👍 pairs 🌍.\n'
+};
+
+// the methods which are the same as another one
+const aliases = {
+  slice: 'substring',
+  toUpperCase: 'upperCase',
+  toLowerCase: 'lowerCase',
+  trimLeft: 'trimStart',
+  trimRight: 'trimEnd'
+};
+
+function makeText(mix, size) {
+  var unit = mixes[mix];
+  return unit.repeat(Math.ceil(size / unit.length)).slice(0, size);
+}
+
+/**
+ * Create the input of the cases for a character mix and a size, in characters.
+ * <br/>
+ * Cases which modify `sb` keep its length in a range, and the work to reset it is a part of what they measure. `sb` is recreated before every case.
+ */
+function createInput(mix, size) {
+  var text = makeText(mix, size);
+  var middle = Math.floor(size / 2);
+  var binary = Buffer.from(text);
+  var file = path.join(os.tmpdir(), 'node-stringbuilder-benchmark-' + process.pid + '-' + mix + '-' + size + '.txt');
+  fs.writeFileSync(file, text);
+  return {
+    mix: mix,
+    size: size,
+    text: text,
+    // an equal string which is not the same string
+    copy: Buffer.from(text, 'utf16le').toString('utf16le'),
+    bytes: size * 2,
+    middle: middle,
+    // room for the whole text, for readInto and commit
+    codeUnits: new Uint16Array(size),
+    pattern: text.slice(Math.max(0, size - 12), Math.max(0, size - 4)) || 'x',
+    limit: Math.max(size * 16, 65536),
+    sb: StringBuilder.from(text),
+    other: StringBuilder.from(text),
+    binary: binary,
+    base64: StringBuilder.from(binary.toString('base64')),
+    template: StringBuilder.compileTemplate('<p class="${className}">${text}</p>\n'),
+    templateSource: text.replace(/ /g, ' ${x} '),
+    json: {mix: mix, size: size, text: text, words: text.split(' ').slice(0, 16), flags: [true, false, null], ratio: 0.5},
+    pool: StringBuilder.pool(),
+    file: file,
+    fd: fs.openSync(os.devNull, 'w')
+  };
+}
+
+// give every case the builder in the same state
+function resetInput(input) {
+  input.sb = StringBuilder.from(input.text);
+  input.string = '';
+}
+
+function destroyInput(input) {
+  fs.closeSync(input.fd);
+  fs.unlinkSync(input.file);
+}
+
+// keep an appended builder from growing without a bound
+function appended(s, sb) {
+  if (sb.length() > s.limit) {
+    sb.clear();
+  }
+}
+
+function consume(iterator) {
+  var n = 0;
+  for (let x of iterator) {
+    n += x.length;
+  }
+  return n;
+}
+
+/**
+ * Every case measures `run(input)`. `methods` lists the methods it covers, and `bytes` is the number of bytes of the text it handles per call (the UTF-16 length of the input text by default).
+ */
+const cases = [
+  // creators
+  {name: 'constructor', methods: ['constructor'], run: (s) => new StringBuilder(s.text)},
+  {name: 'from', methods: ['from'], run: (s) => StringBuilder.from(s.text)},
+  {name: 'pool acquire/release', methods: ['pool'], run: (s) => {
+    var sb = s.pool.acquire();
+    sb.append(s.text);
+    s.pool.release(sb);
+  }},
+  {name: 'scratchArenaStats', methods: ['scratchArenaStats'], bytes: () => 0, run: () => StringBuilder.scratchArenaStats()},
+  {name: 'globalStats', methods: ['globalStats'], bytes: () => 0, run: () => StringBuilder.globalStats()},
+  {name: 'kernels', methods: ['kernels'], bytes: () => 0, run: () => StringBuilder.kernels()},
+  {name: 'enableProfiling/profilingReport', methods: ['enableProfiling', 'profilingReport'], bytes: () => 0, run: (s) => {
+    StringBuilder.enableProfiling();
+    s.sb.length();
+    StringBuilder.enableProfiling(false);
+    return StringBuilder.profilingReport({reset: true});
+  }},
+  {name: 'trackRuntimeStats/runtimeStats', methods: ['trackRuntimeStats', 'runtimeStats'], bytes: () => 0, run: (s) => s.sb.clone().trackRuntimeStats().runtimeStats()},
+  {name: 'compileTemplate', methods: ['compileTemplate'], run: (s) => StringBuilder.compileTemplate(s.templateSource)},
+
+  // getters
+  {name: 'inspect', methods: ['inspect'], run: (s) => s.sb.inspect()},
+  {name: 'toString', methods: ['toString'], run: (s) => s.sb.toString()},
+  {name: 'toBuffer', methods: ['toBuffer'], run: (s) => s.sb.toBuffer()},
+  {name: 'toBuffers', methods: ['toBuffers'], run: (s) => s.sb.toBuffers()},
+  {name: 'segmentCount', methods: ['segmentCount'], bytes: () => 0, run: (s) => s.sb.segmentCount()},
+  {name: 'length', methods: ['length'], bytes: () => 0, run: (s) => s.sb.length()},
+  {name: 'capacity', methods: ['capacity'], bytes: () => 0, run: (s) => s.sb.capacity()},
+  {name: 'byteLength', methods: ['byteLength'], run: (s) => s.sb.byteLength()},
+  {name: 'count', methods: ['count'], run: (s) => s.sb.count()},
+  {name: 'stats', methods: ['stats'], run: (s) => s.sb.stats()},
+  {name: 'hash xxh3', methods: ['hash'], run: (s) => s.sb.hash()},
+  {name: 'hash crc32c', methods: ['hash'], run: (s) => s.sb.hash(0, s.size, {algorithm: 'crc32c'})},
+  {name: 'charAt', methods: ['charAt'], bytes: () => 2, run: (s) => s.sb.charAt(s.middle)},
+  {name: 'charCodeAt/codePointAt', methods: ['charCodeAt', 'codePointAt'], bytes: () => 4, run: (s) => s.sb.charCodeAt(s.middle) + s.sb.codePointAt(s.middle)},
+  {name: 'readInto', methods: ['readInto'], run: (s) => s.sb.readInto(s.codeUnits, 0)},
+  {name: 'lineCount', methods: ['lineCount'], run: (s) => s.sb.lineCount()},
+  {name: 'getLine', methods: ['getLine'], run: (s) => s.sb.getLine(-1)},
+  {name: 'lineOf/columnOf', methods: ['lineOf', 'columnOf'], run: (s) => s.sb.lineOf(s.middle) + s.sb.columnOf(s.middle)},
+  {name: 'clone', methods: ['clone'], run: (s) => s.sb.clone()},
+  {name: 'view', methods: ['view'], run: (s) => s.sb.view(1, s.middle).toString()},
+  {name: 'unsafeView/storageGeneration', methods: ['unsafeView', 'storageGeneration'], bytes: () => 0, run: (s) => s.sb.unsafeView().length + s.sb.storageGeneration()},
+  {name: 'decodeBase64', methods: ['decodeBase64'], bytes: (s) => s.binary.length, run: (s) => s.base64.decodeBase64()},
+
+  // comparison and search
+  {name: 'equals', methods: ['equals'], run: (s) => s.sb.equals(s.other)},
+  {name: 'equalsIgnoreCase', methods: ['equalsIgnoreCase'], run: (s) => s.sb.equalsIgnoreCase(s.text)},
+  {name: 'compare', methods: ['compare'], run: (s) => s.sb.compare(s.other)},
+  {name: 'compareIgnoreCase', methods: ['compareIgnoreCase'], run: (s) => s.sb.compareIgnoreCase(s.text)},
+  {name: 'startsWith/endsWith', methods: ['startsWith', 'endsWith'], run: (s) => s.sb.startsWith(s.pattern) || s.sb.endsWith(s.pattern)},
+  {name: 'indexOf', methods: ['indexOf'], run: (s) => s.sb.indexOf(s.pattern)},
+  {name: 'indexOf one character', methods: ['indexOf'], run: (s) => s.sb.indexOf(' ')},
+  {name: 'indexOfSkip', methods: ['indexOfSkip'], run: (s) => s.sb.indexOfSkip(s.pattern)},
+  {name: 'indexOfRegExp', methods: ['indexOfRegExp'], run: (s) => s.sb.indexOfRegExp(/o[a-z]|é|文字|🚀/g)},
+  {name: 'lastIndexOf', methods: ['lastIndexOf'], run: (s) => s.sb.lastIndexOf(s.pattern)},
+  {name: 'split', methods: ['split'], run: (s) => s.sb.split(' ')},
+  {name: 'tokens', methods: ['tokens'], run: (s) => consume(s.sb.tokens(' '))},
+  {name: 'lines', methods: ['lines'], run: (s) => consume(s.sb.lines())},
+
+  // appenders
+  {name: 'append', methods: ['append'], run: (s) => appended(s, s.sb.append(s.text))},
+  {name: 'append number', methods: ['append'], bytes: () => 8, run: (s) => appended(s, s.sb.append(12345678))},
+  {name: 'unsafeView spare/commit', methods: ['commit'], run: (s) => {
+    s.sb.unsafeView({spare: s.size}).set(s.codeUnits);
+    appended(s, s.sb.commit(s.size));
+  }},
+  {name: 'appendLine', methods: ['appendLine'], run: (s) => appended(s, s.sb.appendLine(s.text))},
+  {name: 'appendRepeat', methods: ['appendRepeat'], bytes: (s) => s.bytes * 3, run: (s) => appended(s, s.sb.appendRepeat(s.text, 3))},
+  {name: 'appendTemplate', methods: ['appendTemplate'], run: (s) => appended(s, s.sb.appendTemplate(s.template, {className: 'item', text: s.text}))},
+  {name: 'appendHtmlEscaped', methods: ['appendHtmlEscaped'], run: (s) => appended(s, s.sb.appendHtmlEscaped(s.text))},
+  {name: 'appendJsonEscaped', methods: ['appendJsonEscaped'], run: (s) => appended(s, s.sb.appendJsonEscaped(s.text))},
+  {name: 'appendCsvField', methods: ['appendCsvField'], run: (s) => appended(s, s.sb.appendCsvField(s.text))},
+  {name: 'appendUrlEncoded', methods: ['appendUrlEncoded'], run: (s) => appended(s, s.sb.appendUrlEncoded(s.text))},
+  {name: 'appendJSON', methods: ['appendJSON'], run: (s) => appended(s, s.sb.appendJSON(s.json))},
+  {name: 'appendBase64', methods: ['appendBase64'], bytes: (s) => s.binary.length, run: (s) => appended(s, s.sb.appendBase64(s.binary))},
+  {name: 'appendHex', methods: ['appendHex'], bytes: (s) => s.binary.length, run: (s) => appended(s, s.sb.appendHex(s.binary))},
+  {name: 'appendReadStream', methods: ['appendReadStream'], async: true, run: async (s) => appended(s, await s.sb.appendReadStream(fs.createReadStream(s.file)) || s.sb)},
+
+  // modifiers
+  {name: 'insert', methods: ['insert'], bytes: () => 8, run: (s) => {
+    s.sb.insert(s.middle, 'abcd');
+    if (s.sb.length() > s.size * 2) {
+      s.sb.clear().append(s.text);
+    }
+  }},
+  {name: 'replace', methods: ['replace'], bytes: () => 8, run: (s) => s.sb.replace(s.middle, s.middle + 4, 'abcd')},
+  {name: 'delete', methods: ['delete'], bytes: () => 8, run: (s) => {
+    if (s.sb.length() < s.size / 2 + 4) {
+      s.sb.clear().append(s.text);
+    }
+    s.sb.delete(s.middle / 2, s.middle / 2 + 4);
+  }},
+  {name: 'deleteCharAt', methods: ['deleteCharAt'], bytes: () => 2, run: (s) => {
+    if (s.sb.length() < s.size / 2 + 1) {
+      s.sb.clear().append(s.text);
+    }
+    s.sb.deleteCharAt(s.middle / 2);
+  }},
+  {name: 'append/clear', methods: ['clear'], run: (s) => s.sb.append(s.text).clear()},
+  {name: 'append/reset', methods: ['reset'], run: (s) => s.sb.append(s.text).reset()},
+  {name: 'clone/substring', methods: ['substring'], run: (s) => s.sb.clone().substring(1, s.middle)},
+  {name: 'clone/substr', methods: ['substr'], run: (s) => s.sb.clone().substr(1, s.middle)},
+  {name: 'clone/trim', methods: ['trim'], run: (s) => s.sb.clone().trim()},
+  {name: 'clone/trimStart', methods: ['trimStart'], run: (s) => s.sb.clone().trimStart()},
+  {name: 'clone/trimEnd', methods: ['trimEnd'], run: (s) => s.sb.clone().trimEnd()},
+  {name: 'clone/repeat', methods: ['repeat'], bytes: (s) => s.bytes * 3, run: (s) => s.sb.clone().repeat(2)},
+  {name: 'clone/replacePattern', methods: ['replacePattern'], run: (s) => s.sb.clone().replacePattern(s.pattern, 'abcd')},
+  {name: 'clone/replaceAll', methods: ['replaceAll'], run: (s) => s.sb.clone().replaceAll(' ', '_')},
+  {name: 'reverse', methods: ['reverse'], run: (s) => s.sb.reverse()},
+  {name: 'upperCase/lowerCase', methods: ['upperCase', 'lowerCase'], bytes: (s) => s.bytes * 2, run: (s) => s.sb.upperCase().lowerCase()},
+  {name: 'expandCapacity/shrinkCapacity', methods: ['expandCapacity', 'shrinkCapacity'], run: (s) => s.sb.expandCapacity(s.size * 2).shrinkCapacity()},
+  {name: 'setMaxCapacity/maxCapacity', methods: ['setMaxCapacity', 'maxCapacity'], bytes: () => 0, run: (s) => s.sb.setMaxCapacity(s.size * 4).setMaxCapacity().maxCapacity()},
+  {name: 'segment', methods: ['segment'], run: (s) => {
+    var sb = new StringBuilder();
+    sb.segment(4096);
+    sb.append(s.text).append(s.text).segment(0);
+  }},
+
+  // output
+  {name: 'writevSync', methods: ['writevSync'], run: (s) => s.sb.writevSync(s.fd)},
+  {name: 'writev', methods: ['writev'], async: true, run: (s) => s.sb.writev(s.fd)},
+
+  // the same work done with JavaScript strings, for reference
+  {name: 'native +=', native: true, run: (s) => {
+    s.string += s.text;
+    if (s.string.length > s.limit) {
+      s.string = '';
+    }
+  }},
+  {name: 'native insert', native: true, bytes: () => 8, run: (s) => s.text.slice(0, s.middle) + 'abcd' + s.text.slice(s.middle)},
+  {name: 'native equals', native: true, run: (s) => s.text === s.copy},
+  {name: 'native indexOf', native: true, run: (s) => s.text.indexOf(s.pattern)},
+  {name: 'native split', native: true, run: (s) => s.text.split(' ')},
+  {name: 'native split/join', native: true, run: (s) => s.text.split(s.pattern).join('abcd')},
+  {name: 'native reverse', native: true, run: (s) => Array.from(s.text).reverse().join('')},
+  {name: 'native toUpperCase/toLowerCase', native: true, bytes: (s) => s.bytes * 2, run: (s) => s.text.toUpperCase().toLowerCase()},
+  {name: 'native JSON.stringify', native: true, run: (s) => JSON.stringify(s.json)},
+  {name: 'native base64', native: true, bytes: (s) => s.binary.length, run: (s) => s.binary.toString('base64')}
+];
+
+/**
+ * Get the methods of StringBuilder which no case covers.
+ * @returns {string[]}
+ */
+function uncoveredMethods() {
+  var covered = new Set();
+  for (let c of cases) {
+    for (let method of c.methods || []) {
+      covered.add(method);
+    }
+  }
+  var ignored = new Set(['length', 'name', 'prototype', 'arguments', 'caller']);
+  var methods = Object.getOwnPropertyNames(StringBuilder.prototype).concat(Object.getOwnPropertyNames(StringBuilder).filter((name) => !ignored.has(name)));
+  return methods.filter((name) => !covered.has(Object.prototype.hasOwnProperty.call(aliases, name) ? aliases[name] : name));
+}
+
+module.exports = {
+  mixes,
+  cases,
+  createInput,
+  resetInput,
+  destroyInput,
+  uncoveredMethods
+};
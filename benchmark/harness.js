@@ -0,0 +1,173 @@
+'use strict';
+
+/**
+ * Measure a function.
+ * <br/>
+ * The function is warmed up first, then called in batches which are long enough for the timer, and every batch gives a sample of the time per call. Memory is sampled between the batches.
+ * @param {function} fn The function to measure. If it returns a promise, every call is awaited.
+ * @param {Object} [options]
+ * @param {number} [options.warmup=20] The warmup time, in milliseconds.
+ * @param {number} [options.time=100] The minimum sampling time, in milliseconds.
+ * @param {number} [options.minSamples=20]
+ * @param {number} [options.maxSamples=5000]
+ * @param {number} [options.minBatchTime=0.05] The minimum time of a batch, in milliseconds.
+ * @param {boolean} [options.async=false]
+ * @returns {Promise<Object>}
+ */
+async function measure(fn, options = {}) {
+  var warmup = BigInt(Math.round((options.warmup === undefined ? 20 : options.warmup) * 1e6));
+  var time = BigInt(Math.round((options.time === undefined ? 100 : options.time) * 1e6));
+  var minSamples = options.minSamples || 20;
+  var maxSamples = options.maxSamples || 5000;
+  var minBatchTime = BigInt(Math.round((options.minBatchTime || 0.05) * 1e6));
+  var isAsync = options.async === true;
+
+  async function runBatch(batch) {
+    var start = process.hrtime.bigint();
+    if (isAsync) {
+      for (let i = 0; i < batch; ++i) {
+        await fn();
+      }
+    } else {
+      for (let i = 0; i < batch; ++i) {
+        fn();
+      }
+    }
+    return process.hrtime.bigint() - start;
+  }
+
+  var start = process.hrtime.bigint();
+  do {
+    await runBatch(1);
+  } while (process.hrtime.bigint() - start < warmup);
+
+  var batch = 1;
+  while (batch < 1 << 24 && await runBatch(batch) < minBatchTime) {
+    batch *= 2;
+  }
+
+  var memory = process.memoryUsage();
+  var startExternal = memory.external;
+  var peakRss = memory.rss;
+  var peakExternal = memory.external;
+  var samples = [];
+  var total = 0n;
+  while ((total < time || samples.length < minSamples) && samples.length < maxSamples) {
+    let elapsed = await runBatch(batch);
+    total += elapsed;
+    samples.push(Number(elapsed) / batch);
+    memory = process.memoryUsage();
+    peakRss = Math.max(peakRss, memory.rss);
+    peakExternal = Math.max(peakExternal, memory.external);
+  }
+
+  var stats = summarize(samples);
+  var ops = samples.length * batch;
+  stats.batch = batch;
+  stats.ops = ops;
+  stats.opsPerSec = ops / (Number(total) / 1e9);
+  stats.peakRss = peakRss;
+  stats.peakExternal = peakExternal;
+  stats.externalGrowth = peakExternal - startExternal;
+  return stats;
+}
+
+function percentile(sorted, p) {
+  var index = (sorted.length - 1) * p;
+  var low = Math.floor(index);
+  var high = Math.ceil(index);
+  return sorted[low] + (sorted[high] - sorted[low]) * (index - low);
+}
+
+/**
+ * Summarize samples of the time per call, in nanoseconds.
+ * @param {number[]!} samples
+ * @returns {{samples: number, mean: number, sd: number, rme: number, min: number, p50: number, p95: number, p99: number, max: number}}
+ */
+function summarize(samples) {
+  var sorted = samples.slice().sort((a, b) => a - b);
+  var n = sorted.length;
+  var mean = sorted.reduce((sum, x) => sum + x, 0) / n;
+  var variance = n > 1 ? sorted.reduce((sum, x) => sum + (x - mean) * (x - mean), 0) / (n - 1) : 0;
+  var sd = Math.sqrt(variance);
+  return {
+    samples: n,
+    mean: mean,
+    sd: sd,
+    // the relative margin of error at 95% confidence, in percent
+    rme: mean > 0 ? 1.96 * sd / Math.sqrt(n) / mean * 100 : 0,
+    min: sorted[0],
+    p50: percentile(sorted, 0.5),
+    p95: percentile(sorted, 0.95),
+    p99: percentile(sorted, 0.99),
+    max: sorted[n - 1]
+  };
+}
+
+/**
+ * Compare results with a baseline. A case is only reported as faster or slower if its median changes by more than the threshold and by more than the margins of error of both runs.
+ * @param {Object[]!} results
+ * @param {Object[]!} baseline
+ * @param {number} [threshold=0.05]
+ * @returns {Object[]} The cases found in both, with `change` being the relative change of the median time.
+ */
+function compare(results, baseline, threshold = 0.05) {
+  var baselineMap = new Map(baseline.map((r) => [r.id, r]));
+  var comparisons = [];
+  for (let r of results) {
+    let b = baselineMap.get(r.id);
+    if (!b) {
+      continue;
+    }
+    let change = r.p50 / b.p50 - 1;
+    let margin = Math.max(threshold, (r.rme + b.rme) / 100);
+    let verdict = 'same';
+    if (change > margin) {
+      verdict = 'slower';
+    } else if (change < -margin) {
+      verdict = 'faster';
+    }
+    comparisons.push({
+      id: r.id,
+      baseline: b.p50,
+      current: r.p50,
+      change: change,
+      verdict: verdict
+    });
+  }
+  return comparisons;
+}
+
+function formatTime(ns) {
+  if (ns < 1e3) {
+    return ns.toFixed(1) + ' ns';
+  } else if (ns < 1e6) {
+    return (ns / 1e3).toFixed(2) + ' µs';
+  } else if (ns < 1e9) {
+    return (ns / 1e6).toFixed(2) + ' ms';
+  }
+  return (ns / 1e9).toFixed(2) + ' s';
+}
+
+function formatRate(n, unit) {
+  var prefixes = ['', 'K', 'M', 'G', 'T'];
+  var i = 0;
+  while (n >= 1000 && i < prefixes.length - 1) {
+    n /= 1000;
+    ++i;
+  }
+  return n.toFixed(n < 10 ? 2 : n < 100 ? 1 : 0) + ' ' + prefixes[i] + unit;
+}
+
+function formatBytes(n) {
+  return (n / 1048576).toFixed(1) + ' MiB';
+}
+
+module.exports = {
+  measure,
+  summarize,
+  compare,
+  formatTime,
+  formatRate,
+  formatBytes
+};
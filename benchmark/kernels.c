@@ -0,0 +1,590 @@
+// A standalone benchmark and test of the text kernels (src/kernels.c), without N-API and the JavaScript call overhead.
+//
+// Usage: kernel-benchmark [--test] [--kernels table] [--filter name] [--size code-units] [--time ms] [file ...]
+//
+// The kernels are checked against simple reference implementations first, with every kernel table the CPU supports, then timed on synthetic corpora (ascii, latin1, cjk and emoji) and on the UTF-8 files given.
+// The timing uses the fastest table, or the one given by --kernels (scalar, sse2, sse4.2, avx2 or neon) or the STRINGBUILDER_KERNELS environment variable.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAS_TSC
+#endif
+
+#include "kernels.h"
+
+#define defaultSize 1048576
+#define defaultTime 200
+#define maxCorpora 16
+
+typedef struct {
+        char name[64];
+        uint16_t* text;
+        int64_t length;
+        // text, encoded in UTF-8
+        uint8_t* utf8;
+        int64_t utf8Length;
+        // text, encoded in Base64
+        uint16_t* base64;
+        int64_t base64Length;
+        // the end of the text, a pattern which is not found, and a short pattern found often
+        uint16_t* tailPattern;
+        uint16_t* missingPattern;
+        int64_t patternLength;
+        uint16_t* commonPattern;
+        int64_t commonPatternLength;
+} Corpus;
+
+typedef struct {
+        uint16_t* units;
+        uint16_t* copy;
+        uint8_t* bytes;
+        int64_t* positions;
+} Workspace;
+
+// The kernel runs once, returns a value so that the run cannot be optimized out, and sets the number of bytes handled.
+typedef int64_t (*KernelRun)(Corpus* corpus, Workspace* workspace, int64_t* bytes);
+
+typedef struct {
+        const char* name;
+        KernelRun run;
+} Kernel;
+
+volatile int64_t sink;
+
+uint64_t nowNanoseconds() {
+#if defined(_WIN32)
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+#endif
+}
+
+// The time stamp counter, which counts at a constant reference frequency on modern x86 CPUs
+uint64_t nowCycles() {
+#if defined(HAS_TSC)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+}
+
+void* allocate(size_t size) {
+        void* p = malloc(size > 0 ? size : 1);
+        if (p == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                exit(2);
+        }
+        return p;
+}
+
+// TODO -----Corpora-----
+
+void encodeUTF16(const char* utf8, uint16_t** text, int64_t* length) {
+        int64_t utf8Length = (int64_t)strlen(utf8);
+        *text = (uint16_t*)allocate(sizeof(uint16_t) * utf8Length);
+        *length = decodeUTF8((const uint8_t*)utf8, utf8Length, *text);
+}
+
+void completeCorpus(Corpus* corpus) {
+        int64_t length = corpus->length;
+        corpus->utf8 = (uint8_t*)allocate(utf8LengthOfUTF16(corpus->text, length));
+        corpus->utf8Length = encodeUTF16ToUTF8(corpus->text, length, corpus->utf8) - corpus->utf8;
+        corpus->base64 = (uint16_t*)allocate(sizeof(uint16_t) * ((length * 2 + 2) / 3 * 4));
+        corpus->base64Length = encodeBase64((const uint8_t*)corpus->text, length * 2, false, corpus->base64);
+        corpus->patternLength = length < 16 ? length : 16;
+        corpus->tailPattern = corpus->text + length - corpus->patternLength;
+        // U+FFFF is a noncharacter
+        corpus->missingPattern = (uint16_t*)allocate(sizeof(uint16_t) * corpus->patternLength);
+        memcpy(corpus->missingPattern, corpus->tailPattern, corpus->patternLength * 2);
+        corpus->missingPattern[corpus->patternLength / 2] = 0xFFFF;
+        corpus->commonPatternLength = length < 3 ? length : 3;
+        corpus->commonPattern = corpus->text + length / 2;
+}
+
+void createSyntheticCorpus(Corpus* corpus, const char* name, const char* unitText, int64_t size) {
+        uint16_t* unit;
+        int64_t unitLength, i;
+        encodeUTF16(unitText, &unit, &unitLength);
+        snprintf(corpus->name, sizeof(corpus->name), "%s", name);
+        corpus->text = (uint16_t*)allocate(sizeof(uint16_t) * size);
+        for (i = 0; i < size; ++i) {
+                corpus->text[i] = unit[i % unitLength];
+        }
+        corpus->length = size;
+        free(unit);
+        completeCorpus(corpus);
+}
+
+bool loadCorpus(Corpus* corpus, const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (file == NULL) {
+                return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        uint8_t* data = (uint8_t*)allocate(size);
+        size_t read = fread(data, 1, size, file);
+        fclose(file);
+        const char* name = strrchr(path, '/');
+        snprintf(corpus->name, sizeof(corpus->name), "%s", name ? name + 1 : path);
+        corpus->text = (uint16_t*)allocate(sizeof(uint16_t) * read);
+        corpus->length = decodeUTF8(data, (int64_t)read, corpus->text);
+        free(data);
+        completeCorpus(corpus);
+        return true;
+}
+
+// TODO -----Kernels-----
+
+int64_t runFind(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return boyerMooreMagicLenFind(c->text, c->length, c->missingPattern, c->patternLength, 0, 1, false, w->positions);
+}
+
+int64_t runFindAll(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return boyerMooreMagicLenFind(c->text, c->length, c->commonPattern, c->commonPatternLength, 0, c->length, true, w->positions);
+}
+
+int64_t runFindRev(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return boyerMooreMagicLenFindRev(c->text, c->length, c->missingPattern, c->patternLength, 0, 1, w->positions);
+}
+
+int64_t runFindCodeUnits(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return findCodeUnits(c->text, 0, c->length, '\n', 0, w->positions);
+}
+
+int64_t runSkipWhiteSpace(Corpus* c, Workspace* w, int64_t* bytes) {
+        // w->units is the corpus between two runs of spaces as long as itself
+        int64_t length = c->length * 3;
+        *bytes = c->length * 4;
+        return skipWhiteSpaceForward(w->units, 0, length) + skipWhiteSpaceBackward(w->units, 0, length);
+}
+
+int64_t runConvertCase(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 4;
+        convertCase(w->copy, c->length, true);
+        convertCase(w->copy, c->length, false);
+        return w->copy[0];
+}
+
+int64_t runCompare(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return compareUTF16(c->text, c->length, w->units + c->length, c->length);
+}
+
+int64_t runCompareIgnoreCase(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return compareUTF16IgnoreCase(c->text, c->length, w->units + c->length, c->length);
+}
+
+int64_t runCountWords(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return countWordsUTF16(c->text, c->length);
+}
+
+int64_t runMeasure(Corpus* c, Workspace* w, int64_t* bytes) {
+        TextStatistics statistics;
+        *bytes = c->length * 2;
+        measureUTF16(c->text, c->length, true, &statistics);
+        return statistics.words + statistics.codePoints;
+}
+
+int64_t runReverse(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        reverseSurrogatePairs(w->copy, c->length);
+        reverseCodeUnits(w->copy, c->length);
+        return w->copy[0];
+}
+
+int64_t runReverseGraphemes(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        reverseGraphemeClusters(w->copy, c->length);
+        reverseCodeUnits(w->copy, c->length);
+        return w->copy[0];
+}
+
+int64_t runEncodeUTF8(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return encodeUTF16ToUTF8(c->text, c->length, w->bytes) - w->bytes;
+}
+
+int64_t runDecodeUTF8(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->utf8Length;
+        return decodeUTF8(c->utf8, c->utf8Length, w->units);
+}
+
+int64_t runEscapeHTML(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return escapeText(c->text, c->length, escapeHTML, w->units);
+}
+
+int64_t runEscapeJSON(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return escapeText(c->text, c->length, escapeJSON, w->units);
+}
+
+int64_t runEscapeURL(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return escapeText(c->text, c->length, escapeURL, w->units);
+}
+
+int64_t runEncodeBase64(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return encodeBase64((const uint8_t*)c->text, c->length * 2, false, w->units);
+}
+
+int64_t runDecodeBase64(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->base64Length * 2;
+        return decodeBase64(c->base64, c->base64Length, w->bytes);
+}
+
+int64_t runEncodeHex(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length;
+        encodeHex((const uint8_t*)c->text, c->length, w->units);
+        return w->units[0];
+}
+
+int64_t runXXH3(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return (int64_t)xxh3((const uint8_t*)c->text, c->length * 2);
+}
+
+int64_t runWyhash(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return (int64_t)wyhash((const uint8_t*)c->text, c->length * 2, 0);
+}
+
+int64_t runCRC32C(Corpus* c, Workspace* w, int64_t* bytes) {
+        *bytes = c->length * 2;
+        return updateCRC32C(0xFFFFFFFF, (const uint8_t*)c->text, c->length * 2);
+}
+
+// Append the text in chunks of 64 code units, reallocating and copying like reAlloc does
+int64_t runReAlloc(Corpus* c, Workspace* w, int64_t* bytes) {
+        int64_t capacity = blockSize, length = 0, i, total = c->length * 2;
+        uint8_t* buffer = (uint8_t*)allocate(capacity);
+        for (i = 0; i < total; i += 128) {
+                int64_t size = total - i < 128 ? total - i : 128;
+                if (capacity < length + size) {
+                        int64_t newCapacity = growCapacity(capacity, length + size);
+                        uint8_t* newBuffer = (uint8_t*)allocate(newCapacity);
+                        memcpy(newBuffer, buffer, length);
+                        free(buffer);
+                        buffer = newBuffer;
+                        capacity = newCapacity;
+                }
+                memcpy(buffer + length, (const uint8_t*)c->text + i, size);
+                length += size;
+        }
+        free(buffer);
+        *bytes = total;
+        return capacity;
+}
+
+const Kernel kernels[] = {
+        {"boyerMooreMagicLenFind", runFind},
+        {"boyerMooreMagicLenFind all", runFindAll},
+        {"boyerMooreMagicLenFindRev", runFindRev},
+        {"findCodeUnits", runFindCodeUnits},
+        {"skipWhiteSpace", runSkipWhiteSpace},
+        {"convertCase", runConvertCase},
+        {"compareUTF16", runCompare},
+        {"compareUTF16IgnoreCase", runCompareIgnoreCase},
+        {"countWordsUTF16", runCountWords},
+        {"measureUTF16", runMeasure},
+        {"reverseCodeUnits", runReverse},
+        {"reverseGraphemeClusters", runReverseGraphemes},
+        {"encodeUTF16ToUTF8", runEncodeUTF8},
+        {"decodeUTF8", runDecodeUTF8},
+        {"escapeText html", runEscapeHTML},
+        {"escapeText json", runEscapeJSON},
+        {"escapeText url", runEscapeURL},
+        {"encodeBase64", runEncodeBase64},
+        {"decodeBase64", runDecodeBase64},
+        {"encodeHex", runEncodeHex},
+        {"xxh3", runXXH3},
+        {"wyhash", runWyhash},
+        {"updateCRC32C", runCRC32C},
+        {"growCapacity (reAlloc)", runReAlloc}
+};
+
+#define kernelsLength (sizeof(kernels) / sizeof(kernels[0]))
+
+void prepareWorkspace(Corpus* c, Workspace* w) {
+        int64_t i;
+        for (i = 0; i < c->length; ++i) {
+                w->units[i] = ' ';
+                w->units[c->length * 2 + i] = ' ';
+        }
+        memcpy(w->units + c->length, c->text, c->length * 2);
+        memcpy(w->copy, c->text, c->length * 2);
+}
+
+int compareDoubles(const void* a, const void* b) {
+        double x = *(const double*)a, y = *(const double*)b;
+        return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+// Time a kernel in batches long enough for the clock, and print the median time and cycles per run
+void benchmark(const Kernel* kernel, Corpus* c, Workspace* w, uint64_t time) {
+        double samples[1000], cycleSamples[1000];
+        int64_t bytes, batch = 1, i, n = 0;
+        prepareWorkspace(c, w);
+        sink = kernel->run(c, w, &bytes);
+        for (;;) {
+                uint64_t start = nowNanoseconds();
+                for (i = 0; i < batch; ++i) {
+                        sink = kernel->run(c, w, &bytes);
+                }
+                if (nowNanoseconds() - start >= 100000 || batch >= 1 << 20) {
+                        break;
+                }
+                batch *= 2;
+        }
+        uint64_t end = nowNanoseconds() + time;
+        while (n < 1000 && (n < 10 || nowNanoseconds() < end)) {
+                uint64_t start = nowNanoseconds(), startCycles = nowCycles();
+                for (i = 0; i < batch; ++i) {
+                        sink = kernel->run(c, w, &bytes);
+                }
+                cycleSamples[n] = (double)(nowCycles() - startCycles) / batch;
+                samples[n++] = (double)(nowNanoseconds() - start) / batch;
+        }
+        qsort(samples, n, sizeof(double), compareDoubles);
+        qsort(cycleSamples, n, sizeof(double), compareDoubles);
+        double median = samples[n / 2], p95 = samples[n * 95 / 100];
+        printf("%-28s %-12s %10lld %12.1f %12.1f %10.3f", kernel->name, c->name, (long long)bytes, median / 1000, p95 / 1000, bytes / median);
+#if defined(HAS_TSC)
+        printf(" %10.3f\n", cycleSamples[n / 2] / bytes);
+#else
+        printf(" %10s\n", "-");
+#endif
+}
+
+// TODO -----Tests-----
+
+int failures = 0;
+
+void check(bool ok, const char* kernel, const char* corpus) {
+        if (!ok) {
+                ++failures;
+                printf("FAIL %s [%s] (%s)\n", kernel, corpus, selectedKernels()->name);
+        }
+}
+
+int64_t naiveFind(const uint16_t* source, int64_t sourceLength, const uint16_t* pattern, int64_t patternLength, int64_t offset, bool skip, int64_t* output) {
+        int64_t i, count = 0;
+        for (i = offset; i + patternLength <= sourceLength; ++i) {
+                if (memcmp(source + i, pattern, patternLength * 2) == 0) {
+                        output[count++] = i;
+                        if (skip) {
+                                i += patternLength - 1;
+                        }
+                }
+        }
+        return count;
+}
+
+void testCorpus(Corpus* c, Workspace* w) {
+        int64_t length = c->length, i, count, expectedCount;
+        int64_t* expected = (int64_t*)allocate(sizeof(int64_t) * (length + 1));
+
+        expectedCount = naiveFind(c->text, length, c->commonPattern, c->commonPatternLength, 0, true, expected);
+        count = boyerMooreMagicLenFind(c->text, length, c->commonPattern, c->commonPatternLength, 0, length, true, w->positions);
+        check(count == expectedCount && memcmp(w->positions, expected, count * 8) == 0, "boyerMooreMagicLenFind skip", c->name);
+        expectedCount = naiveFind(c->text, length, c->commonPattern, c->commonPatternLength, 1, false, expected);
+        count = boyerMooreMagicLenFind(c->text, length, c->commonPattern, c->commonPatternLength, 1, length, false, w->positions);
+        check(count == expectedCount && memcmp(w->positions, expected, count * 8) == 0, "boyerMooreMagicLenFind", c->name);
+        count = boyerMooreMagicLenFindRev(c->text, length, c->tailPattern, c->patternLength, 0, 1, w->positions);
+        check(count == 1 && w->positions[0] == length - c->patternLength, "boyerMooreMagicLenFindRev", c->name);
+        check(boyerMooreMagicLenFind(c->text, length, c->missingPattern, c->patternLength, 0, 1, false, w->positions) == 0 && boyerMooreMagicLenFindRev(c->text, length, c->missingPattern, c->patternLength, 0, 1, w->positions) == 0, "boyerMooreMagicLenFind missing", c->name);
+
+        expectedCount = 0;
+        for (i = 0; i < length; ++i) {
+                if (c->text[i] == '\n') {
+                        expected[expectedCount++] = i + 1;
+                }
+        }
+        count = findCodeUnits(c->text, 0, length, '\n', 0, w->positions);
+        check(count == expectedCount && memcmp(w->positions, expected, count * 8) == 0, "findCodeUnits", c->name);
+        count = findCodeUnits(c->text, 1, length, '\n', 3, w->positions);
+        check(count == (expectedCount < 3 ? expectedCount : 3) && memcmp(w->positions, expected, count * 8) == 0 && findCodeUnits(c->text, 0, length, '\n', 0, NULL) == expectedCount, "findCodeUnits limit", c->name);
+
+        prepareWorkspace(c, w);
+        int64_t start = 0, end = length * 3;
+        while (start < end && isWhiteSpace(w->units[start])) {
+                ++start;
+        }
+        while (end > start && isWhiteSpace(w->units[end - 1])) {
+                --end;
+        }
+        check(skipWhiteSpaceForward(w->units, 0, length * 3) == start && skipWhiteSpaceBackward(w->units, 0, length * 3) == end, "skipWhiteSpace", c->name);
+
+        check(compareUTF16(c->text, length, w->units + length, length) == 0 && compareUTF16IgnoreCase(c->text, length, w->units + length, length) == 0, "compareUTF16", c->name);
+        convertCase(w->copy, length, true);
+        for (i = 0; i < length && (c->text[i] < 'a' || c->text[i] > 'z' || w->copy[i] == c->text[i] - 32); ++i) {
+        }
+        check(i == length, "convertCase", c->name);
+        check(compareUTF16IgnoreCase(c->text, length, w->copy, length) == 0, "compareUTF16IgnoreCase", c->name);
+
+        // reverse uses them with reverseCodeUnits, which puts the code units of the clusters back in order
+        memcpy(w->copy, c->text, length * 2);
+        for (i = 0; i < 2; ++i) {
+                reverseGraphemeClusters(w->copy, length);
+                reverseCodeUnits(w->copy, length);
+        }
+        check(memcmp(w->copy, c->text, length * 2) == 0, "reverseGraphemeClusters", c->name);
+
+        TextStatistics statistics;
+        measureUTF16(c->text, length, true, &statistics);
+        check(statistics.words == countWordsUTF16(c->text, length) && statistics.utf8Length == c->utf8Length, "measureUTF16", c->name);
+
+        check(decodeUTF8(c->utf8, c->utf8Length, w->units) == length && memcmp(w->units, c->text, length * 2) == 0, "decodeUTF8", c->name);
+        check(decodeBase64(c->base64, c->base64Length, w->bytes) == length * 2 && memcmp(w->bytes, c->text, length * 2) == 0, "decodeBase64", c->name);
+        check(escapeText(c->text, length, escapeJSON, NULL) == escapeText(c->text, length, escapeJSON, w->units), "escapeText", c->name);
+
+        encodeHex((const uint8_t*)c->text, length, w->units);
+        for (i = 0; i < length; ++i) {
+                uint8_t b = ((const uint8_t*)c->text)[i];
+                if (w->units[i * 2] != "0123456789abcdef"[b >> 4] || w->units[i * 2 + 1] != "0123456789abcdef"[b & 15]) {
+                        break;
+                }
+        }
+        check(i == length, "encodeHex", c->name);
+
+        uint32_t crc = updateCRC32C(0xFFFFFFFF, (const uint8_t*)c->text, length);
+        check(updateCRC32C(crc, (const uint8_t*)c->text + length, length) == updateCRC32C(0xFFFFFFFF, (const uint8_t*)c->text, length * 2), "updateCRC32C", c->name);
+
+        free(expected);
+}
+
+void testKnownValues() {
+        check((updateCRC32C(0xFFFFFFFF, (const uint8_t*)"123456789", 9) ^ 0xFFFFFFFF) == 0xE3069283, "updateCRC32C", "check value");
+        check(xxh3((const uint8_t*)"", 0) == 0x2D06800538D394C2ULL, "xxh3", "empty");
+
+        // the test vectors of wyhash final version 4, the seed of each is its index
+        static const char* wyhashInputs[7] = {"", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", "12345678901234567890123456789012345678901234567890123456789012345678901234567890"};
+        static const uint64_t wyhashOutputs[7] = {0x93228a4de0eec5a2ULL, 0xc5bac3db178713c4ULL, 0xa97f2f7b1d9b3314ULL, 0x786d1f1df3801df4ULL, 0xdca5a8138ad37c87ULL, 0xb9e734f117cfaf70ULL, 0x6cc5eab49a92d617ULL};
+        int i;
+        for (i = 0; i < 7; ++i) {
+                check(wyhash((const uint8_t*)wyhashInputs[i], (int64_t)strlen(wyhashInputs[i]), (uint64_t)i) == wyhashOutputs[i], "wyhash", wyhashInputs[i]);
+        }
+        check(growCapacity(blockSize, blockSize) == blockSize && growCapacity(blockSize, blockSize + 1) == blockSize * 2, "growCapacity", "blocks");
+
+        uint16_t* text;
+        int64_t length;
+        encodeUTF16("The 2 quick foxes jump 3.5 m, e.g. over 10.x dogs", &text, &length);
+        TextStatistics statistics;
+        measureUTF16(text, length, true, &statistics);
+        check(countWordsUTF16(text, length) == statistics.words && statistics.codePoints == length, "countWordsUTF16", "sentence");
+        free(text);
+}
+
+int main(int argc, char** argv) {
+        int64_t size = defaultSize;
+        uint64_t time = (uint64_t)defaultTime * 1000000;
+        const char* filter = NULL;
+        const char* tableName = NULL;
+        bool testOnly = false;
+        Corpus corpora[maxCorpora];
+        int corporaLength = 0, i;
+        size_t k;
+
+        initializeKernels();
+
+        for (i = 1; i < argc; ++i) {
+                if (strcmp(argv[i], "--test") == 0) {
+                        testOnly = true;
+                } else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) {
+                        tableName = argv[++i];
+                } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+                        filter = argv[++i];
+                } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+                        size = atoll(argv[++i]);
+                } else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+                        time = (uint64_t)atoll(argv[++i]) * 1000000;
+                } else if (corporaLength < maxCorpora - 4) {
+                        if (!loadCorpus(&corpora[corporaLength], argv[i])) {
+                                fprintf(stderr, "Cannot read %s.\n", argv[i]);
+                                return 2;
+                        }
+                        ++corporaLength;
+                }
+        }
+        if (size < 16) {
+                size = 16;
+        }
+
+        createSyntheticCorpus(&corpora[corporaLength++], "ascii", "The quick brown fox jumps over the lazy dog, 0123456789.\n", size);
+        createSyntheticCorpus(&corpora[corporaLength++], "latin1", "Caf\xC3\xA9 cr\xC3\xA8me br\xC3\xBBl\xC3\xA9" "e \xC3\xA0 la fran\xC3\xA7" "aise, na\xC3\xAFve fa\xC3\xA7" "ade.\n", size);
+        createSyntheticCorpus(&corpora[corporaLength++], "cjk", "\xE5\xAD\x97\xE4\xB8\xB2\xE5\xBB\xBA\xE6\xA7\x8B\xE5\x99\xA8\xE5\x8F\xAF\xE4\xBB\xA5\xE5\xBF\xAB\xE9\x80\x9F\xE5\x9C\xB0\xE4\xB8\xB2\xE6\x8E\xA5\xE6\x96\x87\xE5\xAD\x97\xE3\x80\x82\n", size);
+        createSyntheticCorpus(&corpora[corporaLength++], "emoji", "Emoji \xF0\x9F\x98\x80 test \xF0\x9F\x8E\x89 with \xF0\x9F\x9A\x80 pairs \xF0\x9F\x91\x8D.\n", size);
+
+        int64_t maxLength = 0;
+        for (i = 0; i < corporaLength; ++i) {
+                if (corpora[i].length > maxLength) {
+                        maxLength = corpora[i].length;
+                }
+        }
+        Workspace workspace;
+        // escaping takes at most 12 code units for each code unit
+        workspace.units = (uint16_t*)allocate(sizeof(uint16_t) * (maxLength * 12 + 16));
+        workspace.copy = (uint16_t*)allocate(sizeof(uint16_t) * (maxLength + 1));
+        workspace.bytes = (uint8_t*)allocate(maxLength * 3 + 16);
+        workspace.positions = (int64_t*)allocate(sizeof(int64_t) * (maxLength + 1));
+
+        const KernelTable* selected = selectedKernels();
+        for (k = 0; k < (size_t)kernelTablesLength; ++k) {
+                if (!selectKernels(kernelTables[k]->name)) {
+                        continue;
+                }
+                testKnownValues();
+                for (i = 0; i < corporaLength; ++i) {
+                        testCorpus(&corpora[i], &workspace);
+                }
+                printf("%s: tested\n", kernelTables[k]->name);
+        }
+        selectKernels(selected->name);
+        printf("%d test failure(s)\n", failures);
+        if (failures > 0 || testOnly) {
+                return failures > 0 ? 1 : 0;
+        }
+
+        if (tableName != NULL && !selectKernels(tableName)) {
+                fprintf(stderr, "The kernel table %s is unknown or not supported by this CPU.\n", tableName);
+                return 2;
+        }
+        printf("Kernels: %s\n\n", selectedKernels()->name);
+        printf("%-28s %-12s %10s %12s %12s %10s %10s\n", "kernel", "corpus", "bytes", "p50 (us)", "p95 (us)", "GB/s", "cycles/B");
+        for (k = 0; k < kernelsLength; ++k) {
+                if (filter != NULL && strstr(kernels[k].name, filter) == NULL) {
+                        continue;
+                }
+                for (i = 0; i < corporaLength; ++i) {
+                        benchmark(&kernels[k], &corpora[i], &workspace, time);
+                }
+        }
+        return 0;
+}
@@ -1,8 +1,25 @@
 {
+  "variables": {
+    "runtime_stats%": 1,
+    "profiling%": 1
+  },
   "targets": [
     {
       "target_name": "node-stringbuilder",
-      "sources": [ "./src/node-stringbuilder.c" ]
+      "sources": [ "./src/node-stringbuilder.c", "./src/kernels.c" ],
+      "conditions": [
+        [ "runtime_stats == 1", { "defines": [ "RUNTIME_STATS" ] } ],
+        [ "profiling == 1", { "defines": [ "PROFILING" ] } ]
+      ]
+    },
+    {
+      "target_name": "kernel-benchmark",
+      "type": "executable",
+      "sources": [ "./src/kernels.c", "./benchmark/kernels.c" ],
+      "include_dirs": [ "./src" ],
+      "conditions": [
+        [ "OS != 'win'", { "libraries": [ "-lm" ] } ]
+      ]
     }
   ]
 }
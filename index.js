@@ -54,6 +54,7 @@ stringBuilder._initialize(fs.ReadStream, readFileStream, indexOfRegExp);
  * @returns {Promise<StringBuilder>}
  */
 StringBuilder.prototype.appendReadStream = async function(readStream) {
+  var self = this;
   readStream.setEncoding('utf8');
   var promise = new Promise(function(resolve, reject) {
     readStream.on('error', function(err) {
@@ -70,4 +71,182 @@ StringBuilder.prototype.appendReadStream = async function(readStream) {
   return this;
 };
 
+/**
+ * Write the text of this StringBuilder into a file descriptor by using a gather write, segment by segment.
+ * @param {number!} fd The file descriptor.
+ * @param {string} [encoding='utf8'] `utf8` or `utf16le`.
+ * @returns {number} The number of bytes written.
+ */
+StringBuilder.prototype.writevSync = function(fd, encoding) {
+  var buffers = this.toBuffers(encoding);
+  var written = 0;
+  while (buffers.length > 0) {
+    let n = fs.writevSync(fd, buffers);
+    written += n;
+    while (buffers.length > 0 && n >= buffers[0].length) {
+      n -= buffers[0].length;
+      buffers.shift();
+    }
+    if (n > 0) {
+      buffers[0] = buffers[0].subarray(n);
+    }
+  }
+  return written;
+};
+
+/**
+ * Write the text of this StringBuilder into a file descriptor by using a gather write, segment by segment.
+ * <br/>
+ * <b>#Async</b>
+ * @param {number!} fd The file descriptor.
+ * @param {string} [encoding='utf8'] `utf8` or `utf16le`.
+ * @returns {Promise<number>} The number of bytes written.
+ */
+StringBuilder.prototype.writev = async function(fd, encoding) {
+  var buffers = this.toBuffers(encoding);
+  var written = 0;
+  while (buffers.length > 0) {
+    let n = await new Promise(function(resolve, reject) {
+      fs.writev(fd, buffers, function(err, bytesWritten) {
+        if (err) {
+          reject(err);
+        } else {
+          resolve(bytesWritten);
+        }
+      });
+    });
+    written += n;
+    while (buffers.length > 0 && n >= buffers[0].length) {
+      n -= buffers[0].length;
+      buffers.shift();
+    }
+    if (n > 0) {
+      buffers[0] = buffers[0].subarray(n);
+    }
+  }
+  return written;
+};
+
+const tokenBatchSize = 256;
+
+/**
+ * Iterate over the pieces of the text separated by `separator`, creating each string only when it is consumed. The separators are searched natively in batches.
+ * <br/>
+ * The iteration throws an error if this StringBuilder is modified before it finishes.
+ * @param {string|Buffer|StringBuilder!} separator
+ * @param {Object} [options]
+ * @param {boolean} [options.offsets=false] Yield `[start, end]` pairs instead of strings.
+ * @returns {IterableIterator<string|number[]>}
+ */
+StringBuilder.prototype.tokens = function* (separator, options = {}) {
+  if (typeof separator !== 'string') {
+    separator = String(separator);
+  }
+  var offsets = options.offsets === true;
+  var view = this.view();
+  var start = 0;
+  if (separator.length === 0) {
+    let length = view.length();
+    for (; start < length; ++start) {
+      yield offsets ? [start, start + 1] : view.charAt(start);
+    }
+    return;
+  }
+  for (;;) {
+    let found = view.indexOfSkip(separator, start, tokenBatchSize);
+    for (let i = 0; i < found.length; ++i) {
+      let end = found[i];
+      yield offsets ? [start, end] : view.toString(start, end);
+      start = end + separator.length;
+    }
+    if (found.length < tokenBatchSize) {
+      break;
+    }
+  }
+  let end = view.length();
+  yield offsets ? [start, end] : view.toString(start, end);
+};
+
+/**
+ * Iterate over the lines of the text, which are separated by `\n`, creating each string only when it is consumed.
+ * @param {Object} [options] See `tokens`.
+ * @returns {IterableIterator<string|number[]>}
+ */
+StringBuilder.prototype.lines = function(options) {
+  return this.tokens('\n', options);
+};
+
+/**
+ * A pool of StringBuilder instances which can be reused, in order to keep their buffers instead of allocating new ones.
+ */
+class StringBuilderPool {
+  /**
+   * @param {Object} [options]
+   * @param {number} [options.maxIdle=64] The maximum number of idle instances kept by this pool.
+   * @param {number} [options.maxRetainedCapacity=65536] The capacity, in characters, which a released instance is trimmed to if it is bigger.
+   */
+  constructor(options = {}) {
+    this.maxIdle = options.maxIdle === undefined ? 64 : options.maxIdle;
+    this.maxRetainedCapacity = options.maxRetainedCapacity === undefined ? 65536 : options.maxRetainedCapacity;
+    this.idle = [];
+    this.idleSet = new WeakSet();
+    this.hits = 0;
+    this.misses = 0;
+    this.dropped = 0;
+  }
+
+  /**
+   * Get an empty StringBuilder from this pool, or create a new one if there is no idle instance.
+   * @returns {StringBuilder}
+   */
+  acquire() {
+    if (this.idle.length > 0) {
+      let sb = this.idle.pop();
+      this.idleSet.delete(sb);
+      ++this.hits;
+      return sb;
+    }
+    ++this.misses;
+    return new StringBuilder();
+  }
+
+  /**
+   * Give a StringBuilder back to this pool. Its text is cleared, but its buffer is kept up to `maxRetainedCapacity`.
+   * @param {StringBuilder!} sb
+   */
+  release(sb) {
+    if (!(sb instanceof StringBuilder) || this.idleSet.has(sb)) {
+      return;
+    }
+    if (this.idle.length >= this.maxIdle) {
+      ++this.dropped;
+      return;
+    }
+    sb.reset(this.maxRetainedCapacity);
+    this.idle.push(sb);
+    this.idleSet.add(sb);
+  }
+
+  /**
+   * @returns {{hits: number, misses: number, dropped: number, idle: number}}
+   */
+  stats() {
+    return {
+      hits: this.hits,
+      misses: this.misses,
+      dropped: this.dropped,
+      idle: this.idle.length
+    };
+  }
+}
+
+/**
+ * Create a pool of StringBuilder instances.
+ * @param {Object} [options] See `StringBuilderPool`.
+ * @returns {StringBuilderPool}
+ */
+StringBuilder.pool = function(options) {
+  return new StringBuilderPool(options);
+};
+
 module.exports = StringBuilder;
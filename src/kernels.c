@@ -0,0 +1,2085 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <math.h>
+
+#include "kernels.h"
+#include "unicode-tables.h"
+
+// The functions built for SSE4.2 or AVX2 are only called after the CPU is checked, see isKernelTableSupported
+#if defined(SIMD_AVX2)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define targetSSE42
+#define targetAVX2
+#else
+#define targetSSE42 __attribute__((target("sse4.2")))
+#define targetAVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// TODO -----Capacity-----
+
+// The capacity (in bytes) after growing capacity to hold size bytes, in blocks
+int64_t growCapacity(int64_t capacity, int64_t size) {
+        if (capacity >= size) {
+                return capacity;
+        }
+        int64_t count = (size - capacity + blockSize - 1) / blockSize;
+        return capacity + count * blockSize;
+}
+
+// TODO -----Search-----
+
+// Search pattern in source from offset with Boyer-Moore-MagicLen, write the indices of at most limit (which has to be positive) matches into output, and return the number of them. With skip, a match never overlaps the previous one.
+int64_t boyerMooreMagicLenFind(const uint16_t* source, int64_t sourceLength, const uint16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit, bool skip, int64_t* output){
+        if (patternLength == 0 || offset < 0 || sourceLength - offset < patternLength) {
+                return 0;
+        }
+
+        int64_t sourceLength_dec = sourceLength - 1;
+        int64_t patternLength_dec = patternLength - 1;
+        int64_t resultListLength = 0;
+        int64_t badCharShiftMap[65536] = { patternLength };
+        int64_t i;
+        for (i = 0; i < patternLength_dec; ++i) {
+                uint16_t index = pattern[i];
+                badCharShiftMap[index] = patternLength_dec - i;
+        }
+        uint16_t specialChar = pattern[patternLength_dec];
+        int64_t specialShift = badCharShiftMap[specialChar];
+        badCharShiftMap[specialChar] = 0;
+        int64_t sourcePointer = offset + patternLength_dec;
+        int64_t patternPointer;
+        while (sourcePointer < sourceLength) {
+                patternPointer = patternLength_dec;
+                while (patternPointer >= 0) {
+                        if (source[sourcePointer] != pattern[patternPointer]) {
+                                break;
+                        }
+                        --sourcePointer;
+                        --patternPointer;
+                }
+                int64_t starePointer = sourcePointer;
+                int64_t goodSuffixLength_inc = patternLength - patternPointer;
+                sourcePointer += goodSuffixLength_inc;
+                if (patternPointer < 0) {
+                        output[resultListLength++] = starePointer + 1;
+                        if (sourcePointer > sourceLength_dec || resultListLength == limit) {
+                                break;
+                        } else {
+                                sourcePointer += skip ? patternLength_dec : badCharShiftMap[source[sourcePointer]];
+                                continue;
+                        }
+                }
+                int64_t shift1 = (sourcePointer <= sourceLength_dec) ? badCharShiftMap[source[sourcePointer]] : 0;
+                if (shift1 >= patternLength_dec) {
+                        sourcePointer += shift1;
+                } else {
+                        int64_t shift2 = ((source[starePointer] == specialChar) ? specialShift : badCharShiftMap[source[starePointer]]) - goodSuffixLength_inc;
+                        sourcePointer += (shift1 >= shift2) ? shift1 : shift2;
+                }
+        }
+        return resultListLength;
+}
+
+// Search pattern in source backward, skipping offset code units at the end, like boyerMooreMagicLenFind.
+int64_t boyerMooreMagicLenFindRev(const uint16_t* source, int64_t sourceLength, const uint16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit, int64_t* output){
+        if (patternLength == 0 || offset < 0 || sourceLength - offset < patternLength) {
+                return 0;
+        }
+
+        int64_t sourceLength_dec = sourceLength - 1;
+        int64_t patternLength_dec = patternLength - 1;
+        int64_t resultListLength = 0;
+        int64_t badCharShiftMap[65536] = { patternLength };
+        int64_t i;
+        for (i = patternLength_dec; i > 0; --i) {
+                uint16_t index = pattern[i];
+                badCharShiftMap[index] = i;
+        }
+        uint16_t specialChar = pattern[patternLength_dec];
+        int64_t specialShift = badCharShiftMap[specialChar];
+        badCharShiftMap[specialChar] = 0;
+        int64_t sourcePointer = sourceLength_dec - patternLength_dec - offset;
+        int64_t patternPointer;
+        while (sourcePointer >= 0) {
+                patternPointer = 0;
+                while (patternPointer < patternLength) {
+                        if (source[sourcePointer] != pattern[patternPointer]) {
+                                break;
+                        }
+                        ++sourcePointer;
+                        ++patternPointer;
+                }
+                int64_t starePointer = sourcePointer;
+                int64_t goodSuffixLength_inc = patternPointer + 1;
+                sourcePointer -= goodSuffixLength_inc;
+                if (patternPointer >= patternLength) {
+                        output[resultListLength++] = sourcePointer + 1;
+                        if (sourcePointer < 0 || resultListLength == limit) {
+                                break;
+                        } else {
+                                sourcePointer -= badCharShiftMap[source[sourcePointer]];
+                                continue;
+                        }
+                }
+                int64_t shift1 = (sourcePointer >= 0) ? badCharShiftMap[source[sourcePointer]] : 0;
+                if (shift1 >= patternLength_dec) {
+                        sourcePointer -= shift1;
+                } else {
+                        int64_t shift2 = ((source[starePointer] == specialChar) ? specialShift : badCharShiftMap[source[starePointer]]) - goodSuffixLength_inc;
+                        sourcePointer -= (shift1 >= shift2) ? shift1 : shift2;
+                }
+        }
+        return resultListLength;
+}
+// TODO -----Text-----
+
+// Decode UTF-8 into UTF-16 the way V8 does (the WHATWG decoder, which replaces each maximal invalid subpart with U+FFFD), and return the number of code units. If output is NULL, only count.
+int64_t decodeUTF8(const uint8_t* data, int64_t length, uint16_t* output) {
+        int64_t i, count = 0;
+        uint32_t codePoint = 0, bytesNeeded = 0, bytesSeen = 0;
+        uint8_t lowerBoundary = 0x80, upperBoundary = 0xBF;
+        for (i = 0; i < length; ++i) {
+                uint8_t b = data[i];
+                if (bytesNeeded == 0) {
+                        if (b < 0x80) {
+                                if (output) {
+                                        output[count] = b;
+                                }
+                                ++count;
+                                continue;
+                        }
+                        if (b >= 0xC2 && b <= 0xDF) {
+                                bytesNeeded = 1;
+                                codePoint = b & 0x1F;
+                        } else if (b >= 0xE0 && b <= 0xEF) {
+                                if (b == 0xE0) {
+                                        lowerBoundary = 0xA0;
+                                } else if (b == 0xED) {
+                                        upperBoundary = 0x9F;
+                                }
+                                bytesNeeded = 2;
+                                codePoint = b & 0xF;
+                        } else if (b >= 0xF0 && b <= 0xF4) {
+                                if (b == 0xF0) {
+                                        lowerBoundary = 0x90;
+                                } else if (b == 0xF4) {
+                                        upperBoundary = 0x8F;
+                                }
+                                bytesNeeded = 3;
+                                codePoint = b & 0x7;
+                        } else {
+                                if (output) {
+                                        output[count] = 0xFFFD;
+                                }
+                                ++count;
+                        }
+                        continue;
+                }
+                if (b < lowerBoundary || b > upperBoundary) {
+                        codePoint = bytesNeeded = bytesSeen = 0;
+                        lowerBoundary = 0x80;
+                        upperBoundary = 0xBF;
+                        if (output) {
+                                output[count] = 0xFFFD;
+                        }
+                        ++count;
+                        --i;
+                        continue;
+                }
+                lowerBoundary = 0x80;
+                upperBoundary = 0xBF;
+                codePoint = (codePoint << 6) | (b & 0x3F);
+                if (++bytesSeen < bytesNeeded) {
+                        continue;
+                }
+                if (codePoint >= 0x10000) {
+                        if (output) {
+                                output[count] = 0xD800 + ((codePoint - 0x10000) >> 10);
+                                output[count + 1] = 0xDC00 + ((codePoint - 0x10000) & 0x3FF);
+                        }
+                        count += 2;
+                } else {
+                        if (output) {
+                                output[count] = codePoint;
+                        }
+                        ++count;
+                }
+                codePoint = bytesNeeded = bytesSeen = 0;
+        }
+        if (bytesNeeded != 0) {
+                if (output) {
+                        output[count] = 0xFFFD;
+                }
+                ++count;
+        }
+        return count;
+}
+
+// The White_Space characters trimmed by String.prototype.trim.
+bool isWhiteSpace(uint16_t characterCode) {
+        if (characterCode <= 32) {
+                return characterCode == 32 || (characterCode >= 9 && characterCode <= 13);
+        }
+        if (characterCode < 160) {
+                return false;
+        }
+        return characterCode == 160 || characterCode == 5760 || (characterCode >= 8192 && characterCode <= 8202) || characterCode == 8232 || characterCode == 8233 || characterCode == 8239 || characterCode == 8287 || characterCode == 12288 || characterCode == 65279;
+}
+
+// Return the index of the first non-whitespace code unit in data[start..end), or end.
+int64_t skipWhiteSpaceForwardScalar(const uint16_t* data, int64_t start, int64_t end) {
+        while (start < end && isWhiteSpace(data[start])) {
+                ++start;
+        }
+        return start;
+}
+
+// Return the index after the last non-whitespace code unit in data[start..end), or start.
+int64_t skipWhiteSpaceBackwardScalar(const uint16_t* data, int64_t start, int64_t end) {
+        while (end > start && isWhiteSpace(data[end - 1])) {
+                --end;
+        }
+        return end;
+}
+
+// The SIMD variants skip runs of ASCII whitespace a block at a time.
+#if defined(SIMD_SSE2)
+bool isASCIIWhiteSpaceBlockSSE2(__m128i v) {
+        __m128i isSpace = _mm_cmpeq_epi16(v, _mm_set1_epi16(32));
+        __m128i isControl = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16(8)), _mm_cmplt_epi16(v, _mm_set1_epi16(14)));
+        return _mm_movemask_epi8(_mm_or_si128(isSpace, isControl)) == 0xFFFF;
+}
+
+int64_t skipWhiteSpaceForwardSSE2(const uint16_t* data, int64_t start, int64_t end) {
+        while (start < end) {
+                while (start + 8 <= end && isASCIIWhiteSpaceBlockSSE2(_mm_loadu_si128((const __m128i*)(data + start)))) {
+                        start += 8;
+                }
+                if (start < end && isWhiteSpace(data[start])) {
+                        ++start;
+                } else {
+                        break;
+                }
+        }
+        return start;
+}
+
+int64_t skipWhiteSpaceBackwardSSE2(const uint16_t* data, int64_t start, int64_t end) {
+        while (end > start) {
+                while (end - 8 >= start && isASCIIWhiteSpaceBlockSSE2(_mm_loadu_si128((const __m128i*)(data + end - 8)))) {
+                        end -= 8;
+                }
+                if (end > start && isWhiteSpace(data[end - 1])) {
+                        --end;
+                } else {
+                        break;
+                }
+        }
+        return end;
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 bool isASCIIWhiteSpaceBlockAVX2(__m256i v) {
+        __m256i isSpace = _mm256_cmpeq_epi16(v, _mm256_set1_epi16(32));
+        __m256i isControl = _mm256_and_si256(_mm256_cmpgt_epi16(v, _mm256_set1_epi16(8)), _mm256_cmpgt_epi16(_mm256_set1_epi16(14), v));
+        return (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(isSpace, isControl)) == 0xFFFFFFFF;
+}
+
+targetAVX2 int64_t skipWhiteSpaceForwardAVX2(const uint16_t* data, int64_t start, int64_t end) {
+        while (start < end) {
+                while (start + 16 <= end && isASCIIWhiteSpaceBlockAVX2(_mm256_loadu_si256((const __m256i*)(data + start)))) {
+                        start += 16;
+                }
+                if (start < end && isWhiteSpace(data[start])) {
+                        ++start;
+                } else {
+                        break;
+                }
+        }
+        return start;
+}
+
+targetAVX2 int64_t skipWhiteSpaceBackwardAVX2(const uint16_t* data, int64_t start, int64_t end) {
+        while (end > start) {
+                while (end - 16 >= start && isASCIIWhiteSpaceBlockAVX2(_mm256_loadu_si256((const __m256i*)(data + end - 16)))) {
+                        end -= 16;
+                }
+                if (end > start && isWhiteSpace(data[end - 1])) {
+                        --end;
+                } else {
+                        break;
+                }
+        }
+        return end;
+}
+#endif
+
+#if defined(SIMD_NEON)
+bool isASCIIWhiteSpaceBlockNEON(uint16x8_t v) {
+        uint16x8_t isSpace = vceqq_u16(v, vdupq_n_u16(32));
+        uint16x8_t isControl = vandq_u16(vcgeq_u16(v, vdupq_n_u16(9)), vcleq_u16(v, vdupq_n_u16(13)));
+        return vminvq_u16(vorrq_u16(isSpace, isControl)) != 0;
+}
+
+int64_t skipWhiteSpaceForwardNEON(const uint16_t* data, int64_t start, int64_t end) {
+        while (start < end) {
+                while (start + 8 <= end && isASCIIWhiteSpaceBlockNEON(vld1q_u16(data + start))) {
+                        start += 8;
+                }
+                if (start < end && isWhiteSpace(data[start])) {
+                        ++start;
+                } else {
+                        break;
+                }
+        }
+        return start;
+}
+
+int64_t skipWhiteSpaceBackwardNEON(const uint16_t* data, int64_t start, int64_t end) {
+        while (end > start) {
+                while (end - 8 >= start && isASCIIWhiteSpaceBlockNEON(vld1q_u16(data + end - 8))) {
+                        end -= 8;
+                }
+                if (end > start && isWhiteSpace(data[end - 1])) {
+                        --end;
+                } else {
+                        break;
+                }
+        }
+        return end;
+}
+#endif
+int64_t log2Floor(int64_t n) {
+        return (int64_t)floor(log2(n));
+}
+
+uint32_t mapCase(const CaseMappingRange* ranges, int64_t rangesLength, uint32_t codePoint) {
+        int64_t low = 0, high = rangesLength - 1;
+        while (low <= high) {
+                int64_t middle = (low + high) / 2;
+                const CaseMappingRange* range = ranges + middle;
+                if (codePoint < range->start) {
+                        high = middle - 1;
+                } else if (codePoint > range->end) {
+                        low = middle + 1;
+                } else {
+                        if ((codePoint - range->start) % range->stride == 0) {
+                                return codePoint + range->delta;
+                        }
+                        return codePoint;
+                }
+        }
+        return codePoint;
+}
+
+// Convert data[i..end) code unit by code unit. A surrogate pair crossing `end` is converted as a whole, so the returned index may be end + 1.
+int64_t convertCaseRange(uint16_t* data, int64_t length, int64_t i, int64_t end, bool upper) {
+        const CaseMappingRange* ranges = upper ? upperCaseRanges : lowerCaseRanges;
+        int64_t rangesLength = upper ? sizeof(upperCaseRanges) / sizeof(CaseMappingRange) : sizeof(lowerCaseRanges) / sizeof(CaseMappingRange);
+        for (; i < end; ++i) {
+                uint16_t v = data[i];
+                if (v < 128) {
+                        if (upper) {
+                                if (v >= 97 && v <= 122) {
+                                        data[i] = v - 32;
+                                }
+                        } else if (v >= 65 && v <= 90) {
+                                data[i] = v + 32;
+                        }
+                } else if (v >= 0xD800 && v <= 0xDBFF) {
+                        if (i + 1 < length && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                                uint32_t codePoint = 0x10000 + ((v - 0xD800) << 10) + (data[i + 1] - 0xDC00);
+                                codePoint = mapCase(ranges, rangesLength, codePoint) - 0x10000;
+                                data[i] = 0xD800 + (codePoint >> 10);
+                                data[i + 1] = 0xDC00 + (codePoint & 0x3FF);
+                                ++i;
+                        }
+                } else if (v < 0xDC00 || v > 0xDFFF) {
+                        data[i] = mapCase(ranges, rangesLength, v);
+                }
+        }
+        return i;
+}
+
+void convertCaseScalar(uint16_t* data, int64_t length, bool upper) {
+        convertCaseRange(data, length, 0, length, upper);
+}
+
+// The SIMD variants convert ASCII letters a block at a time, and only the blocks containing non-ASCII data go through the Unicode tables.
+#if defined(SIMD_SSE2)
+void convertCaseSSE2(uint16_t* data, int64_t length, bool upper) {
+        int64_t i = 0;
+        uint16_t from = upper ? 97 : 65;
+        __m128i lowerBound = _mm_set1_epi16(from - 1);
+        __m128i upperBound = _mm_set1_epi16(from + 26);
+        __m128i difference = _mm_set1_epi16(32);
+        __m128i asciiMask = _mm_set1_epi16((short)0xFF80);
+        __m128i zero = _mm_setzero_si128();
+        while (i + 8 <= length) {
+                __m128i v = _mm_loadu_si128((__m128i*)(data + i));
+                __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi16(v, lowerBound), _mm_cmplt_epi16(v, upperBound));
+                __m128i delta = _mm_and_si128(isLetter, difference);
+                v = upper ? _mm_sub_epi16(v, delta) : _mm_add_epi16(v, delta);
+                _mm_storeu_si128((__m128i*)(data + i), v);
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, asciiMask), zero)) != 0xFFFF) {
+                        i = convertCaseRange(data, length, i, i + 8, upper);
+                } else {
+                        i += 8;
+                }
+        }
+        convertCaseRange(data, length, i, length, upper);
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 void convertCaseAVX2(uint16_t* data, int64_t length, bool upper) {
+        int64_t i = 0;
+        uint16_t from = upper ? 97 : 65;
+        __m256i lowerBound = _mm256_set1_epi16(from - 1);
+        __m256i upperBound = _mm256_set1_epi16(from + 26);
+        __m256i difference = _mm256_set1_epi16(32);
+        __m256i asciiMask = _mm256_set1_epi16((short)0xFF80);
+        __m256i zero = _mm256_setzero_si256();
+        while (i + 16 <= length) {
+                __m256i v = _mm256_loadu_si256((__m256i*)(data + i));
+                __m256i isLetter = _mm256_and_si256(_mm256_cmpgt_epi16(v, lowerBound), _mm256_cmpgt_epi16(upperBound, v));
+                __m256i delta = _mm256_and_si256(isLetter, difference);
+                v = upper ? _mm256_sub_epi16(v, delta) : _mm256_add_epi16(v, delta);
+                _mm256_storeu_si256((__m256i*)(data + i), v);
+                if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, asciiMask), zero)) != 0xFFFFFFFF) {
+                        i = convertCaseRange(data, length, i, i + 16, upper);
+                } else {
+                        i += 16;
+                }
+        }
+        convertCaseRange(data, length, i, length, upper);
+}
+#endif
+
+#if defined(SIMD_NEON)
+void convertCaseNEON(uint16_t* data, int64_t length, bool upper) {
+        int64_t i = 0;
+        uint16_t from = upper ? 97 : 65;
+        uint16x8_t lowerBound = vdupq_n_u16(from);
+        uint16x8_t upperBound = vdupq_n_u16(from + 25);
+        uint16x8_t difference = vdupq_n_u16(32);
+        while (i + 8 <= length) {
+                uint16x8_t v = vld1q_u16(data + i);
+                uint16x8_t isLetter = vandq_u16(vcgeq_u16(v, lowerBound), vcleq_u16(v, upperBound));
+                uint16x8_t delta = vandq_u16(isLetter, difference);
+                v = upper ? vsubq_u16(v, delta) : vaddq_u16(v, delta);
+                vst1q_u16(data + i, v);
+                if (vmaxvq_u16(v) >= 128) {
+                        i = convertCaseRange(data, length, i, i + 8, upper);
+                } else {
+                        i += 8;
+                }
+        }
+        convertCaseRange(data, length, i, length, upper);
+}
+#endif
+uint32_t countTrailingZeros(uint32_t n) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, n);
+        return index;
+#else
+        return __builtin_ctz(n);
+#endif
+}
+
+uint32_t countOnes(uint32_t n) {
+#if defined(_MSC_VER)
+        return __popcnt(n);
+#else
+        return __builtin_popcount(n);
+#endif
+}
+
+// Return the index of the first different code unit, or length if there is none.
+int64_t findMismatchScalar(const uint16_t* a, const uint16_t* b, int64_t length) {
+        int64_t i;
+        for (i = 0; i < length; ++i) {
+                if (a[i] != b[i]) {
+                        return i;
+                }
+        }
+        return length;
+}
+
+#if defined(SIMD_SSE2)
+int64_t findMismatchSSE2(const uint16_t* a, const uint16_t* b, int64_t length) {
+        int64_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+                __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+                uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi16(va, vb));
+                if (mask != 0xFFFF) {
+                        return i + countTrailingZeros(~mask & 0xFFFF) / 2;
+                }
+        }
+        return i + findMismatchScalar(a + i, b + i, length - i);
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 int64_t findMismatchAVX2(const uint16_t* a, const uint16_t* b, int64_t length) {
+        int64_t i = 0;
+        for (; i + 16 <= length; i += 16) {
+                __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+                __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+                uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(va, vb));
+                if (mask != 0xFFFFFFFF) {
+                        return i + countTrailingZeros(~mask) / 2;
+                }
+        }
+        return i + findMismatchScalar(a + i, b + i, length - i);
+}
+#endif
+
+#if defined(SIMD_NEON)
+int64_t findMismatchNEON(const uint16_t* a, const uint16_t* b, int64_t length) {
+        int64_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+                if (vminvq_u16(vceqq_u16(vld1q_u16(a + i), vld1q_u16(b + i))) == 0) {
+                        break;
+                }
+        }
+        return i + findMismatchScalar(a + i, b + i, length - i);
+}
+#endif
+int compareUTF16(const uint16_t* a, int64_t aLength, const uint16_t* b, int64_t bLength) {
+        int64_t length = aLength < bLength ? aLength : bLength;
+        int64_t i = findMismatch(a, b, length);
+        if (i < length) {
+                return a[i] < b[i] ? -1 : 1;
+        }
+        return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+// The code unit at index i after the simple uppercase mapping of the code point it belongs to.
+uint16_t foldCodeUnitAt(const uint16_t* data, int64_t length, int64_t i) {
+        uint16_t v = data[i];
+        if (v < 128) {
+                return (v >= 97 && v <= 122) ? v - 32 : v;
+        }
+        uint32_t codePoint;
+        if (v >= 0xD800 && v <= 0xDBFF) {
+                if (i + 1 < length && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                        codePoint = 0x10000 + ((v - 0xD800) << 10) + (data[i + 1] - 0xDC00);
+                        codePoint = mapCase(upperCaseRanges, sizeof(upperCaseRanges) / sizeof(CaseMappingRange), codePoint) - 0x10000;
+                        return 0xD800 + (codePoint >> 10);
+                }
+                return v;
+        }
+        if (v >= 0xDC00 && v <= 0xDFFF) {
+                if (i > 0 && data[i - 1] >= 0xD800 && data[i - 1] <= 0xDBFF) {
+                        codePoint = 0x10000 + ((data[i - 1] - 0xD800) << 10) + (v - 0xDC00);
+                        codePoint = mapCase(upperCaseRanges, sizeof(upperCaseRanges) / sizeof(CaseMappingRange), codePoint) - 0x10000;
+                        return 0xDC00 + (codePoint & 0x3FF);
+                }
+                return v;
+        }
+        return mapCase(upperCaseRanges, sizeof(upperCaseRanges) / sizeof(CaseMappingRange), v);
+}
+
+int compareUTF16IgnoreCaseScalar(const uint16_t* a, int64_t aLength, const uint16_t* b, int64_t bLength, int64_t i, int64_t end) {
+        for (; i < end; ++i) {
+                uint16_t va = foldCodeUnitAt(a, aLength, i);
+                uint16_t vb = foldCodeUnitAt(b, bLength, i);
+                if (va != vb) {
+                        return va < vb ? -1 : 1;
+                }
+        }
+        return 0;
+}
+
+// Blocks of ASCII data are folded and compared 8 code units at a time. A block containing non-ASCII data or a difference is compared by the scalar path.
+int compareUTF16IgnoreCase(const uint16_t* a, int64_t aLength, const uint16_t* b, int64_t bLength) {
+        int64_t length = aLength < bLength ? aLength : bLength;
+        int64_t i = 0;
+        int c;
+#if defined(SIMD_SSE2)
+        __m128i lowerBound = _mm_set1_epi16(96);
+        __m128i upperBound = _mm_set1_epi16(123);
+        __m128i difference = _mm_set1_epi16(32);
+        __m128i asciiMask = _mm_set1_epi16((short)0xFF80);
+        __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= length; i += 8) {
+                __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(_mm_or_si128(va, vb), asciiMask), zero)) == 0xFFFF) {
+                        va = _mm_sub_epi16(va, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi16(va, lowerBound), _mm_cmplt_epi16(va, upperBound)), difference));
+                        vb = _mm_sub_epi16(vb, _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi16(vb, lowerBound), _mm_cmplt_epi16(vb, upperBound)), difference));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi16(va, vb)) == 0xFFFF) {
+                                continue;
+                        }
+                }
+                c = compareUTF16IgnoreCaseScalar(a, aLength, b, bLength, i, i + 8);
+                if (c != 0) {
+                        return c;
+                }
+        }
+#elif defined(SIMD_NEON)
+        uint16x8_t lowerBound = vdupq_n_u16(97);
+        uint16x8_t upperBound = vdupq_n_u16(122);
+        uint16x8_t difference = vdupq_n_u16(32);
+        for (; i + 8 <= length; i += 8) {
+                uint16x8_t va = vld1q_u16(a + i);
+                uint16x8_t vb = vld1q_u16(b + i);
+                if (vmaxvq_u16(vorrq_u16(va, vb)) < 128) {
+                        va = vsubq_u16(va, vandq_u16(vandq_u16(vcgeq_u16(va, lowerBound), vcleq_u16(va, upperBound)), difference));
+                        vb = vsubq_u16(vb, vandq_u16(vandq_u16(vcgeq_u16(vb, lowerBound), vcleq_u16(vb, upperBound)), difference));
+                        if (vminvq_u16(vceqq_u16(va, vb)) != 0) {
+                                continue;
+                        }
+                }
+                c = compareUTF16IgnoreCaseScalar(a, aLength, b, bLength, i, i + 8);
+                if (c != 0) {
+                        return c;
+                }
+        }
+#endif
+        c = compareUTF16IgnoreCaseScalar(a, aLength, b, bLength, i, length);
+        if (c != 0) {
+                return c;
+        }
+        return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+// The word counting state machine of count, driven by tables. Modes: 0: normal, 1: appending, 2: integer, 3: prefloat, 4: float. Classes: 0: digit, 1: letter, 2: non-ASCII, 3: dot, 4: others.
+static const uint8_t wordNextMode[5][5] = {
+        {2, 1, 0, 0, 0},
+        {1, 1, 0, 0, 0},
+        {2, 1, 0, 3, 0},
+        {4, 1, 0, 0, 0},
+        {4, 1, 0, 0, 0}
+};
+
+static const uint8_t wordIncrement[5][5] = {
+        {0, 0, 1, 0, 0},
+        {0, 0, 2, 1, 1},
+        {0, 0, 2, 0, 1},
+        {0, 1, 2, 1, 1},
+        {0, 1, 2, 1, 1}
+};
+
+uint8_t wordClass(uint16_t v) {
+        if (v > 127) {
+                return 2;
+        }
+        if (v >= 48 && v <= 57) {
+                return 0;
+        }
+        if ((v >= 65 && v <= 90) || (v >= 97 && v <= 122)) {
+                return 1;
+        }
+        return v == 46 ? 3 : 4;
+}
+
+// Count the words the way count does, see wordNextMode
+int64_t countWordsUTF16(const uint16_t* data, int64_t length) {
+        uint8_t mode = 0;
+        int64_t sum = 0, i;
+        for (i = 0; i < length; ++i) {
+                uint8_t c = wordClass(data[i]);
+                sum += wordIncrement[mode][c];
+                mode = wordNextMode[mode][c];
+        }
+        if (mode != 0) {
+                ++sum;
+        }
+        return sum;
+}
+
+// Measure data[i..end) code unit by code unit. A surrogate pair crossing `end` is measured as a whole, so the returned index may be end + 1.
+int64_t measureUTF16Range(const uint16_t* data, int64_t length, int64_t i, int64_t end, TextStatistics* statistics) {
+        for (; i < end; ++i) {
+                uint16_t v = data[i];
+                statistics->codePoints += 1;
+                if (v < 0x80) {
+                        statistics->utf8Length += 1;
+                        if (v == 10) {
+                                statistics->lines += 1;
+                        }
+                } else if (v < 0x800) {
+                        statistics->utf8Length += 2;
+                } else if (v >= 0xD800 && v <= 0xDBFF && i + 1 < length && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                        statistics->utf8Length += 4;
+                        ++i;
+                } else {
+                        statistics->utf8Length += 3;
+                }
+        }
+        return i;
+}
+
+// Run the word counting state machine over data[i..end)
+void countWordsRange(const uint16_t* data, int64_t i, int64_t end, uint8_t* mode, TextStatistics* statistics) {
+        for (; i < end; ++i) {
+                uint8_t c = wordClass(data[i]);
+                statistics->words += wordIncrement[*mode][c];
+                *mode = wordNextMode[*mode][c];
+        }
+}
+
+void finishMeasure(const uint16_t* data, int64_t length, uint8_t mode, TextStatistics* statistics) {
+        if (mode != 0) {
+                statistics->words += 1;
+        }
+        if (length > 0 && data[length - 1] != 10) {
+                statistics->lines += 1;
+        }
+}
+
+// Count line feeds, code points, UTF-8 bytes and optionally words in one pass.
+void measureUTF16Scalar(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics) {
+        uint8_t mode = 0;
+        memset(statistics, 0, sizeof(TextStatistics));
+        measureUTF16Range(data, length, 0, length, statistics);
+        if (countWords) {
+                countWordsRange(data, 0, length, &mode, statistics);
+        }
+        finishMeasure(data, length, mode, statistics);
+}
+
+// The SIMD variants measure the blocks without surrogates at once.
+#if defined(SIMD_SSE2)
+void measureUTF16SSE2(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics) {
+        int64_t i = 0;
+        uint8_t mode = 0;
+        __m128i zero = _mm_setzero_si128();
+        memset(statistics, 0, sizeof(TextStatistics));
+        while (i < length) {
+                int64_t blockStart = i;
+                if (i + 8 <= length) {
+                        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+                        __m128i top = _mm_and_si128(v, _mm_set1_epi16((short)0xF800));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi16(top, _mm_set1_epi16((short)0xD800))) == 0) {
+                                uint32_t ascii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xFF80)), zero));
+                                uint32_t below800 = _mm_movemask_epi8(_mm_cmpeq_epi16(top, zero));
+                                uint32_t lineFeeds = _mm_movemask_epi8(_mm_cmpeq_epi16(v, _mm_set1_epi16(10)));
+                                statistics->codePoints += 8;
+                                statistics->utf8Length += 24 - (countOnes(ascii) + countOnes(below800)) / 2;
+                                statistics->lines += countOnes(lineFeeds) / 2;
+                                i += 8;
+                        } else {
+                                i = measureUTF16Range(data, length, i, i + 8, statistics);
+                        }
+                } else {
+                        i = measureUTF16Range(data, length, i, length, statistics);
+                }
+                if (countWords) {
+                        countWordsRange(data, blockStart, i, &mode, statistics);
+                }
+        }
+        finishMeasure(data, length, mode, statistics);
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 void measureUTF16AVX2(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics) {
+        int64_t i = 0;
+        uint8_t mode = 0;
+        __m256i zero = _mm256_setzero_si256();
+        memset(statistics, 0, sizeof(TextStatistics));
+        while (i < length) {
+                int64_t blockStart = i;
+                if (i + 16 <= length) {
+                        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+                        __m256i top = _mm256_and_si256(v, _mm256_set1_epi16((short)0xF800));
+                        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(top, _mm256_set1_epi16((short)0xD800))) == 0) {
+                                uint32_t ascii = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16((short)0xFF80)), zero));
+                                uint32_t below800 = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(top, zero));
+                                uint32_t lineFeeds = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, _mm256_set1_epi16(10)));
+                                statistics->codePoints += 16;
+                                statistics->utf8Length += 48 - (countOnes(ascii) + countOnes(below800)) / 2;
+                                statistics->lines += countOnes(lineFeeds) / 2;
+                                i += 16;
+                        } else {
+                                i = measureUTF16Range(data, length, i, i + 16, statistics);
+                        }
+                } else {
+                        i = measureUTF16Range(data, length, i, length, statistics);
+                }
+                if (countWords) {
+                        countWordsRange(data, blockStart, i, &mode, statistics);
+                }
+        }
+        finishMeasure(data, length, mode, statistics);
+}
+#endif
+
+#if defined(SIMD_NEON)
+void measureUTF16NEON(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics) {
+        int64_t i = 0;
+        uint8_t mode = 0;
+        memset(statistics, 0, sizeof(TextStatistics));
+        while (i < length) {
+                int64_t blockStart = i;
+                if (i + 8 <= length) {
+                        uint16x8_t v = vld1q_u16(data + i);
+                        uint16x8_t top = vandq_u16(v, vdupq_n_u16(0xF800));
+                        if (vmaxvq_u16(vceqq_u16(top, vdupq_n_u16(0xD800))) == 0) {
+                                uint16x8_t one = vdupq_n_u16(1);
+                                uint16x8_t bytes = vaddq_u16(vaddq_u16(one, vandq_u16(vcgeq_u16(v, vdupq_n_u16(0x80)), one)), vandq_u16(vcgeq_u16(v, vdupq_n_u16(0x800)), one));
+                                statistics->codePoints += 8;
+                                statistics->utf8Length += vaddvq_u16(bytes);
+                                statistics->lines += vaddvq_u16(vandq_u16(vceqq_u16(v, vdupq_n_u16(10)), one));
+                                i += 8;
+                        } else {
+                                i = measureUTF16Range(data, length, i, i + 8, statistics);
+                        }
+                } else {
+                        i = measureUTF16Range(data, length, i, length, statistics);
+                }
+                if (countWords) {
+                        countWordsRange(data, blockStart, i, &mode, statistics);
+                }
+        }
+        finishMeasure(data, length, mode, statistics);
+}
+#endif
+#if defined(SIMD_SSE2)
+__m128i reverseBlock(__m128i v) {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        return _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+}
+#elif defined(SIMD_NEON)
+uint16x8_t reverseBlock(uint16x8_t v) {
+        v = vrev64q_u16(v);
+        return vextq_u16(v, v, 4);
+}
+#endif
+
+// Reverse in place by swapping blocks of 8 code units from both ends.
+void reverseCodeUnits(uint16_t* data, int64_t length) {
+        int64_t start = 0, end = length;
+#if defined(SIMD_SSE2)
+        while (end - start >= 16) {
+                __m128i head = _mm_loadu_si128((__m128i*)(data + start));
+                __m128i tail = _mm_loadu_si128((__m128i*)(data + end - 8));
+                _mm_storeu_si128((__m128i*)(data + start), reverseBlock(tail));
+                _mm_storeu_si128((__m128i*)(data + end - 8), reverseBlock(head));
+                start += 8;
+                end -= 8;
+        }
+#elif defined(SIMD_NEON)
+        while (end - start >= 16) {
+                uint16x8_t head = vld1q_u16(data + start);
+                uint16x8_t tail = vld1q_u16(data + end - 8);
+                vst1q_u16(data + start, reverseBlock(tail));
+                vst1q_u16(data + end - 8, reverseBlock(head));
+                start += 8;
+                end -= 8;
+        }
+#endif
+        for (--end; start < end; ++start, --end) {
+                uint16_t t = data[start];
+                data[start] = data[end];
+                data[end] = t;
+        }
+}
+
+// Swap the two code units of every surrogate pair, so that reversing the code units afterwards keeps the pairs in order.
+void reverseSurrogatePairs(uint16_t* data, int64_t length) {
+        int64_t i = 0;
+        while (i < length - 1) {
+#if defined(SIMD_SSE2)
+                if (i + 8 <= length) {
+                        __m128i top = _mm_and_si128(_mm_loadu_si128((__m128i*)(data + i)), _mm_set1_epi16((short)0xF800));
+                        if (_mm_movemask_epi8(_mm_cmpeq_epi16(top, _mm_set1_epi16((short)0xD800))) == 0) {
+                                i += 8;
+                                continue;
+                        }
+                }
+#elif defined(SIMD_NEON)
+                if (i + 8 <= length) {
+                        uint16x8_t top = vandq_u16(vld1q_u16(data + i), vdupq_n_u16(0xF800));
+                        if (vmaxvq_u16(vceqq_u16(top, vdupq_n_u16(0xD800))) == 0) {
+                                i += 8;
+                                continue;
+                        }
+                }
+#endif
+                if (data[i] >= 0xD800 && data[i] <= 0xDBFF && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                        uint16_t t = data[i];
+                        data[i] = data[i + 1];
+                        data[i + 1] = t;
+                        i += 2;
+                } else {
+                        ++i;
+                }
+        }
+}
+
+enum GraphemeBreakClass {
+        graphemeOther, graphemeCR, graphemeLF, graphemeControl, graphemeExtend, graphemeZWJ, graphemeRegionalIndicator, graphemePrepend, graphemeSpacingMark, graphemeL, graphemeV, graphemeT, graphemeLV, graphemeLVT
+};
+
+bool inCodePointRanges(const CodePointRange* ranges, int64_t rangesLength, uint32_t codePoint) {
+        int64_t low = 0, high = rangesLength - 1;
+        if (codePoint < ranges[0].start) {
+                return false;
+        }
+        while (low <= high) {
+                int64_t middle = (low + high) / 2;
+                if (codePoint < ranges[middle].start) {
+                        high = middle - 1;
+                } else if (codePoint > ranges[middle].end) {
+                        low = middle + 1;
+                } else {
+                        return true;
+                }
+        }
+        return false;
+}
+
+enum GraphemeBreakClass graphemeBreakClass(uint32_t codePoint) {
+        if (codePoint < 0x7F) {
+                if (codePoint >= 0x20) {
+                        return graphemeOther;
+                }
+                return codePoint == 13 ? graphemeCR : (codePoint == 10 ? graphemeLF : graphemeControl);
+        }
+        if (codePoint == 0x200D) {
+                return graphemeZWJ;
+        }
+        if (codePoint >= 0x1F1E6 && codePoint <= 0x1F1FF) {
+                return graphemeRegionalIndicator;
+        }
+        if ((codePoint >= 0x1100 && codePoint <= 0x115F) || (codePoint >= 0xA960 && codePoint <= 0xA97C)) {
+                return graphemeL;
+        }
+        if ((codePoint >= 0x1160 && codePoint <= 0x11A7) || (codePoint >= 0xD7B0 && codePoint <= 0xD7C6)) {
+                return graphemeV;
+        }
+        if ((codePoint >= 0x11A8 && codePoint <= 0x11FF) || (codePoint >= 0xD7CB && codePoint <= 0xD7FB)) {
+                return graphemeT;
+        }
+        if (codePoint >= 0xAC00 && codePoint <= 0xD7A3) {
+                return (codePoint - 0xAC00) % 28 == 0 ? graphemeLV : graphemeLVT;
+        }
+        if (inCodePointRanges(extendRanges, sizeof(extendRanges) / sizeof(CodePointRange), codePoint)) {
+                return graphemeExtend;
+        }
+        if (inCodePointRanges(controlRanges, sizeof(controlRanges) / sizeof(CodePointRange), codePoint)) {
+                return graphemeControl;
+        }
+        if (inCodePointRanges(spacingMarkRanges, sizeof(spacingMarkRanges) / sizeof(CodePointRange), codePoint)) {
+                return graphemeSpacingMark;
+        }
+        if (inCodePointRanges(prependRanges, sizeof(prependRanges) / sizeof(CodePointRange), codePoint)) {
+                return graphemePrepend;
+        }
+        return graphemeOther;
+}
+
+// Reverse the code units of every extended grapheme cluster (UAX #29, without the Indic conjunct rule GB9c), so that reversing the code units afterwards keeps the clusters in order.
+void reverseGraphemeClusters(uint16_t* data, int64_t length) {
+        int64_t i = 0, clusterStart = 0;
+        enum GraphemeBreakClass previous = graphemeControl;
+        bool pictographicSequence = false, pictographicJoiner = false;
+        int64_t regionalIndicatorCount = 0;
+        while (i < length) {
+                uint32_t codePoint = data[i];
+                int64_t width = 1;
+                if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < length && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (data[i + 1] - 0xDC00);
+                        width = 2;
+                }
+                enum GraphemeBreakClass current = graphemeBreakClass(codePoint);
+                bool pictographic = codePoint >= 0xA9 && inCodePointRanges(extendedPictographicRanges, sizeof(extendedPictographicRanges) / sizeof(CodePointRange), codePoint);
+                bool boundary;
+                if (i == 0) {
+                        boundary = false;
+                } else if (previous == graphemeCR && current == graphemeLF) {
+                        boundary = false;
+                } else if (previous == graphemeCR || previous == graphemeLF || previous == graphemeControl || current == graphemeCR || current == graphemeLF || current == graphemeControl) {
+                        boundary = true;
+                } else if (previous == graphemeL && (current == graphemeL || current == graphemeV || current == graphemeLV || current == graphemeLVT)) {
+                        boundary = false;
+                } else if ((previous == graphemeLV || previous == graphemeV) && (current == graphemeV || current == graphemeT)) {
+                        boundary = false;
+                } else if ((previous == graphemeLVT || previous == graphemeT) && current == graphemeT) {
+                        boundary = false;
+                } else if (current == graphemeExtend || current == graphemeZWJ || current == graphemeSpacingMark || previous == graphemePrepend) {
+                        boundary = false;
+                } else if (pictographicJoiner && pictographic) {
+                        boundary = false;
+                } else if (previous == graphemeRegionalIndicator && current == graphemeRegionalIndicator) {
+                        boundary = regionalIndicatorCount % 2 == 0;
+                } else {
+                        boundary = true;
+                }
+                if (boundary) {
+                        reverseCodeUnits(data + clusterStart, i - clusterStart);
+                        clusterStart = i;
+                }
+                pictographicJoiner = current == graphemeZWJ && pictographicSequence;
+                if (pictographic) {
+                        pictographicSequence = true;
+                } else if (current != graphemeExtend) {
+                        pictographicSequence = false;
+                }
+                regionalIndicatorCount = current == graphemeRegionalIndicator ? regionalIndicatorCount + 1 : 0;
+                previous = current;
+                i += width;
+        }
+        reverseCodeUnits(data + clusterStart, length - clusterStart);
+}
+
+int64_t utf8LengthOfUTF16(uint16_t* data, int64_t length) {
+        int64_t i, sum = 0;
+        for (i = 0; i < length; ++i) {
+                uint16_t v = data[i];
+                if (v < 0x80) {
+                        sum += 1;
+                } else if (v < 0x800) {
+                        sum += 2;
+                } else if (v >= 0xD800 && v <= 0xDBFF && i + 1 < length && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                        sum += 4;
+                        ++i;
+                } else {
+                        sum += 3;
+                }
+        }
+        return sum;
+}
+
+uint8_t* encodeUTF8CodePoint(uint32_t codePoint, uint8_t* output) {
+        if (codePoint < 0x80) {
+                *output++ = codePoint;
+        } else if (codePoint < 0x800) {
+                *output++ = 0xC0 | (codePoint >> 6);
+                *output++ = 0x80 | (codePoint & 0x3F);
+        } else if (codePoint < 0x10000) {
+                *output++ = 0xE0 | (codePoint >> 12);
+                *output++ = 0x80 | ((codePoint >> 6) & 0x3F);
+                *output++ = 0x80 | (codePoint & 0x3F);
+        } else {
+                *output++ = 0xF0 | (codePoint >> 18);
+                *output++ = 0x80 | ((codePoint >> 12) & 0x3F);
+                *output++ = 0x80 | ((codePoint >> 6) & 0x3F);
+                *output++ = 0x80 | (codePoint & 0x3F);
+        }
+        return output;
+}
+
+// Lone surrogates are encoded as U+FFFD, the same as V8 does.
+uint8_t* encodeUTF16ToUTF8(uint16_t* data, int64_t length, uint8_t* output) {
+        int64_t i;
+        for (i = 0; i < length; ++i) {
+                uint32_t v = data[i];
+                if (v < 0x80) {
+                        *output++ = v;
+                        continue;
+                }
+                if (v >= 0xD800 && v <= 0xDFFF) {
+                        if (v <= 0xDBFF && i + 1 < length && data[i + 1] >= 0xDC00 && data[i + 1] <= 0xDFFF) {
+                                v = 0x10000 + ((v - 0xD800) << 10) + (data[i + 1] - 0xDC00);
+                                ++i;
+                        } else {
+                                v = 0xFFFD;
+                        }
+                }
+                output = encodeUTF8CodePoint(v, output);
+        }
+        return output;
+}
+
+
+uint64_t readLE64(const uint8_t* p) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+}
+
+uint32_t readLE32(const uint8_t* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+}
+
+uint64_t byteSwap64(uint64_t v) {
+        v = ((v & 0x00FF00FF00FF00FFULL) << 8) | ((v >> 8) & 0x00FF00FF00FF00FFULL);
+        v = ((v & 0x0000FFFF0000FFFFULL) << 16) | ((v >> 16) & 0x0000FFFF0000FFFFULL);
+        return (v << 32) | (v >> 32);
+}
+
+uint64_t rotateLeft64(uint64_t v, int n) {
+        return (v << n) | (v >> (64 - n));
+}
+
+// Multiply two 64-bit integers into the 128-bit product (lo, hi)
+void multiply128(uint64_t a, uint64_t b, uint64_t* lo, uint64_t* hi) {
+#if defined(__SIZEOF_INT128__)
+        __uint128_t product = (__uint128_t)a * b;
+        *lo = (uint64_t)product;
+        *hi = (uint64_t)(product >> 64);
+#else
+        uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32, bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+        uint64_t loLo = aLo * bLo, hiLo = aHi * bLo, loHi = aLo * bHi, hiHi = aHi * bHi;
+        uint64_t cross = (loLo >> 32) + (hiLo & 0xFFFFFFFF) + loHi;
+        *lo = (cross << 32) | (loLo & 0xFFFFFFFF);
+        *hi = (hiLo >> 32) + (cross >> 32) + hiHi;
+#endif
+}
+
+uint64_t multiplyFold64(uint64_t a, uint64_t b) {
+        uint64_t lo, hi;
+        multiply128(a, b, &lo, &hi);
+        return lo ^ hi;
+}
+
+// XXH3 (64-bit, seed 0, the default secret) of xxHash 0.8
+
+#define xxhPrime32_1 0x9E3779B1ULL
+#define xxhPrime32_2 0x85EBCA77ULL
+#define xxhPrime32_3 0xC2B2AE3DULL
+#define xxhPrime64_1 0x9E3779B185EBCA87ULL
+#define xxhPrime64_2 0xC2B2AE3D27D4EB4FULL
+#define xxhPrime64_3 0x165667B19E3779F9ULL
+#define xxhPrime64_4 0x85EBCA77C2B2AE63ULL
+#define xxhPrime64_5 0x27D4EB2F165667C5ULL
+#define xxh3SecretSize 192
+
+static const uint8_t xxh3Secret[xxh3SecretSize] = {
+        0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+        0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+        0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+        0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+        0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+        0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+        0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+        0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+        0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+        0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+        0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+        0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+};
+
+uint64_t xxh64Avalanche(uint64_t h) {
+        h ^= h >> 33;
+        h *= xxhPrime64_2;
+        h ^= h >> 29;
+        h *= xxhPrime64_3;
+        return h ^ (h >> 32);
+}
+
+uint64_t xxh3Avalanche(uint64_t h) {
+        h ^= h >> 37;
+        h *= 0x165667919E3779F9ULL;
+        return h ^ (h >> 32);
+}
+
+uint64_t xxh3Mix16(const uint8_t* data, const uint8_t* secret) {
+        return multiplyFold64(readLE64(data) ^ readLE64(secret), readLE64(data + 8) ^ readLE64(secret + 8));
+}
+
+// Accumulate a stripe of 64 bytes
+void xxh3Accumulate512(uint64_t* acc, const uint8_t* data, const uint8_t* secret) {
+#if defined(SIMD_SSE2)
+        int i;
+        for (i = 0; i < 4; ++i) {
+                __m128i accVector = _mm_loadu_si128((const __m128i*)(acc + i * 2));
+                __m128i dataVector = _mm_loadu_si128((const __m128i*)(data + i * 16));
+                __m128i dataKey = _mm_xor_si128(dataVector, _mm_loadu_si128((const __m128i*)(secret + i * 16)));
+                __m128i product = _mm_mul_epu32(dataKey, _mm_shuffle_epi32(dataKey, _MM_SHUFFLE(0, 3, 0, 1)));
+                accVector = _mm_add_epi64(accVector, _mm_shuffle_epi32(dataVector, _MM_SHUFFLE(1, 0, 3, 2)));
+                _mm_storeu_si128((__m128i*)(acc + i * 2), _mm_add_epi64(accVector, product));
+        }
+#elif defined(SIMD_NEON)
+        int i;
+        for (i = 0; i < 4; ++i) {
+                uint64x2_t accVector = vld1q_u64(acc + i * 2);
+                uint64x2_t dataVector = vreinterpretq_u64_u8(vld1q_u8(data + i * 16));
+                uint64x2_t dataKey = veorq_u64(dataVector, vreinterpretq_u64_u8(vld1q_u8(secret + i * 16)));
+                accVector = vaddq_u64(accVector, vextq_u64(dataVector, dataVector, 1));
+                accVector = vmlal_u32(accVector, vmovn_u64(dataKey), vshrn_n_u64(dataKey, 32));
+                vst1q_u64(acc + i * 2, accVector);
+        }
+#else
+        int i;
+        for (i = 0; i < 8; ++i) {
+                uint64_t dataValue = readLE64(data + i * 8);
+                uint64_t dataKey = dataValue ^ readLE64(secret + i * 8);
+                acc[i ^ 1] += dataValue;
+                acc[i] += (dataKey & 0xFFFFFFFF) * (dataKey >> 32);
+        }
+#endif
+}
+
+void xxh3Scramble(uint64_t* acc, const uint8_t* secret) {
+        int i;
+        for (i = 0; i < 8; ++i) {
+                uint64_t a = acc[i];
+                a ^= a >> 47;
+                a ^= readLE64(secret + i * 8);
+                acc[i] = a * xxhPrime32_1;
+        }
+}
+
+uint64_t xxh3Long(const uint8_t* data, int64_t length) {
+        uint64_t acc[8] = {xxhPrime32_3, xxhPrime64_1, xxhPrime64_2, xxhPrime64_3, xxhPrime64_4, xxhPrime32_2, xxhPrime64_5, xxhPrime32_1};
+        const int64_t stripesPerBlock = (xxh3SecretSize - 64) / 8;
+        const int64_t blockLength = 64 * stripesPerBlock;
+        int64_t blocks = (length - 1) / blockLength;
+        int64_t i, n;
+        for (n = 0; n < blocks; ++n) {
+                for (i = 0; i < stripesPerBlock; ++i) {
+                        xxh3Accumulate512(acc, data + n * blockLength + i * 64, xxh3Secret + i * 8);
+                }
+                xxh3Scramble(acc, xxh3Secret + xxh3SecretSize - 64);
+        }
+        int64_t stripes = ((length - 1) - blockLength * blocks) / 64;
+        for (i = 0; i < stripes; ++i) {
+                xxh3Accumulate512(acc, data + blocks * blockLength + i * 64, xxh3Secret + i * 8);
+        }
+        xxh3Accumulate512(acc, data + length - 64, xxh3Secret + xxh3SecretSize - 64 - 7);
+        uint64_t result = length * xxhPrime64_1;
+        for (i = 0; i < 4; ++i) {
+                result += multiplyFold64(acc[i * 2] ^ readLE64(xxh3Secret + 11 + i * 16), acc[i * 2 + 1] ^ readLE64(xxh3Secret + 11 + i * 16 + 8));
+        }
+        return xxh3Avalanche(result);
+}
+
+uint64_t xxh3(const uint8_t* data, int64_t length) {
+        const uint8_t* secret = xxh3Secret;
+        if (length <= 16) {
+                if (length > 8) {
+                        uint64_t low = readLE64(data) ^ (readLE64(secret + 24) ^ readLE64(secret + 32));
+                        uint64_t high = readLE64(data + length - 8) ^ (readLE64(secret + 40) ^ readLE64(secret + 48));
+                        uint64_t acc = length + byteSwap64(low) + high + multiplyFold64(low, high);
+                        return xxh3Avalanche(acc);
+                }
+                if (length >= 4) {
+                        uint64_t input = readLE32(data + length - 4) + ((uint64_t)readLE32(data) << 32);
+                        uint64_t h = input ^ (readLE64(secret + 8) ^ readLE64(secret + 16));
+                        h ^= rotateLeft64(h, 49) ^ rotateLeft64(h, 24);
+                        h *= 0x9FB21C651E98DF25ULL;
+                        h ^= (h >> 35) + length;
+                        h *= 0x9FB21C651E98DF25ULL;
+                        return h ^ (h >> 28);
+                }
+                if (length > 0) {
+                        uint32_t combined = ((uint32_t)data[0] << 16) | ((uint32_t)data[length >> 1] << 24) | data[length - 1] | ((uint32_t)length << 8);
+                        return xxh64Avalanche((uint64_t)combined ^ (readLE32(secret) ^ readLE32(secret + 4)));
+                }
+                return xxh64Avalanche(readLE64(secret + 56) ^ readLE64(secret + 64));
+        }
+        uint64_t acc = length * xxhPrime64_1;
+        if (length <= 128) {
+                if (length > 32) {
+                        if (length > 64) {
+                                if (length > 96) {
+                                        acc += xxh3Mix16(data + 48, secret + 96);
+                                        acc += xxh3Mix16(data + length - 64, secret + 112);
+                                }
+                                acc += xxh3Mix16(data + 32, secret + 64);
+                                acc += xxh3Mix16(data + length - 48, secret + 80);
+                        }
+                        acc += xxh3Mix16(data + 16, secret + 32);
+                        acc += xxh3Mix16(data + length - 32, secret + 48);
+                }
+                acc += xxh3Mix16(data, secret);
+                acc += xxh3Mix16(data + length - 16, secret + 16);
+                return xxh3Avalanche(acc);
+        }
+        if (length <= 240) {
+                int64_t i, rounds = length / 16;
+                for (i = 0; i < 8; ++i) {
+                        acc += xxh3Mix16(data + i * 16, secret + i * 16);
+                }
+                acc = xxh3Avalanche(acc);
+                for (i = 8; i < rounds; ++i) {
+                        acc += xxh3Mix16(data + i * 16, secret + (i - 8) * 16 + 3);
+                }
+                acc += xxh3Mix16(data + length - 16, secret + 136 - 17);
+                return xxh3Avalanche(acc);
+        }
+        return xxh3Long(data, length);
+}
+
+// wyhash (final version 4, seed 0, the default secret)
+
+static const uint64_t wyhashSecret[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+uint64_t wyhashMix(uint64_t a, uint64_t b) {
+        return multiplyFold64(a, b);
+}
+
+uint64_t wyhash(const uint8_t* data, int64_t length, uint64_t seed) {
+        const uint64_t* secret = wyhashSecret;
+        const uint8_t* p = data;
+        uint64_t a, b;
+        seed ^= wyhashMix(seed ^ secret[0], secret[1]);
+        if (length <= 16) {
+                if (length >= 4) {
+                        a = ((uint64_t)readLE32(p) << 32) | readLE32(p + ((length >> 3) << 2));
+                        b = ((uint64_t)readLE32(p + length - 4) << 32) | readLE32(p + length - 4 - ((length >> 3) << 2));
+                } else if (length > 0) {
+                        a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+                        b = 0;
+                } else {
+                        a = b = 0;
+                }
+        } else {
+                int64_t i = length;
+                if (i >= 48) {
+                        uint64_t seed1 = seed, seed2 = seed;
+                        do {
+                                seed = wyhashMix(readLE64(p) ^ secret[1], readLE64(p + 8) ^ seed);
+                                seed1 = wyhashMix(readLE64(p + 16) ^ secret[2], readLE64(p + 24) ^ seed1);
+                                seed2 = wyhashMix(readLE64(p + 32) ^ secret[3], readLE64(p + 40) ^ seed2);
+                                p += 48;
+                                i -= 48;
+                        } while (i >= 48);
+                        seed ^= seed1 ^ seed2;
+                }
+                while (i > 16) {
+                        seed = wyhashMix(readLE64(p) ^ secret[1], readLE64(p + 8) ^ seed);
+                        i -= 16;
+                        p += 16;
+                }
+                a = readLE64(p + i - 16);
+                b = readLE64(p + i - 8);
+        }
+        a ^= secret[1];
+        b ^= seed;
+        multiply128(a, b, &a, &b);
+        return wyhashMix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+// CRC-32C (Castagnoli). The state is the CRC register before the final inversion, starting with 0xFFFFFFFF.
+
+uint32_t crc32cTable[8][256];
+
+void initializeCRC32C() {
+        uint32_t i, j;
+        for (i = 0; i < 256; ++i) {
+                uint32_t crc = i;
+                for (j = 0; j < 8; ++j) {
+                        crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+                }
+                crc32cTable[0][i] = crc;
+        }
+        for (i = 0; i < 256; ++i) {
+                for (j = 1; j < 8; ++j) {
+                        crc32cTable[j][i] = (crc32cTable[j - 1][i] >> 8) ^ crc32cTable[0][crc32cTable[j - 1][i] & 0xFF];
+                }
+        }
+}
+
+uint32_t updateCRC32CScalar(uint32_t crc, const uint8_t* data, int64_t length) {
+        int64_t i = 0;
+        // slicing-by-8
+        for (; i + 8 <= length; i += 8) {
+                uint32_t low = readLE32(data + i) ^ crc, high = readLE32(data + i + 4);
+                crc = crc32cTable[7][low & 0xFF] ^ crc32cTable[6][(low >> 8) & 0xFF] ^ crc32cTable[5][(low >> 16) & 0xFF] ^ crc32cTable[4][low >> 24] ^ crc32cTable[3][high & 0xFF] ^ crc32cTable[2][(high >> 8) & 0xFF] ^ crc32cTable[1][(high >> 16) & 0xFF] ^ crc32cTable[0][high >> 24];
+        }
+        for (; i < length; ++i) {
+                crc = (crc >> 8) ^ crc32cTable[0][(crc ^ data[i]) & 0xFF];
+        }
+        return crc;
+}
+
+#if defined(SIMD_AVX2)
+targetSSE42 uint32_t updateCRC32CSSE42(uint32_t crc, const uint8_t* data, int64_t length) {
+        int64_t i = 0;
+#if defined(_M_X64) || defined(__x86_64__)
+        uint64_t crc64 = crc;
+        for (; i + 8 <= length; i += 8) {
+                crc64 = _mm_crc32_u64(crc64, readLE64(data + i));
+        }
+        crc = (uint32_t)crc64;
+#endif
+        for (; i + 4 <= length; i += 4) {
+                crc = _mm_crc32_u32(crc, readLE32(data + i));
+        }
+        for (; i < length; ++i) {
+                crc = _mm_crc32_u8(crc, data[i]);
+        }
+        return crc;
+}
+#endif
+
+#if defined(SIMD_NEON) && defined(__ARM_FEATURE_CRC32)
+uint32_t updateCRC32CARM(uint32_t crc, const uint8_t* data, int64_t length) {
+        int64_t i = 0;
+        for (; i + 8 <= length; i += 8) {
+                crc = __crc32cd(crc, readLE64(data + i));
+        }
+        for (; i < length; ++i) {
+                crc = __crc32cb(crc, data[i]);
+        }
+        return crc;
+}
+#endif
+// Find unit in [start, end) and write the indices following the matches into output (if it is not NULL). Return the number of them.
+int64_t findCodeUnitsScalar(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output) {
+        // output receives the index following each match, and stops after limit matches if limit is positive
+        int64_t i, count = 0;
+        for (i = start; i < end; ++i) {
+                if (data[i] == unit) {
+                        if (output) {
+                                output[count] = i + 1;
+                        }
+                        if (++count == limit) {
+                                return count;
+                        }
+                }
+        }
+        return count;
+}
+
+// The SIMD variants hand the rest which does not fill a block to findCodeUnitsScalar.
+#if defined(SIMD_SSE2)
+int64_t findCodeUnitsSSE2(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output) {
+        int64_t i = start, count = 0;
+        __m128i target = _mm_set1_epi16((short)unit);
+        for (; i + 8 <= end; i += 8) {
+                uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(data + i)), target));
+                if (output) {
+                        while (mask != 0) {
+                                uint32_t bit = countTrailingZeros(mask);
+                                output[count++] = i + bit / 2 + 1;
+                                if (count == limit) {
+                                        return count;
+                                }
+                                mask &= ~((uint32_t)3 << bit);
+                        }
+                } else {
+                        count += countOnes(mask) / 2;
+                }
+        }
+        return count + findCodeUnitsScalar(data, i, end, unit, limit > 0 ? limit - count : 0, output ? output + count : NULL);
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 int64_t findCodeUnitsAVX2(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output) {
+        int64_t i = start, count = 0;
+        __m256i target = _mm256_set1_epi16((short)unit);
+        for (; i + 16 <= end; i += 16) {
+                uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i*)(data + i)), target));
+                if (output) {
+                        while (mask != 0) {
+                                uint32_t bit = countTrailingZeros(mask);
+                                output[count++] = i + bit / 2 + 1;
+                                if (count == limit) {
+                                        return count;
+                                }
+                                mask &= ~((uint32_t)3 << bit);
+                        }
+                } else {
+                        count += countOnes(mask) / 2;
+                }
+        }
+        return count + findCodeUnitsScalar(data, i, end, unit, limit > 0 ? limit - count : 0, output ? output + count : NULL);
+}
+#endif
+
+#if defined(SIMD_NEON)
+int64_t findCodeUnitsNEON(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output) {
+        int64_t i = start, count = 0;
+        uint16x8_t target = vdupq_n_u16(unit);
+        for (; i + 8 <= end; i += 8) {
+                uint16x8_t matches = vceqq_u16(vld1q_u16(data + i), target);
+                if (vmaxvq_u16(matches) == 0) {
+                        continue;
+                }
+                if (output) {
+                        int64_t j;
+                        for (j = i; j < i + 8; ++j) {
+                                if (data[j] == unit) {
+                                        output[count++] = j + 1;
+                                        if (count == limit) {
+                                                return count;
+                                        }
+                                }
+                        }
+                } else {
+                        count += vaddvq_u16(vandq_u16(matches, vdupq_n_u16(1)));
+                }
+        }
+        return count + findCodeUnitsScalar(data, i, end, unit, limit > 0 ? limit - count : 0, output ? output + count : NULL);
+}
+#endif
+bool needsEscape(uint16_t c, int kind) {
+        switch (kind) {
+        case escapeHTML:
+                return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+        case escapeJSON:
+                return c < 0x20 || c == '"' || c == '\\' || (c & 0xF800) == 0xD800;
+        case escapeCSV:
+                return c == ',' || c == '"' || c == '\r' || c == '\n';
+        default:
+                // the characters which encodeURIComponent keeps
+                return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~' || c == '!' || c == '\'' || c == '(' || c == ')' || c == '*');
+        }
+}
+
+#if defined(SIMD_SSE2)
+__m128i inRangeSSE2(__m128i v, uint16_t low, uint16_t high) {
+        return _mm_cmpeq_epi16(_mm_subs_epu16(_mm_sub_epi16(v, _mm_set1_epi16((short)low)), _mm_set1_epi16((short)(high - low))), _mm_setzero_si128());
+}
+
+__m128i escapeMaskSSE2(__m128i v, int kind) {
+        switch (kind) {
+        case escapeHTML:
+                return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('&')), _mm_cmpeq_epi16(v, _mm_set1_epi16('<'))), _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('>')), _mm_cmpeq_epi16(v, _mm_set1_epi16('"'))), _mm_cmpeq_epi16(v, _mm_set1_epi16('\''))));
+        case escapeJSON:
+                return _mm_or_si128(_mm_or_si128(inRangeSSE2(v, 0, 0x1F), _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xF800)), _mm_set1_epi16((short)0xD800))), _mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('"')), _mm_cmpeq_epi16(v, _mm_set1_epi16('\\'))));
+        case escapeCSV:
+                return _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16(',')), _mm_cmpeq_epi16(v, _mm_set1_epi16('"'))), _mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('\r')), _mm_cmpeq_epi16(v, _mm_set1_epi16('\n'))));
+        default: {
+                __m128i kept = _mm_or_si128(_mm_or_si128(inRangeSSE2(v, 'a', 'z'), inRangeSSE2(v, 'A', 'Z')), _mm_or_si128(inRangeSSE2(v, '0', '9'), inRangeSSE2(v, '-', '.')));
+                kept = _mm_or_si128(kept, _mm_or_si128(inRangeSSE2(v, '\'', '*'), _mm_cmpeq_epi16(v, _mm_set1_epi16('!'))));
+                kept = _mm_or_si128(kept, _mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('_')), _mm_cmpeq_epi16(v, _mm_set1_epi16('~'))));
+                return _mm_xor_si128(kept, _mm_set1_epi16(-1));
+        }
+        }
+}
+#elif defined(SIMD_NEON)
+uint16x8_t inRangeNEON(uint16x8_t v, uint16_t low, uint16_t high) {
+        return vcleq_u16(vsubq_u16(v, vdupq_n_u16(low)), vdupq_n_u16(high - low));
+}
+
+uint16x8_t escapeMaskNEON(uint16x8_t v, int kind) {
+        switch (kind) {
+        case escapeHTML:
+                return vorrq_u16(vorrq_u16(vceqq_u16(v, vdupq_n_u16('&')), vceqq_u16(v, vdupq_n_u16('<'))), vorrq_u16(vorrq_u16(vceqq_u16(v, vdupq_n_u16('>')), vceqq_u16(v, vdupq_n_u16('"'))), vceqq_u16(v, vdupq_n_u16('\''))));
+        case escapeJSON:
+                return vorrq_u16(vorrq_u16(vcleq_u16(v, vdupq_n_u16(0x1F)), vceqq_u16(vandq_u16(v, vdupq_n_u16(0xF800)), vdupq_n_u16(0xD800))), vorrq_u16(vceqq_u16(v, vdupq_n_u16('"')), vceqq_u16(v, vdupq_n_u16('\\'))));
+        case escapeCSV:
+                return vorrq_u16(vorrq_u16(vceqq_u16(v, vdupq_n_u16(',')), vceqq_u16(v, vdupq_n_u16('"'))), vorrq_u16(vceqq_u16(v, vdupq_n_u16('\r')), vceqq_u16(v, vdupq_n_u16('\n'))));
+        default: {
+                uint16x8_t kept = vorrq_u16(vorrq_u16(inRangeNEON(v, 'a', 'z'), inRangeNEON(v, 'A', 'Z')), vorrq_u16(inRangeNEON(v, '0', '9'), inRangeNEON(v, '-', '.')));
+                kept = vorrq_u16(kept, vorrq_u16(inRangeNEON(v, '\'', '*'), vceqq_u16(v, vdupq_n_u16('!'))));
+                kept = vorrq_u16(kept, vorrq_u16(vceqq_u16(v, vdupq_n_u16('_')), vceqq_u16(v, vdupq_n_u16('~'))));
+                return vmvnq_u16(kept);
+        }
+        }
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 __m256i inRangeAVX2(__m256i v, uint16_t low, uint16_t high) {
+        return _mm256_cmpeq_epi16(_mm256_subs_epu16(_mm256_sub_epi16(v, _mm256_set1_epi16((short)low)), _mm256_set1_epi16((short)(high - low))), _mm256_setzero_si256());
+}
+
+targetAVX2 __m256i escapeMaskAVX2(__m256i v, int kind) {
+        switch (kind) {
+        case escapeHTML:
+                return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('&')), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('<'))), _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('>')), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('"'))), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('\''))));
+        case escapeJSON:
+                return _mm256_or_si256(_mm256_or_si256(inRangeAVX2(v, 0, 0x1F), _mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16((short)0xF800)), _mm256_set1_epi16((short)0xD800))), _mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('"')), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('\\'))));
+        case escapeCSV:
+                return _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16(',')), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('"'))), _mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('\r')), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('\n'))));
+        default: {
+                __m256i kept = _mm256_or_si256(_mm256_or_si256(inRangeAVX2(v, 'a', 'z'), inRangeAVX2(v, 'A', 'Z')), _mm256_or_si256(inRangeAVX2(v, '0', '9'), inRangeAVX2(v, '-', '.')));
+                kept = _mm256_or_si256(kept, _mm256_or_si256(inRangeAVX2(v, '\'', '*'), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('!'))));
+                kept = _mm256_or_si256(kept, _mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_set1_epi16('_')), _mm256_cmpeq_epi16(v, _mm256_set1_epi16('~'))));
+                return _mm256_xor_si256(kept, _mm256_set1_epi16(-1));
+        }
+        }
+}
+#endif
+
+// Find the first code unit from start which has to be escaped, or end
+int64_t findEscapeScalar(const uint16_t* data, int64_t start, int64_t end, int kind) {
+        int64_t i;
+        for (i = start; i < end; ++i) {
+                if (needsEscape(data[i], kind)) {
+                        return i;
+                }
+        }
+        return end;
+}
+
+#if defined(SIMD_SSE2)
+int64_t findEscapeSSE2(const uint16_t* data, int64_t start, int64_t end, int kind) {
+        int64_t i = start;
+        for (; i + 8 <= end; i += 8) {
+                uint32_t mask = _mm_movemask_epi8(escapeMaskSSE2(_mm_loadu_si128((const __m128i*)(data + i)), kind));
+                if (mask != 0) {
+                        return i + countTrailingZeros(mask) / 2;
+                }
+        }
+        return findEscapeScalar(data, i, end, kind);
+}
+#endif
+
+#if defined(SIMD_AVX2)
+targetAVX2 int64_t findEscapeAVX2(const uint16_t* data, int64_t start, int64_t end, int kind) {
+        int64_t i = start;
+        for (; i + 16 <= end; i += 16) {
+                uint32_t mask = (uint32_t)_mm256_movemask_epi8(escapeMaskAVX2(_mm256_loadu_si256((const __m256i*)(data + i)), kind));
+                if (mask != 0) {
+                        return i + countTrailingZeros(mask) / 2;
+                }
+        }
+        return findEscapeScalar(data, i, end, kind);
+}
+#endif
+
+#if defined(SIMD_NEON)
+int64_t findEscapeNEON(const uint16_t* data, int64_t start, int64_t end, int kind) {
+        int64_t i = start;
+        for (; i + 8 <= end; i += 8) {
+                if (vmaxvq_u16(escapeMaskNEON(vld1q_u16(data + i), kind)) != 0) {
+                        break;
+                }
+        }
+        return findEscapeScalar(data, i, end, kind);
+}
+#endif
+// Escape the code unit (or the surrogate pair) at *index into output, which needs room for 12 code units, and return the length of the output
+int64_t escapeCodeUnits(const uint16_t* data, int64_t* index, int64_t end, int kind, uint16_t* output) {
+        static const char lowerHexDigits[] = "0123456789abcdef";
+        static const char upperHexDigits[] = "0123456789ABCDEF";
+        uint16_t c = data[(*index)++];
+        bool pair = c >= 0xD800 && c < 0xDC00 && *index < end && (data[*index] & 0xFC00) == 0xDC00;
+        const char* text = 0;
+        int64_t n = 0;
+        switch (kind) {
+        case escapeHTML:
+                text = c == '&' ? "&amp;" : c == '<' ? "&lt;" : c == '>' ? "&gt;" : c == '"' ? "&quot;" : "&#39;";
+                break;
+        case escapeJSON:
+                if (pair) {
+                        output[0] = c;
+                        output[1] = data[(*index)++];
+                        return 2;
+                }
+                switch (c) {
+                case '"':
+                        text = "\\\"";
+                        break;
+                case '\\':
+                        text = "\\\\";
+                        break;
+                case '\b':
+                        text = "\\b";
+                        break;
+                case '\f':
+                        text = "\\f";
+                        break;
+                case '\n':
+                        text = "\\n";
+                        break;
+                case '\r':
+                        text = "\\r";
+                        break;
+                case '\t':
+                        text = "\\t";
+                        break;
+                default:
+                        // control characters and lone surrogates
+                        output[0] = '\\';
+                        output[1] = 'u';
+                        output[2] = lowerHexDigits[c >> 12];
+                        output[3] = lowerHexDigits[(c >> 8) & 15];
+                        output[4] = lowerHexDigits[(c >> 4) & 15];
+                        output[5] = lowerHexDigits[c & 15];
+                        return 6;
+                }
+                break;
+        case escapeCSV:
+                if (c != '"') {
+                        output[0] = c;
+                        return 1;
+                }
+                text = "\"\"";
+                break;
+        default: {
+                // percent-encode the UTF-8 bytes, a lone surrogate is encoded as U+FFFD
+                uint32_t codePoint = c;
+                if (pair) {
+                        codePoint = 0x10000 + ((c - 0xD800) << 10) + (data[(*index)++] - 0xDC00);
+                } else if ((c & 0xF800) == 0xD800) {
+                        codePoint = 0xFFFD;
+                }
+                uint8_t bytes[4];
+                int64_t byteCount, i;
+                if (codePoint < 0x80) {
+                        bytes[0] = codePoint;
+                        byteCount = 1;
+                } else if (codePoint < 0x800) {
+                        bytes[0] = 0xC0 | (codePoint >> 6);
+                        bytes[1] = 0x80 | (codePoint & 0x3F);
+                        byteCount = 2;
+                } else if (codePoint < 0x10000) {
+                        bytes[0] = 0xE0 | (codePoint >> 12);
+                        bytes[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+                        bytes[2] = 0x80 | (codePoint & 0x3F);
+                        byteCount = 3;
+                } else {
+                        bytes[0] = 0xF0 | (codePoint >> 18);
+                        bytes[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+                        bytes[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+                        bytes[3] = 0x80 | (codePoint & 0x3F);
+                        byteCount = 4;
+                }
+                for (i = 0; i < byteCount; ++i) {
+                        output[n++] = '%';
+                        output[n++] = upperHexDigits[bytes[i] >> 4];
+                        output[n++] = upperHexDigits[bytes[i] & 15];
+                }
+                return n;
+        }
+        }
+        for (; text[n]; ++n) {
+                output[n] = text[n];
+        }
+        return n;
+}
+
+// Escape data into output, copying the runs which need no escaping in bulk, or only measure the escaped length if output is NULL
+int64_t escapeText(const uint16_t* data, int64_t length, int kind, uint16_t* output) {
+        uint16_t escaped[12];
+        int64_t i = 0, outputLength = 0;
+        while (i < length) {
+                int64_t next = findEscape(data, i, length, kind);
+                if (output) {
+                        memcpy(output + outputLength, data + i, (next - i) * 2);
+                }
+                outputLength += next - i;
+                i = next;
+                if (i < length) {
+                        outputLength += escapeCodeUnits(data, &i, length, kind, output ? output + outputLength : escaped);
+                }
+        }
+        return outputLength;
+}
+
+const char base64Alphabets[2][65] = {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"};
+// base64Pairs[url][n] holds the two UTF-16 code units (little-endian) for the 12 bits n, so three bytes are encoded with two stores
+uint32_t base64Pairs[2][4096];
+// the value of a base64 character of both alphabets, or -1
+int8_t base64Values[256];
+// base64Shifted[k][c] is the value of the character c shifted for the position k in a group of four, or has bits above 24 set if c is not in the alphabets
+uint32_t base64Shifted[4][256];
+
+void initializeBase64() {
+        int32_t i, j;
+        for (i = 0; i < 2; ++i) {
+                for (j = 0; j < 4096; ++j) {
+                        base64Pairs[i][j] = (uint32_t)base64Alphabets[i][j >> 6] | ((uint32_t)base64Alphabets[i][j & 63] << 16);
+                }
+        }
+        memset(base64Values, -1, sizeof(base64Values));
+        for (i = 0; i < 2; ++i) {
+                for (j = 0; j < 64; ++j) {
+                        base64Values[(uint8_t)base64Alphabets[i][j]] = j;
+                }
+        }
+        for (i = 0; i < 4; ++i) {
+                for (j = 0; j < 256; ++j) {
+                        base64Shifted[i][j] = base64Values[j] < 0 ? 0xFF000000 : (uint32_t)base64Values[j] << (18 - 6 * i);
+                }
+        }
+}
+
+// Encode data into output, which needs room for (length + 2) / 3 * 4 code units, and return the number of code units written. The URL alphabet is not padded.
+int64_t encodeBase64(const uint8_t* data, int64_t length, bool url, uint16_t* output) {
+        const uint32_t* pairs = base64Pairs[url];
+        const char* alphabet = base64Alphabets[url];
+        uint16_t* o = output;
+        int64_t i = 0;
+        for (; i + 3 <= length; i += 3) {
+                uint32_t triple = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+                memcpy(o, &pairs[triple >> 12], 4);
+                memcpy(o + 2, &pairs[triple & 0xFFF], 4);
+                o += 4;
+        }
+        if (i < length) {
+                uint32_t triple = (uint32_t)data[i] << 16;
+                if (i + 1 < length) {
+                        triple |= (uint32_t)data[i + 1] << 8;
+                }
+                *o++ = alphabet[triple >> 18];
+                *o++ = alphabet[(triple >> 12) & 63];
+                if (i + 1 < length) {
+                        *o++ = alphabet[(triple >> 6) & 63];
+                } else if (!url) {
+                        *o++ = '=';
+                }
+                if (!url) {
+                        *o++ = '=';
+                }
+        }
+        return o - output;
+}
+
+// Decode base64 of both alphabets like Buffer.from(text, "base64"), skipping the characters which are not in the alphabets and stopping at '='. Return the number of bytes, only counted if output is NULL.
+int64_t decodeBase64(const uint16_t* text, int64_t length, uint8_t* output) {
+        int64_t i = 0, count = 0;
+        uint32_t bits = 0, sextets = 0;
+        while (i < length) {
+                // eight characters which are all in the alphabet give six bytes at once
+                while (sextets == 0 && i + 8 <= length && ((text[i] | text[i + 1] | text[i + 2] | text[i + 3] | text[i + 4] | text[i + 5] | text[i + 6] | text[i + 7]) & 0xFF00) == 0) {
+                        uint32_t first = base64Shifted[0][text[i]] | base64Shifted[1][text[i + 1]] | base64Shifted[2][text[i + 2]] | base64Shifted[3][text[i + 3]];
+                        uint32_t second = base64Shifted[0][text[i + 4]] | base64Shifted[1][text[i + 5]] | base64Shifted[2][text[i + 6]] | base64Shifted[3][text[i + 7]];
+                        if (((first | second) & 0xFF000000) != 0) {
+                                break;
+                        }
+                        if (output) {
+                                output[count] = first >> 16;
+                                output[count + 1] = first >> 8;
+                                output[count + 2] = first;
+                                output[count + 3] = second >> 16;
+                                output[count + 4] = second >> 8;
+                                output[count + 5] = second;
+                        }
+                        count += 6;
+                        i += 8;
+                }
+                if (i >= length) {
+                        break;
+                }
+                uint16_t c = text[i++];
+                if (c == '=') {
+                        break;
+                }
+                int32_t value = c < 256 ? base64Values[c] : -1;
+                if (value < 0) {
+                        continue;
+                }
+                bits = (bits << 6) | value;
+                if (++sextets == 4) {
+                        if (output) {
+                                output[count] = bits >> 16;
+                                output[count + 1] = bits >> 8;
+                                output[count + 2] = bits;
+                        }
+                        count += 3;
+                        bits = 0;
+                        sextets = 0;
+                }
+        }
+        if (sextets >= 2) {
+                bits <<= 6 * (4 - sextets);
+                if (output) {
+                        output[count] = bits >> 16;
+                        if (sextets == 3) {
+                                output[count + 1] = bits >> 8;
+                        }
+                }
+                count += sextets - 1;
+        }
+        return count;
+}
+
+// Encode data in lowercase hexadecimal into output, which needs room for length * 2 code units
+void encodeHexScalar(const uint8_t* data, int64_t length, uint16_t* output) {
+        static const char hexDigits[] = "0123456789abcdef";
+        int64_t i;
+        for (i = 0; i < length; ++i) {
+                output[i * 2] = hexDigits[data[i] >> 4];
+                output[i * 2 + 1] = hexDigits[data[i] & 15];
+        }
+}
+
+#if defined(SIMD_SSE2)
+void encodeHexSSE2(const uint8_t* data, int64_t length, uint16_t* output) {
+        int64_t i = 0;
+        const __m128i lowNibble = _mm_set1_epi8(0x0F), nine = _mm_set1_epi8(9), letterOffset = _mm_set1_epi8('a' - '0' - 10), zeroCharacter = _mm_set1_epi8('0'), zero = _mm_setzero_si128();
+        for (; i + 16 <= length; i += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+                __m128i high = _mm_and_si128(_mm_srli_epi16(v, 4), lowNibble);
+                __m128i low = _mm_and_si128(v, lowNibble);
+                high = _mm_add_epi8(_mm_add_epi8(high, zeroCharacter), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letterOffset));
+                low = _mm_add_epi8(_mm_add_epi8(low, zeroCharacter), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letterOffset));
+                __m128i first = _mm_unpacklo_epi8(high, low);
+                __m128i second = _mm_unpackhi_epi8(high, low);
+                uint16_t* o = output + i * 2;
+                _mm_storeu_si128((__m128i*)o, _mm_unpacklo_epi8(first, zero));
+                _mm_storeu_si128((__m128i*)(o + 8), _mm_unpackhi_epi8(first, zero));
+                _mm_storeu_si128((__m128i*)(o + 16), _mm_unpacklo_epi8(second, zero));
+                _mm_storeu_si128((__m128i*)(o + 24), _mm_unpackhi_epi8(second, zero));
+        }
+        encodeHexScalar(data + i, length - i, output + i * 2);
+}
+#endif
+
+#if defined(SIMD_NEON)
+void encodeHexNEON(const uint8_t* data, int64_t length, uint16_t* output) {
+        int64_t i = 0;
+        const uint8x16_t lowNibble = vdupq_n_u8(0x0F), nine = vdupq_n_u8(9), letterOffset = vdupq_n_u8('a' - '0' - 10), zeroCharacter = vdupq_n_u8('0');
+        for (; i + 16 <= length; i += 16) {
+                uint8x16_t v = vld1q_u8(data + i);
+                uint8x16_t high = vshrq_n_u8(v, 4);
+                uint8x16_t low = vandq_u8(v, lowNibble);
+                high = vaddq_u8(vaddq_u8(high, zeroCharacter), vandq_u8(vcgtq_u8(high, nine), letterOffset));
+                low = vaddq_u8(vaddq_u8(low, zeroCharacter), vandq_u8(vcgtq_u8(low, nine), letterOffset));
+                uint8x16x2_t characters = vzipq_u8(high, low);
+                uint16_t* o = output + i * 2;
+                vst1q_u16(o, vmovl_u8(vget_low_u8(characters.val[0])));
+                vst1q_u16(o + 8, vmovl_u8(vget_high_u8(characters.val[0])));
+                vst1q_u16(o + 16, vmovl_u8(vget_low_u8(characters.val[1])));
+                vst1q_u16(o + 24, vmovl_u8(vget_high_u8(characters.val[1])));
+        }
+        encodeHexScalar(data + i, length - i, output + i * 2);
+}
+#endif
+
+// TODO -----Dispatch-----
+
+static const KernelTable scalarKernels = {"scalar", findCodeUnitsScalar, findMismatchScalar, skipWhiteSpaceForwardScalar, skipWhiteSpaceBackwardScalar, convertCaseScalar, measureUTF16Scalar, findEscapeScalar, encodeHexScalar, updateCRC32CScalar};
+#if defined(SIMD_SSE2)
+static const KernelTable sse2Kernels = {"sse2", findCodeUnitsSSE2, findMismatchSSE2, skipWhiteSpaceForwardSSE2, skipWhiteSpaceBackwardSSE2, convertCaseSSE2, measureUTF16SSE2, findEscapeSSE2, encodeHexSSE2, updateCRC32CScalar};
+#endif
+#if defined(SIMD_AVX2)
+static const KernelTable sse42Kernels = {"sse4.2", findCodeUnitsSSE2, findMismatchSSE2, skipWhiteSpaceForwardSSE2, skipWhiteSpaceBackwardSSE2, convertCaseSSE2, measureUTF16SSE2, findEscapeSSE2, encodeHexSSE2, updateCRC32CSSE42};
+static const KernelTable avx2Kernels = {"avx2", findCodeUnitsAVX2, findMismatchAVX2, skipWhiteSpaceForwardAVX2, skipWhiteSpaceBackwardAVX2, convertCaseAVX2, measureUTF16AVX2, findEscapeAVX2, encodeHexSSE2, updateCRC32CSSE42};
+#endif
+#if defined(SIMD_NEON)
+#if defined(__ARM_FEATURE_CRC32)
+static const KernelTable neonKernels = {"neon", findCodeUnitsNEON, findMismatchNEON, skipWhiteSpaceForwardNEON, skipWhiteSpaceBackwardNEON, convertCaseNEON, measureUTF16NEON, findEscapeNEON, encodeHexNEON, updateCRC32CARM};
+#else
+static const KernelTable neonKernels = {"neon", findCodeUnitsNEON, findMismatchNEON, skipWhiteSpaceForwardNEON, skipWhiteSpaceBackwardNEON, convertCaseNEON, measureUTF16NEON, findEscapeNEON, encodeHexNEON, updateCRC32CScalar};
+#endif
+#endif
+
+const KernelTable* const kernelTables[] = {
+        &scalarKernels,
+#if defined(SIMD_SSE2)
+        &sse2Kernels,
+#endif
+#if defined(SIMD_AVX2)
+        &sse42Kernels,
+        &avx2Kernels,
+#endif
+#if defined(SIMD_NEON)
+        &neonKernels,
+#endif
+};
+const int kernelTablesLength = sizeof(kernelTables) / sizeof(KernelTable*);
+
+static const KernelTable* kernels = &scalarKernels;
+
+#define cpuSSE42 1
+#define cpuAVX2 2
+
+static int cpuFeatures = 0;
+
+#if defined(SIMD_AVX2)
+int detectCPUFeatures() {
+        int features = 0;
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        if (info[2] & (1 << 20)) {
+                features |= cpuSSE42;
+        }
+        // AVX2 also needs the OS to save the YMM registers (OSXSAVE and XCR0)
+        if (maxLeaf >= 7 && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+                __cpuidex(info, 7, 0);
+                if (info[1] & (1 << 5)) {
+                        features |= cpuAVX2;
+                }
+        }
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) {
+                features |= cpuSSE42;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+                features |= cpuAVX2;
+        }
+#endif
+        return features;
+}
+#endif
+
+bool isKernelTableSupported(const KernelTable* table) {
+#if defined(SIMD_AVX2)
+        if (table == &sse42Kernels) {
+                return (cpuFeatures & cpuSSE42) != 0;
+        }
+        if (table == &avx2Kernels) {
+                return (cpuFeatures & (cpuSSE42 | cpuAVX2)) == (cpuSSE42 | cpuAVX2);
+        }
+#endif
+        return true;
+}
+
+bool selectKernels(const char* name) {
+        int i;
+        for (i = 0; i < kernelTablesLength; ++i) {
+                if (strcmp(kernelTables[i]->name, name) == 0) {
+                        if (!isKernelTableSupported(kernelTables[i])) {
+                                return false;
+                        }
+                        kernels = kernelTables[i];
+                        return true;
+                }
+        }
+        return false;
+}
+
+const KernelTable* selectedKernels() {
+        return kernels;
+}
+
+int64_t findCodeUnits(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output) {
+        return kernels->findCodeUnits(data, start, end, unit, limit, output);
+}
+
+int64_t findMismatch(const uint16_t* a, const uint16_t* b, int64_t length) {
+        return kernels->findMismatch(a, b, length);
+}
+
+int64_t skipWhiteSpaceForward(const uint16_t* data, int64_t start, int64_t end) {
+        return kernels->skipWhiteSpaceForward(data, start, end);
+}
+
+int64_t skipWhiteSpaceBackward(const uint16_t* data, int64_t start, int64_t end) {
+        return kernels->skipWhiteSpaceBackward(data, start, end);
+}
+
+void convertCase(uint16_t* data, int64_t length, bool upper) {
+        kernels->convertCase(data, length, upper);
+}
+
+void measureUTF16(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics) {
+        kernels->measureUTF16(data, length, countWords, statistics);
+}
+
+int64_t findEscape(const uint16_t* data, int64_t start, int64_t end, int kind) {
+        return kernels->findEscape(data, start, end, kind);
+}
+
+void encodeHex(const uint8_t* data, int64_t length, uint16_t* output) {
+        kernels->encodeHex(data, length, output);
+}
+
+uint32_t updateCRC32C(uint32_t crc, const uint8_t* data, int64_t length) {
+        return kernels->updateCRC32C(crc, data, length);
+}
+
+void initializeKernels() {
+        const char* name = getenv("STRINGBUILDER_KERNELS");
+        int i;
+        initializeCRC32C();
+        initializeBase64();
+#if defined(SIMD_AVX2)
+        cpuFeatures = detectCPUFeatures();
+#endif
+        // the fastest supported table is the last one
+        for (i = kernelTablesLength - 1; i > 0 && !isKernelTableSupported(kernelTables[i]); --i) {
+        }
+        kernels = kernelTables[i];
+        if (name != NULL && name[0] != 0) {
+                selectKernels(name);
+        }
+}
@@ -0,0 +1,107 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+// The text kernels of node-stringbuilder. They only work on raw UTF-16 code units and bytes, without N-API, so that they can also be built into the standalone benchmark (benchmark/kernels.c).
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#include <emmintrin.h>
+// SSE4.2 and AVX2 are only used by the functions built for them (see targetAVX2), after the CPU is checked
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define SIMD_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define blockSize 256
+
+#define escapeHTML 0
+#define escapeJSON 1
+#define escapeCSV 2
+#define escapeURL 3
+
+typedef struct {
+        int64_t words;
+        int64_t lines;
+        int64_t codePoints;
+        int64_t utf8Length;
+} TextStatistics;
+
+// The kernels which have SIMD variants are called through a table. initializeKernels picks the fastest one the CPU supports, unless the STRINGBUILDER_KERNELS environment variable names another one.
+typedef struct {
+        const char* name;
+        int64_t (*findCodeUnits)(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output);
+        int64_t (*findMismatch)(const uint16_t* a, const uint16_t* b, int64_t length);
+        int64_t (*skipWhiteSpaceForward)(const uint16_t* data, int64_t start, int64_t end);
+        int64_t (*skipWhiteSpaceBackward)(const uint16_t* data, int64_t start, int64_t end);
+        void (*convertCase)(uint16_t* data, int64_t length, bool upper);
+        void (*measureUTF16)(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics);
+        int64_t (*findEscape)(const uint16_t* data, int64_t start, int64_t end, int kind);
+        void (*encodeHex)(const uint8_t* data, int64_t length, uint16_t* output);
+        uint32_t (*updateCRC32C)(uint32_t crc, const uint8_t* data, int64_t length);
+} KernelTable;
+
+// The tables built in, from the slowest: scalar, sse2, sse4.2 and avx2 on x86, scalar and neon on ARM
+extern const KernelTable* const kernelTables[];
+extern const int kernelTablesLength;
+
+// Build the lookup tables and pick the kernel table, once before any other kernel is used.
+void initializeKernels();
+bool isKernelTableSupported(const KernelTable* table);
+// Switch to the table with the name. Return false if there is no such table or the CPU does not support it.
+bool selectKernels(const char* name);
+const KernelTable* selectedKernels();
+
+// Capacity (in bytes)
+int64_t growCapacity(int64_t capacity, int64_t size);
+
+// Search
+int64_t boyerMooreMagicLenFind(const uint16_t* source, int64_t sourceLength, const uint16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit, bool skip, int64_t* output);
+int64_t boyerMooreMagicLenFindRev(const uint16_t* source, int64_t sourceLength, const uint16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit, int64_t* output);
+int64_t findCodeUnits(const uint16_t* data, int64_t start, int64_t end, uint16_t unit, int64_t limit, int64_t* output);
+
+// Whitespace, case and comparison
+bool isWhiteSpace(uint16_t characterCode);
+int64_t skipWhiteSpaceForward(const uint16_t* data, int64_t start, int64_t end);
+int64_t skipWhiteSpaceBackward(const uint16_t* data, int64_t start, int64_t end);
+void convertCase(uint16_t* data, int64_t length, bool upper);
+int64_t findMismatch(const uint16_t* a, const uint16_t* b, int64_t length);
+int compareUTF16(const uint16_t* a, int64_t aLength, const uint16_t* b, int64_t bLength);
+int compareUTF16IgnoreCase(const uint16_t* a, int64_t aLength, const uint16_t* b, int64_t bLength);
+
+// Counting and reversing
+int64_t countWordsUTF16(const uint16_t* data, int64_t length);
+void measureUTF16(const uint16_t* data, int64_t length, bool countWords, TextStatistics* statistics);
+void reverseCodeUnits(uint16_t* data, int64_t length);
+void reverseSurrogatePairs(uint16_t* data, int64_t length);
+void reverseGraphemeClusters(uint16_t* data, int64_t length);
+
+// Encoding
+int64_t decodeUTF8(const uint8_t* data, int64_t length, uint16_t* output);
+int64_t utf8LengthOfUTF16(uint16_t* data, int64_t length);
+uint8_t* encodeUTF8CodePoint(uint32_t codePoint, uint8_t* output);
+uint8_t* encodeUTF16ToUTF8(uint16_t* data, int64_t length, uint8_t* output);
+int64_t findEscape(const uint16_t* data, int64_t start, int64_t end, int kind);
+int64_t escapeText(const uint16_t* data, int64_t length, int kind, uint16_t* output);
+int64_t encodeBase64(const uint8_t* data, int64_t length, bool url, uint16_t* output);
+int64_t decodeBase64(const uint16_t* text, int64_t length, uint8_t* output);
+void encodeHex(const uint8_t* data, int64_t length, uint16_t* output);
+
+// Hashing
+uint64_t xxh3(const uint8_t* data, int64_t length);
+uint64_t wyhash(const uint8_t* data, int64_t length, uint64_t seed);
+uint32_t updateCRC32C(uint32_t crc, const uint8_t* data, int64_t length);
+
+int64_t log2Floor(int64_t n);
+
+#endif
@@ -1,12 +1,63 @@
 #include <node_api.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdarg.h>
 
-#define max(a,b) (((a)>(b)) ? (a) : (b))
-#define blockSize 256
+#if defined(PROFILING)
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#endif
+
+#include "kernels.h"
 
-napi_ref StringBuilderRef, ReadStreamRef, ReadFileStreamRef, RegExpSearchRef;
+#define max(a,b) (((a)>(b)) ? (a) : (b))
+#define min(a,b) (((a)<(b)) ? (a) : (b))
+#define headerSize 96
+#define stackBufferSize 256
+#define scratchArenaInitialCapacity 16384
+#define scratchArenaMaxCapacity 4194304
+// the limit of every size in bytes, far from the overflow of int64_t, so that the sum of two sizes cannot overflow
+#define maxSize ((int64_t)1 << 52)
+#define capacityErrorCode "ERR_STRINGBUILDER_MAX_CAPACITY"
+
+#if defined(RUNTIME_STATS)
+// The runtime counters, of every StringBuilder (in the instance data) and of those tracked by trackRuntimeStats (in a buffer at element 3). statPeakCapacity keeps the maximum instead of the sum.
+#define statReallocations 0
+#define statBytesCopied 1
+#define statBytesMoved 2
+#define statSearches 3
+#define statBytesScanned 4
+#define statPeakCapacity 5
+#define statConvertedStrings 6
+#define statConvertedPrimitives 7
+#define statConvertedStringBuilders 8
+#define statConvertedBuffers 9
+#define statConvertedStreams 10
+#define statConvertedObjects 11
+#define statsLength 12
+void countRuntimeStat(napi_env env, napi_value me, int stat, int64_t n);
+#define countStat(env, me, stat, n) countRuntimeStat(env, me, stat, n)
+#else
+#define countStat(env, me, stat, n)
+#endif
+
+#if defined(PROFILING)
+// The latency histograms of profiling have one bucket per power of two nanoseconds (bucket i counts the calls taking [2^i, 2^(i+1)) ns, the last one the longer calls too), for each size class of the text (up to 64, 1024, 16384, 262144, 4194304 and more code units).
+#define histogramLength 32
+#define sizeClassesLength 6
+#endif
+
+// metadata[0]: capacity, metadata[1]: length, metadata[2]: segment capacity (0 means contiguous), metadata[3]: length of the sealed segments, metadata[4]: offset of the text after the header, metadata[5]: number of other instances sharing this buffer (copy-on-write), metadata[6]: generation, increased by every modification, metadata[7]: incremental CRC-32C state, metadata[8]: length of the text covered by metadata[7] (-1 means off), metadata[9]: length of the text not modified since the line index was updated, metadata[10]: maximum capacity, including the sealed segments (0 means no limit), metadata[11]: storage generation, increased whenever the text moves to another buffer or to another offset, so that the arrays of unsafeView are stale
+
+napi_ref StringBuilderRef, StringBuilderViewRef, StringBuilderTemplateRef, ReadStreamRef, ReadFileStreamRef, RegExpSearchRef;
 
 // TODO -----Creators-----
 
@@ -30,126 +81,50 @@ napi_value createEmptyArray(napi_env env){
 
 // TODO -----Functions-----
 
-napi_value boyerMooreMagicLen(napi_env env, char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit){
+// Put the matches found by a Boyer-Moore-MagicLen kernel into a Uint32Array. direction: 1 forward, 2 forward without overlapping, -1 backward
+napi_value boyerMooreMagicLenToArray(napi_env env, char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit, int direction){
         if (patternLength == 0 || offset < 0 || sourceLength - offset < patternLength) {
                 return createEmptyArray(env);
         }
         if(limit <= 0) {
                 limit = 1000;
         }
-
-        uint32_t* buffer;
-        napi_value arrayBuffer;
-        napi_create_arraybuffer(env, limit * 4, (void**)(&buffer), &arrayBuffer);
-
-        int64_t sourceLength_dec = sourceLength - 1;
-        int64_t patternLength_dec = patternLength - 1;
-        napi_value resultList;
-        uint32_t resultListLength = 0;
-        int64_t badCharShiftMap[65536] = { patternLength };
-        int64_t i;
-        for (i = 0; i < patternLength_dec; ++i) {
-                char16_t index = pattern[i];
-                badCharShiftMap[index] = patternLength_dec - i;
-        }
-        char16_t specialChar = pattern[patternLength_dec];
-        int64_t specialShift = badCharShiftMap[specialChar];
-        badCharShiftMap[specialChar] = 0;
-        int64_t sourcePointer = offset + patternLength_dec;
-        int64_t patternPointer;
-        while (sourcePointer < sourceLength) {
-                patternPointer = patternLength_dec;
-                while (patternPointer >= 0) {
-                        if (source[sourcePointer] != pattern[patternPointer]) {
-                                break;
-                        }
-                        --sourcePointer;
-                        --patternPointer;
-                }
-                int64_t starePointer = sourcePointer;
-                int64_t goodSuffixLength_inc = patternLength - patternPointer;
-                sourcePointer += goodSuffixLength_inc;
-                if (patternPointer < 0) {
-                        buffer[resultListLength++] = starePointer + 1;
-                        if (sourcePointer > sourceLength_dec || resultListLength == limit) {
-                                break;
-                        } else {
-                                sourcePointer += badCharShiftMap[source[sourcePointer]];
-                                continue;
-                        }
-                }
-                int64_t shift1 = (sourcePointer <= sourceLength_dec) ? badCharShiftMap[source[sourcePointer]] : 0;
-                if (shift1 >= patternLength_dec) {
-                        sourcePointer += shift1;
-                } else {
-                        int64_t shift2 = ((source[starePointer] == specialChar) ? specialShift : badCharShiftMap[source[starePointer]]) - goodSuffixLength_inc;
-                        sourcePointer += (shift1 >= shift2) ? shift1 : shift2;
-                }
+        // a match cannot start in the last patternLength - 1 code units
+        if (limit > sourceLength - offset - patternLength + 1) {
+                limit = sourceLength - offset - patternLength + 1;
         }
-        napi_create_typedarray(env, napi_uint32_array, resultListLength, arrayBuffer, 0, &resultList);
-        return resultList;
-}
 
-napi_value boyerMooreMagicLenSkip(napi_env env, char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit){
-        if (patternLength == 0 || offset < 0 || sourceLength - offset < patternLength) {
-                return createEmptyArray(env);
-        }
-        if(limit <= 0) {
-                limit = 1000;
+        int64_t positionsOnStack[64];
+        int64_t* positions = limit <= 64 ? positionsOnStack : (int64_t*)malloc(sizeof(int64_t) * limit);
+        int64_t resultListLength;
+        if (direction < 0) {
+                resultListLength = boyerMooreMagicLenFindRev(source, sourceLength, pattern, patternLength, offset, limit, positions);
+        } else {
+                resultListLength = boyerMooreMagicLenFind(source, sourceLength, pattern, patternLength, offset, limit, direction == 2, positions);
         }
 
         uint32_t* buffer;
-        napi_value arrayBuffer;
-        napi_create_arraybuffer(env, limit * 4, (void**)(&buffer), &arrayBuffer);
-
-        int64_t sourceLength_dec = sourceLength - 1;
-        int64_t patternLength_dec = patternLength - 1;
-        napi_value resultList;
-        uint32_t resultListLength = 0;
-        int64_t badCharShiftMap[65536] = { patternLength };
+        napi_value arrayBuffer, resultList;
+        napi_create_arraybuffer(env, resultListLength * 4, (void**)(&buffer), &arrayBuffer);
         int64_t i;
-        for (i = 0; i < patternLength_dec; ++i) {
-                char16_t index = pattern[i];
-                badCharShiftMap[index] = patternLength_dec - i;
-        }
-        char16_t specialChar = pattern[patternLength_dec];
-        int64_t specialShift = badCharShiftMap[specialChar];
-        badCharShiftMap[specialChar] = 0;
-        int64_t sourcePointer = offset + patternLength_dec;
-        int64_t patternPointer;
-        while (sourcePointer < sourceLength) {
-                patternPointer = patternLength_dec;
-                while (patternPointer >= 0) {
-                        if (source[sourcePointer] != pattern[patternPointer]) {
-                                break;
-                        }
-                        --sourcePointer;
-                        --patternPointer;
-                }
-                int64_t starePointer = sourcePointer;
-                int64_t goodSuffixLength_inc = patternLength - patternPointer;
-                sourcePointer += goodSuffixLength_inc;
-                if (patternPointer < 0) {
-                        buffer[resultListLength++] = starePointer + 1;
-                        if (sourcePointer > sourceLength_dec || resultListLength == limit) {
-                                break;
-                        } else {
-                                sourcePointer += patternLength_dec;
-                                continue;
-                        }
-                }
-                int64_t shift1 = (sourcePointer <= sourceLength_dec) ? badCharShiftMap[source[sourcePointer]] : 0;
-                if (shift1 >= patternLength_dec) {
-                        sourcePointer += shift1;
-                } else {
-                        int64_t shift2 = ((source[starePointer] == specialChar) ? specialShift : badCharShiftMap[source[starePointer]]) - goodSuffixLength_inc;
-                        sourcePointer += (shift1 >= shift2) ? shift1 : shift2;
-                }
+        for (i = 0; i < resultListLength; ++i) {
+                buffer[i] = (uint32_t)positions[i];
+        }
+        if (positions != positionsOnStack) {
+                free(positions);
         }
         napi_create_typedarray(env, napi_uint32_array, resultListLength, arrayBuffer, 0, &resultList);
         return resultList;
 }
 
+napi_value boyerMooreMagicLen(napi_env env, char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit){
+        return boyerMooreMagicLenToArray(env, source, sourceLength, pattern, patternLength, offset, limit, 1);
+}
+
+napi_value boyerMooreMagicLenSkip(napi_env env, char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit){
+        return boyerMooreMagicLenToArray(env, source, sourceLength, pattern, patternLength, offset, limit, 2);
+}
+
 void boyerMooreMagicLenSkipPure(char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit, int64_t** resultList, int64_t* resultListLength){
         if (patternLength == 0 || offset < 0 || sourceLength - offset < patternLength) {
                 *resultListLength = -1;
@@ -160,171 +135,642 @@ void boyerMooreMagicLenSkipPure(char16_t* source, int64_t sourceLength, char16_t
         }
 
         *resultList = (int64_t*)malloc(sizeof(int64_t) * limit);
-        *resultListLength = 0;
-
-        int64_t sourceLength_dec = sourceLength - 1;
-        int64_t patternLength_dec = patternLength - 1;
-        int64_t badCharShiftMap[65536] = { patternLength };
-        int64_t i;
-        for (i = 0; i < patternLength_dec; ++i) {
-                char16_t index = pattern[i];
-                badCharShiftMap[index] = patternLength_dec - i;
-        }
-        char16_t specialChar = pattern[patternLength_dec];
-        int64_t specialShift = badCharShiftMap[specialChar];
-        badCharShiftMap[specialChar] = 0;
-        int64_t sourcePointer = offset + patternLength_dec;
-        int64_t patternPointer;
-        while (sourcePointer < sourceLength) {
-                patternPointer = patternLength_dec;
-                while (patternPointer >= 0) {
-                        if (source[sourcePointer] != pattern[patternPointer]) {
-                                break;
-                        }
-                        --sourcePointer;
-                        --patternPointer;
-                }
-                int64_t starePointer = sourcePointer;
-                int64_t goodSuffixLength_inc = patternLength - patternPointer;
-                sourcePointer += goodSuffixLength_inc;
-                if (patternPointer < 0) {
-                        (*resultList)[(*resultListLength)++] = starePointer + 1;
-                        if (sourcePointer > sourceLength_dec || *resultListLength == limit) {
-                                break;
-                        } else {
-                                sourcePointer += patternLength_dec;
-                                continue;
-                        }
-                }
-                int64_t shift1 = (sourcePointer <= sourceLength_dec) ? badCharShiftMap[source[sourcePointer]] : 0;
-                if (shift1 >= patternLength_dec) {
-                        sourcePointer += shift1;
-                } else {
-                        int64_t shift2 = ((source[starePointer] == specialChar) ? specialShift : badCharShiftMap[source[starePointer]]) - goodSuffixLength_inc;
-                        sourcePointer += (shift1 >= shift2) ? shift1 : shift2;
-                }
-        }
+        *resultListLength = boyerMooreMagicLenFind(source, sourceLength, pattern, patternLength, offset, limit, true, *resultList);
 }
 
 napi_value boyerMooreMagicLenRev(napi_env env, char16_t* source, int64_t sourceLength, char16_t* pattern, int64_t patternLength, int64_t offset, int64_t limit){
-        if (patternLength == 0 || offset < 0 || sourceLength - offset < patternLength) {
-                return createEmptyArray(env);
-        }
-        if(limit <= 0) {
-                limit = 1000;
+        return boyerMooreMagicLenToArray(env, source, sourceLength, pattern, patternLength, offset, limit, -1);
+}
+
+void getViewBufferAndMetaData(napi_env env, napi_value me, napi_value parent, uint16_t** buffer, int64_t** metadata);
+
+void getTailBufferAndMetaData(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata){
+        napi_value _raw;
+        uint8_t* raw;
+        uint64_t rawLength;
+        napi_get_element(env, me, 0, &_raw);
+        if (napi_get_buffer_info(env, _raw, (void**)(&raw), &rawLength) != napi_ok) {
+                getViewBufferAndMetaData(env, me, _raw, buffer, metadata);
+                return;
         }
+        *buffer = (uint16_t*)(raw + headerSize + ((int64_t*)raw)[4]);
+        *metadata = (int64_t*)raw;
+}
 
-        uint32_t* buffer;
-        napi_value arrayBuffer;
-        napi_create_arraybuffer(env, limit * 4, (void**)(&buffer), &arrayBuffer);
+void dropSegments(napi_env env, napi_value me, int64_t* metadata){
+        napi_value undefined;
+        napi_get_undefined(env, &undefined);
+        napi_set_element(env, me, 1, undefined);
+        metadata[3] = 0;
+}
 
-        int64_t sourceLength_dec = sourceLength - 1;
-        int64_t patternLength_dec = patternLength - 1;
-        napi_value resultList;
-        napi_create_array(env, &resultList);
-        int64_t resultListLength = 0;
-        int64_t badCharShiftMap[65536] = { patternLength };
-        int64_t i;
-        for (i = patternLength_dec; i > 0; --i) {
-                char16_t index = pattern[i];
-                badCharShiftMap[index] = i;
-        }
-        char16_t specialChar = pattern[patternLength_dec];
-        int64_t specialShift = badCharShiftMap[specialChar];
-        badCharShiftMap[specialChar] = 0;
-        int64_t sourcePointer = sourceLength_dec - patternLength_dec - offset;
-        int64_t patternPointer;
-        while (sourcePointer >= 0) {
-                patternPointer = 0;
-                while (patternPointer < patternLength) {
-                        if (source[sourcePointer] != pattern[patternPointer]) {
-                                break;
-                        }
-                        ++sourcePointer;
-                        ++patternPointer;
-                }
-                int64_t starePointer = sourcePointer;
-                int64_t goodSuffixLength_inc = patternPointer + 1;
-                sourcePointer -= goodSuffixLength_inc;
-                if (patternPointer >= patternLength) {
-                        buffer[resultListLength++] = sourcePointer + 1;
-                        if (sourcePointer < 0 || resultListLength == limit) {
-                                break;
-                        } else {
-                                sourcePointer -= badCharShiftMap[source[sourcePointer]];
-                                continue;
-                        }
-                }
-                int64_t shift1 = (sourcePointer >= 0) ? badCharShiftMap[source[sourcePointer]] : 0;
-                if (shift1 >= patternLength_dec) {
-                        sourcePointer -= shift1;
-                } else {
-                        int64_t shift2 = ((source[starePointer] == specialChar) ? specialShift : badCharShiftMap[source[starePointer]]) - goodSuffixLength_inc;
-                        sourcePointer -= (shift1 >= shift2) ? shift1 : shift2;
-                }
+void flattenSegments(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata){
+        int64_t sealedLength = (*metadata)[3];
+        int64_t length = (*metadata)[1];
+        int64_t count = (sealedLength + length + blockSize - 1) / blockSize;
+        if (count == 0) {
+                count = 1;
         }
-        napi_create_typedarray(env, napi_uint32_array, resultListLength, arrayBuffer, 0, &resultList);
-        return resultList;
+        int64_t newCapacity = count * blockSize;
+        napi_value _raw;
+        uint8_t* raw;
+        napi_create_buffer(env, headerSize + newCapacity, (void**)(&raw), &_raw);
+        uint8_t* p = raw + headerSize;
+        napi_value segments;
+        uint32_t i, segmentsLength;
+        napi_get_element(env, me, 1, &segments);
+        napi_get_array_length(env, segments, &segmentsLength);
+        for (i = 0; i < segmentsLength; ++i) {
+                napi_value segment;
+                uint8_t* segmentRaw;
+                napi_get_element(env, segments, i, &segment);
+                napi_get_buffer_info(env, segment, (void**)(&segmentRaw), 0);
+                int64_t segmentLength = ((int64_t*)segmentRaw)[1];
+                memcpy(p, segmentRaw + headerSize + ((int64_t*)segmentRaw)[4], segmentLength);
+                p += segmentLength;
+        }
+        memcpy(p, *buffer, length);
+        memcpy(raw, *metadata, headerSize);
+        if ((*metadata)[5] > 0) {
+                --(*metadata)[5];
+        }
+        countStat(env, me, statReallocations, 1);
+        countStat(env, me, statBytesCopied, sealedLength + length);
+        countStat(env, me, statPeakCapacity, newCapacity);
+        *buffer = (uint16_t*)(raw + headerSize);
+        *metadata = (int64_t*)raw;
+        (*metadata)[0] = newCapacity;
+        (*metadata)[1] = sealedLength + length;
+        (*metadata)[4] = 0;
+        (*metadata)[5] = 0;
+        ++(*metadata)[11];
+        napi_set_element(env, me, 0, _raw);
+        dropSegments(env, me, *metadata);
 }
 
 void getRawData(napi_env env, napi_value me, uint8_t** raw, uint64_t* rawLength){
+        uint16_t* buffer;
+        int64_t* metadata;
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (metadata[3] > 0) {
+                flattenSegments(env, me, &buffer, &metadata);
+        }
         napi_value _raw;
         napi_get_element(env, me, 0, &_raw);
         napi_get_buffer_info(env, _raw, (void**)raw, rawLength);
 }
 
 void getBufferAndMetaData(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata){
+        getTailBufferAndMetaData(env, me, buffer, metadata);
+        if ((*metadata)[3] > 0) {
+                flattenSegments(env, me, buffer, metadata);
+        }
+}
+
+void getMetaData(napi_env env, napi_value me, int64_t** metadata){
         napi_value _raw;
         uint8_t* raw;
-        uint64_t rawLength;
         napi_get_element(env, me, 0, &_raw);
-        napi_get_buffer_info(env, _raw, (void**)(&raw), &rawLength);
-        *buffer = (uint16_t*)(raw + 16);
+        if (napi_get_buffer_info(env, _raw, (void**)(&raw), 0) != napi_ok) {
+                uint16_t* buffer;
+                getViewBufferAndMetaData(env, me, _raw, &buffer, metadata);
+                return;
+        }
         *metadata = (int64_t*)raw;
 }
 
-void getMetaData(napi_env env, napi_value me, int64_t** metadata){
+// A view has its StringBuilder at element 0 and a header at element 1, whose metadata[1] is the length of the view, metadata[4] is the offset of the view in the text, and metadata[6] is the generation of the StringBuilder when the view was created. A stale view becomes empty and throws an error.
+void getViewBufferAndMetaData(napi_env env, napi_value me, napi_value parent, uint16_t** buffer, int64_t** metadata){
+        static int64_t emptyMetadata[headerSize / 8];
+        napi_value _view;
+        int64_t* view;
+        napi_get_element(env, me, 1, &_view);
+        if (napi_get_buffer_info(env, _view, (void**)(&view), 0) != napi_ok) {
+                *buffer = (uint16_t*)(emptyMetadata + 1);
+                *metadata = emptyMetadata;
+                napi_throw_type_error(env, 0, "Not a StringBuilder");
+                return;
+        }
+        int64_t* parentMetadata;
+        getBufferAndMetaData(env, parent, buffer, &parentMetadata);
+        *metadata = view;
+        if (parentMetadata[6] != view[6]) {
+                view[0] = 0;
+                view[1] = 0;
+                view[4] = 0;
+                napi_throw_error(env, 0, "The StringBuilder has been modified after the view was created");
+                return;
+        }
+        *buffer += view[4] / 2;
+}
+
+// Clones share the buffer until one of them writes, so it has to be copied (with lengthToKeep bytes of the text) before writing if it is shared. The count is not decreased when a clone is garbage collected, so the last owner may copy once more than necessary.
+void unshareBuffer(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata, int64_t lengthToKeep) {
+        if ((*metadata)[5] == 0) {
+                return;
+        }
+        --(*metadata)[5];
+        int64_t capacity = (*metadata)[0] + (*metadata)[4];
         napi_value _raw;
         uint8_t* raw;
-        napi_get_element(env, me, 0, &_raw);
-        napi_get_buffer_info(env, _raw, (void**)(&raw), 0);
+        napi_create_buffer(env, headerSize + capacity, (void**)(&raw), &_raw);
+        memcpy(raw, *metadata, headerSize);
+        memcpy(raw + headerSize, *buffer, lengthToKeep);
+        countStat(env, me, statReallocations, 1);
+        countStat(env, me, statBytesCopied, lengthToKeep);
+        *buffer = (uint16_t*)(raw + headerSize);
         *metadata = (int64_t*)raw;
+        (*metadata)[0] = capacity;
+        (*metadata)[4] = 0;
+        (*metadata)[5] = 0;
+        ++(*metadata)[11];
+        napi_set_element(env, me, 0, _raw);
+}
+
+void getWritableTailBufferAndMetaData(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata){
+        getTailBufferAndMetaData(env, me, buffer, metadata);
+        unshareBuffer(env, me, buffer, metadata, (*metadata)[1]);
+        ++(*metadata)[6];
+}
+
+void getWritableBufferAndMetaData(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata){
+        getBufferAndMetaData(env, me, buffer, metadata);
+        unshareBuffer(env, me, buffer, metadata, (*metadata)[1]);
+        ++(*metadata)[6];
+}
+
+// The text from position (in bytes) has been modified (not only appended), so the incremental hash and the line index are only valid before it
+void markTextModified(int64_t* metadata, int64_t position) {
+        if (metadata[8] > position) {
+                metadata[7] = 0xFFFFFFFF;
+                metadata[8] = 0;
+        }
+        if (metadata[9] > position) {
+                metadata[9] = position;
+        }
 }
 
-void reAlloc(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata, int64_t newSize) {
+int64_t getMaxCapacity(napi_env env, int64_t* metadata);
+bool createStorage(napi_env env, int64_t capacity, uint8_t** raw, napi_value* _raw);
+void throwCapacityError(napi_env env);
+
+// Grow the buffer to hold newSize bytes. Return false with a RangeError thrown if it would exceed the maximum capacity.
+bool reAlloc(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata, int64_t newSize) {
         int64_t capacity = (*metadata)[0];
         if (capacity < newSize) {
+                int64_t maxCapacity = getMaxCapacity(env, *metadata) - (*metadata)[3];
+                if (newSize > maxCapacity) {
+                        throwCapacityError(env);
+                        return false;
+                }
                 int64_t length = (*metadata)[1];
-                int64_t count = (newSize - capacity + blockSize - 1) / blockSize;
-                int64_t sizeToAdd = count * blockSize;
                 uint16_t* oldBuffer = *buffer;
                 napi_value _raw;
                 uint8_t* raw;
-                int64_t newCapacity = capacity + sizeToAdd;
-                napi_create_buffer(env, 16 + newCapacity, (void**)(&raw), &_raw);
-                *buffer = (uint16_t*)(raw + 16);
+                int64_t newCapacity = growCapacity(capacity, newSize);
+                if (newCapacity > maxCapacity) {
+                        newCapacity = maxCapacity;
+                }
+                if (!createStorage(env, newCapacity, &raw, &_raw)) {
+                        return false;
+                }
+                *buffer = (uint16_t*)(raw + headerSize);
                 memcpy(*buffer, oldBuffer, length);
+                memcpy(raw, *metadata, headerSize);
+                countStat(env, me, statReallocations, 1);
+                countStat(env, me, statBytesCopied, length);
+                countStat(env, me, statPeakCapacity, (*metadata)[3] + newCapacity);
+                if ((*metadata)[5] > 0) {
+                        --(*metadata)[5];
+                }
                 *metadata = (int64_t*)raw;
                 (*metadata)[0] = newCapacity;
-                (*metadata)[1] = length;
+                (*metadata)[4] = 0;
+                (*metadata)[5] = 0;
+                ++(*metadata)[11];
                 napi_set_element(env, me, 0, _raw);
                 // TODO Need to free old data?
         }
+        return true;
+}
+
+bool reAllocForAppend(napi_env env, napi_value me, uint16_t** buffer, int64_t** metadata, int64_t sizeToAppend) {
+        int64_t segmentCapacity = (*metadata)[2];
+        int64_t length = (*metadata)[1];
+        if (segmentCapacity == 0 || length == 0) {
+                return reAlloc(env, me, buffer, metadata, length + sizeToAppend);
+        }
+        if ((*metadata)[0] - length >= sizeToAppend) {
+                return true;
+        }
+        int64_t maxCapacity = getMaxCapacity(env, *metadata) - (*metadata)[3] - length;
+        if (sizeToAppend > maxCapacity) {
+                throwCapacityError(env);
+                return false;
+        }
+        int64_t count = (max(segmentCapacity, sizeToAppend) + blockSize - 1) / blockSize;
+        int64_t newCapacity = count * blockSize;
+        if (newCapacity > maxCapacity) {
+                newCapacity = maxCapacity;
+        }
+        napi_value _raw;
+        uint8_t* raw;
+        if (!createStorage(env, newCapacity, &raw, &_raw)) {
+                return false;
+        }
+        // seal the tail segment instead of copying it
+        napi_value _tail, segments;
+        uint32_t segmentsLength = 0;
+        napi_get_element(env, me, 0, &_tail);
+        if ((*metadata)[3] == 0) {
+                napi_create_array(env, &segments);
+                napi_set_element(env, me, 1, segments);
+        } else {
+                napi_get_element(env, me, 1, &segments);
+                napi_get_array_length(env, segments, &segmentsLength);
+        }
+        napi_set_element(env, segments, segmentsLength, _tail);
+        memcpy(raw, *metadata, headerSize);
+        countStat(env, me, statReallocations, 1);
+        countStat(env, me, statPeakCapacity, (*metadata)[3] + length + newCapacity);
+        *buffer = (uint16_t*)(raw + headerSize);
+        *metadata = (int64_t*)raw;
+        (*metadata)[0] = newCapacity;
+        (*metadata)[1] = 0;
+        (*metadata)[3] += length;
+        (*metadata)[4] = 0;
+        (*metadata)[5] = 0;
+        ++(*metadata)[11];
+        napi_set_element(env, me, 0, _raw);
+        return true;
+}
+
+void getSegment(napi_env env, napi_value me, napi_value segments, uint32_t index, uint32_t segmentsLength, napi_value* segment, uint16_t** data, int64_t* dataLength){
+        uint8_t* raw;
+        if (index < segmentsLength) {
+                napi_get_element(env, segments, index, segment);
+        } else {
+                napi_get_element(env, me, 0, segment);
+        }
+        napi_get_buffer_info(env, *segment, (void**)(&raw), 0);
+        *data = (uint16_t*)(raw + headerSize + ((int64_t*)raw)[4]);
+        *dataLength = ((int64_t*)raw)[1];
+}
+
+// A bump allocator for the temporary UTF-16 copies of arguments. Every method using it is called through callWithScratchArena, which gives the memory back when the method returns, so nested calls (through JS callbacks) are safe. An allocation which does not fit is malloc'd, and the arena grows to the high-water mark when it is not in use.
+typedef struct {
+        uint8_t* data;
+        size_t capacity;
+        size_t used;
+        size_t highWaterMark;
+        int64_t growths;
+        int64_t overflows;
+} ScratchArena;
+
+typedef struct {
+        ScratchArena arena;
+        // the maximum capacity of every StringBuilder in bytes (0 means no limit)
+        int64_t maxCapacity;
+#if defined(RUNTIME_STATS)
+        int64_t stats[statsLength];
+        // the number of StringBuilders which have been tracked, not decreased when they are garbage collected, so that element 3 is only looked up if there may be one
+        int64_t trackedInstances;
+#endif
+#if defined(PROFILING)
+        bool profiling;
+        struct ProfiledMethod* profiledMethods;
+        int64_t profiledMethodsLength;
+#endif
+} InstanceData;
+
+#if defined(PROFILING)
+typedef struct {
+        int64_t count;
+        int64_t sum;
+        int64_t max;
+        int64_t buckets[histogramLength];
+} Histogram;
+
+// A method of the StringBuilder class called through callProfiled. Instance data belongs to one thread, so its histograms are updated without locks.
+typedef struct ProfiledMethod {
+        const char* name;
+        napi_callback method;
+        void* data;
+        bool isStatic;
+        InstanceData* instanceData;
+        // sizeClassesLength histograms, allocated when profiling is enabled for the first time
+        Histogram* histograms;
+} ProfiledMethod;
+#endif
+
+InstanceData* getInstanceData(napi_env env) {
+        InstanceData* data;
+        napi_get_instance_data(env, (void**)(&data));
+        return data;
+}
+
+ScratchArena* getScratchArena(napi_env env) {
+        return &getInstanceData(env)->arena;
+}
+
+// The maximum capacity in bytes, the smaller one of the limits of the instance and the global one
+int64_t getMaxCapacity(napi_env env, int64_t* metadata) {
+        int64_t maxCapacity = getInstanceData(env)->maxCapacity;
+        if (metadata[10] > 0 && (maxCapacity == 0 || metadata[10] < maxCapacity)) {
+                maxCapacity = metadata[10];
+        }
+        return maxCapacity == 0 ? maxSize : maxCapacity;
+}
+
+void throwCapacityError(napi_env env) {
+        napi_throw_range_error(env, capacityErrorCode, "The capacity of the StringBuilder would exceed its maxCapacity");
+}
+
+// Allocate a buffer of the header and capacity bytes, or throw a RangeError if it cannot be allocated.
+bool createStorage(napi_env env, int64_t capacity, uint8_t** raw, napi_value* _raw) {
+        if (capacity > maxSize || napi_create_buffer(env, headerSize + capacity, (void**)raw, _raw) != napi_ok) {
+                napi_value error;
+                napi_get_and_clear_last_exception(env, &error);
+                napi_throw_range_error(env, capacityErrorCode, "The buffer of the StringBuilder cannot be allocated");
+                return false;
+        }
+        return true;
+}
+
+// The product of two sizes, or maxSize + 1 if it is bigger than maxSize
+int64_t multiplySizes(int64_t a, int64_t b) {
+        if (a < 0 || b < 0) {
+                return maxSize + 1;
+        }
+        if (b > 0 && a > maxSize / b) {
+                return maxSize + 1;
+        }
+        return a * b;
+}
+
+#if defined(RUNTIME_STATS)
+void addRuntimeStat(int64_t* stats, int stat, int64_t n) {
+        if (stat == statPeakCapacity) {
+                if (stats[stat] < n) {
+                        stats[stat] = n;
+                }
+        } else {
+                stats[stat] += n;
+        }
+}
+
+void countRuntimeStat(napi_env env, napi_value me, int stat, int64_t n) {
+        InstanceData* data = getInstanceData(env);
+        addRuntimeStat(data->stats, stat, n);
+        if (data->trackedInstances == 0 || me == NULL) {
+                return;
+        }
+        napi_value _stats;
+        int64_t* stats;
+        napi_get_element(env, me, 3, &_stats);
+        if (napi_get_buffer_info(env, _stats, (void**)(&stats), 0) == napi_ok) {
+                addRuntimeStat(stats, stat, n);
+        }
+}
+#endif
+
+void* allocateScratch(napi_env env, size_t size, bool* freeAble) {
+        ScratchArena* arena = getScratchArena(env);
+        size = (size + 15) & ~(size_t)15;
+        if (arena->used + size > arena->highWaterMark) {
+                arena->highWaterMark = arena->used + size;
+        }
+        if (arena->used + size <= arena->capacity) {
+                void* p = arena->data + arena->used;
+                arena->used += size;
+                *freeAble = false;
+                return p;
+        }
+        ++arena->overflows;
+        *freeAble = true;
+        return malloc(size);
+}
+
+// Grow the arena (which must not be in use) to its high-water mark. If the memory cannot be allocated, the old block is kept.
+napi_status growScratchArena(napi_env env, ScratchArena* arena) {
+        size_t newCapacity = (arena->highWaterMark + 4095) & ~(size_t)4095;
+        if (newCapacity > scratchArenaMaxCapacity) {
+                newCapacity = scratchArenaMaxCapacity;
+        }
+        uint8_t* data = (uint8_t*)malloc(newCapacity);
+        if (data == NULL) {
+                return napi_generic_failure;
+        }
+        free(arena->data);
+        arena->data = data;
+        int64_t externalMemory;
+        napi_adjust_external_memory(env, (int64_t)newCapacity - (int64_t)arena->capacity, &externalMemory);
+        arena->capacity = newCapacity;
+        ++arena->growths;
+        return napi_ok;
+}
+
+napi_value runWithScratchArena(napi_env env, napi_callback_info info, napi_callback method) {
+        ScratchArena* arena = getScratchArena(env);
+        size_t mark = arena->used;
+        napi_value result = method(env, info);
+        arena->used = mark;
+        if (mark == 0 && arena->highWaterMark > arena->capacity && arena->capacity < scratchArenaMaxCapacity) {
+                // a failed growth only means the big allocations keep falling back to malloc
+                growScratchArena(env, arena);
+        }
+        return result;
+}
+
+napi_value callWithScratchArena(napi_env env, napi_callback_info info) {
+        napi_callback method;
+        napi_get_cb_info(env, info, 0, 0, 0, (void**)(&method));
+        return runWithScratchArena(env, info, method);
+}
+
+#if defined(PROFILING)
+uint64_t nowNanoseconds() {
+#if defined(_WIN32)
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)t.tv_sec * 1000000000ULL + (uint64_t)t.tv_nsec;
+#endif
+}
+
+napi_value callProfiledMethod(napi_env env, napi_callback_info info, ProfiledMethod* profiled) {
+        // the data of the callback info is the ProfiledMethod, so a method which reads its own data (through callWithScratchArena) has to be given it directly
+        if (profiled->method == callWithScratchArena) {
+                return runWithScratchArena(env, info, (napi_callback)profiled->data);
+        }
+        return profiled->method(env, info);
+}
+
+void enableProfiling(napi_env env, InstanceData* data, bool enable) {
+        if (enable) {
+                int64_t i;
+                for (i = 0; i < data->profiledMethodsLength; ++i) {
+                        ProfiledMethod* profiled = data->profiledMethods + i;
+                        if (profiled->histograms == NULL) {
+                                int64_t externalMemory;
+                                profiled->histograms = (Histogram*)calloc(sizeClassesLength, sizeof(Histogram));
+                                napi_adjust_external_memory(env, sizeClassesLength * sizeof(Histogram), &externalMemory);
+                        }
+                }
+        }
+        data->profiling = enable;
+}
+
+// Every method in the table of the StringBuilder class is called through this. When profiling is enabled, the time of the call is put into the histogram of the method for the size of the text it is called on.
+napi_value callProfiled(napi_env env, napi_callback_info info) {
+        napi_value me;
+        ProfiledMethod* profiled;
+        napi_get_cb_info(env, info, 0, 0, &me, (void**)(&profiled));
+        if (!profiled->instanceData->profiling) {
+                return callProfiledMethod(env, info, profiled);
+        }
+        int sizeClass = 0;
+        if (!profiled->isStatic) {
+                int64_t* metadata;
+                getMetaData(env, me, &metadata);
+                int64_t length = (metadata[3] + metadata[1]) / 2;
+                for (; sizeClass < sizeClassesLength - 1 && length > (64LL << (4 * sizeClass)); ++sizeClass) {
+                }
+        }
+        uint64_t start = nowNanoseconds();
+        napi_value result = callProfiledMethod(env, info, profiled);
+        int64_t elapsed = (int64_t)(nowNanoseconds() - start);
+        Histogram* histogram = profiled->histograms + sizeClass;
+        int64_t bucket = elapsed > 1 ? log2Floor(elapsed) : 0;
+        if (bucket >= histogramLength) {
+                bucket = histogramLength - 1;
+        }
+        ++histogram->count;
+        histogram->sum += elapsed;
+        if (histogram->max < elapsed) {
+                histogram->max = elapsed;
+        }
+        ++histogram->buckets[bucket];
+        return result;
+}
+
+// Make every method in the table be called through callProfiled.
+void profileMethods(InstanceData* data, napi_property_descriptor* descriptors, size_t descriptorsLength) {
+        data->profiledMethods = (ProfiledMethod*)calloc(descriptorsLength, sizeof(ProfiledMethod));
+        data->profiledMethodsLength = 0;
+        size_t i;
+        for (i = 0; i < descriptorsLength; ++i) {
+                napi_property_descriptor* descriptor = descriptors + i;
+                if (descriptor->method == NULL) {
+                        continue;
+                }
+                ProfiledMethod* profiled = data->profiledMethods + data->profiledMethodsLength++;
+                profiled->isStatic = (descriptor->attributes & napi_static) != 0;
+                if (profiled->isStatic) {
+                        // a static method may have the name of an instance method
+                        char* name = (char*)malloc(strlen(descriptor->utf8name) + 15);
+                        sprintf(name, "StringBuilder.%s", descriptor->utf8name);
+                        profiled->name = name;
+                } else {
+                        profiled->name = descriptor->utf8name;
+                }
+                profiled->method = descriptor->method;
+                profiled->data = descriptor->data;
+                profiled->instanceData = data;
+                descriptor->method = callProfiled;
+                descriptor->data = profiled;
+        }
+}
+#endif
+
+void finalizeInstanceData(napi_env env, void* data, void* hint) {
+        InstanceData* instanceData = (InstanceData*)data;
+        free(instanceData->arena.data);
+#if defined(PROFILING)
+        int64_t i;
+        for (i = 0; i < instanceData->profiledMethodsLength; ++i) {
+                ProfiledMethod* profiled = instanceData->profiledMethods + i;
+                free(profiled->histograms);
+                if (profiled->isStatic) {
+                        free((char*)profiled->name);
+                }
+        }
+        free(instanceData->profiledMethods);
+#endif
+        free(instanceData);
 }
 
+// Format a boolean or a safe integer the same as JS does, and return the number of code units (at most 24), or -1 if it should be coerced by V8.
+int64_t formatPrimitive(napi_env env, napi_value source, napi_valuetype type, uint16_t* output) {
+        int64_t i = 0;
+        if (type == napi_boolean) {
+                bool value;
+                napi_get_value_bool(env, source, &value);
+                const char* text = value ? "true" : "false";
+                for (; text[i]; ++i) {
+                        output[i] = text[i];
+                }
+                return i;
+        }
+        double value;
+        napi_get_value_double(env, source, &value);
+        if (!(value > -9007199254740992.0 && value < 9007199254740992.0) || value != (double)(int64_t)value) {
+                return -1;
+        }
+        int64_t integer = (int64_t)value;
+        uint64_t magnitude = integer < 0 ? -integer : integer;
+        uint16_t digits[20];
+        int64_t digitsLength = 0;
+        do {
+                digits[digitsLength++] = '0' + magnitude % 10;
+                magnitude /= 10;
+        } while (magnitude > 0);
+        if (integer < 0) {
+                output[i++] = '-';
+        }
+        while (digitsLength > 0) {
+                output[i++] = digits[--digitsLength];
+        }
+        return i;
+}
+
+// Append a string of size bytes. N-API writes a terminator after it, for which there is no room only if the capacity has reached its limit, and then the string is copied through a temporary buffer.
+bool appendString(napi_env env, napi_value me, napi_value string, int64_t size, uint16_t** buffer, int64_t** metadata) {
+        if (reAllocForAppend(env, me, buffer, metadata, size + 2)) {
+                napi_get_value_string_utf16(env, string, *buffer + ((*metadata)[1] / 2), size / 2 + 1, 0);
+                (*metadata)[1] += size;
+                return true;
+        }
+        napi_value error;
+        napi_get_and_clear_last_exception(env, &error);
+        if (!reAllocForAppend(env, me, buffer, metadata, size)) {
+                return false;
+        }
+        uint16_t* temporary = (uint16_t*)malloc(size + 2);
+        napi_get_value_string_utf16(env, string, temporary, size / 2 + 1, 0);
+        memcpy(*buffer + ((*metadata)[1] / 2), temporary, size);
+        free(temporary);
+        (*metadata)[1] += size;
+        return true;
+}
+
+// Append source to the tail, which is taken (writable) only after source has been converted, because the conversion may run JS code (toString) which clones or views me.
 napi_value appendUTF16FromOutside(napi_env env, napi_value me, napi_value source, uint16_t** buffer, int64_t** metadata) {
         int64_t contentBufferLength;
-        int64_t length = (*metadata)[1];
-        int64_t concatLength;
+        int64_t length;
         napi_valuetype type;
         napi_typeof(env, source, &type);
         if (type == napi_string) {
                 napi_get_value_string_utf16(env, source, NULL, 0, (uint64_t*)(&contentBufferLength));
-                contentBufferLength *= 2;
-                concatLength = length + contentBufferLength;
-                reAlloc(env, me, buffer, metadata, concatLength + 2);
-                napi_get_value_string_utf16(env, source, *buffer + (length / 2), contentBufferLength + 2, 0);
-                (*metadata)[1] = concatLength;
+                getWritableTailBufferAndMetaData(env, me, buffer, metadata);
+                if (!appendString(env, me, source, contentBufferLength * 2, buffer, metadata)) {
+                        return 0;
+                }
+                countStat(env, me, statConvertedStrings, 1);
                 return me;
         }else if(type == napi_object) {
                 bool isStringBuilder;
@@ -335,26 +781,33 @@ napi_value appendUTF16FromOutside(napi_env env, napi_value me, napi_value source
                         uint16_t* t_buffer;
                         int64_t* t_metadata;
                         getBufferAndMetaData(env, source, &t_buffer, &t_metadata);
-                        concatLength = length + t_metadata[1];
-                        reAlloc(env, me, buffer, metadata, concatLength);
-                        memcpy(*buffer + (length / 2), t_buffer, t_metadata[1]);
-                        (*metadata)[1] = concatLength;
+                        contentBufferLength = t_metadata[1];
+                        // the source may be this builder itself, which has just been flattened
+                        getWritableTailBufferAndMetaData(env, me, buffer, metadata);
+                        if (!reAllocForAppend(env, me, buffer, metadata, contentBufferLength)) {
+                                return 0;
+                        }
+                        length = (*metadata)[1];
+                        memcpy(*buffer + (length / 2), t_buffer, contentBufferLength);
+                        (*metadata)[1] = length + contentBufferLength;
+                        countStat(env, me, statConvertedStringBuilders, 1);
                         return me;
                 }
                 bool isBuffer;
                 napi_is_buffer(env, source, &isBuffer);
                 if(isBuffer) {
-                        char* utf8Data;
+                        uint8_t* utf8Data;
                         size_t utf8DataLength;
                         napi_get_buffer_info(env, source, (void**)(&utf8Data), &utf8DataLength);
-                        napi_value tempString;
-                        napi_create_string_utf8(env, utf8Data, utf8DataLength, &tempString);
-                        napi_get_value_string_utf16(env, tempString, NULL, 0, (uint64_t*)&contentBufferLength);
-                        contentBufferLength *= 2;
-                        concatLength = length + contentBufferLength;
-                        reAlloc(env, me, buffer, metadata, concatLength + 2);
-                        napi_get_value_string_utf16(env, tempString, *buffer + (length / 2), contentBufferLength + 2, 0);
-                        (*metadata)[1] = concatLength;
+                        contentBufferLength = decodeUTF8(utf8Data, utf8DataLength, NULL) * 2;
+                        getWritableTailBufferAndMetaData(env, me, buffer, metadata);
+                        if (!reAllocForAppend(env, me, buffer, metadata, contentBufferLength)) {
+                                return 0;
+                        }
+                        length = (*metadata)[1];
+                        decodeUTF8(utf8Data, utf8DataLength, *buffer + (length / 2));
+                        (*metadata)[1] = length + contentBufferLength;
+                        countStat(env, me, statConvertedBuffers, 1);
                         return me;
                 }
                 bool isReadStream;
@@ -370,38 +823,61 @@ napi_value appendUTF16FromOutside(napi_env env, napi_value me, napi_value source
                         args[0] = source;
                         napi_call_function(env, source, ReadFileStream, 1, args, &result);
                         napi_get_buffer_info(env, result, (void**)(&contentBuffer), (uint64_t*)&contentBufferLength);
-                        concatLength = length + contentBufferLength;
-                        reAlloc(env, me, buffer, metadata, concatLength);
+                        getWritableTailBufferAndMetaData(env, me, buffer, metadata);
+                        if (!reAllocForAppend(env, me, buffer, metadata, contentBufferLength)) {
+                                return 0;
+                        }
+                        length = (*metadata)[1];
                         memcpy(*buffer + (length / 2), contentBuffer, contentBufferLength);
-                        (*metadata)[1] = concatLength;
+                        (*metadata)[1] = length + contentBufferLength;
+                        countStat(env, me, statConvertedStreams, 1);
+                        return me;
+                }
+        }else if(type == napi_boolean || type == napi_number) {
+                uint16_t text[24];
+                contentBufferLength = formatPrimitive(env, source, type, text) * 2;
+                if (contentBufferLength >= 0) {
+                        getWritableTailBufferAndMetaData(env, me, buffer, metadata);
+                        if (!reAllocForAppend(env, me, buffer, metadata, contentBufferLength)) {
+                                return 0;
+                        }
+                        length = (*metadata)[1];
+                        memcpy(*buffer + (length / 2), text, contentBufferLength);
+                        (*metadata)[1] = length + contentBufferLength;
+                        countStat(env, me, statConvertedPrimitives, 1);
                         return me;
                 }
-                type = napi_boolean;
         }
-        if(type == napi_boolean || type == napi_number) {
+        if(type == napi_boolean || type == napi_number || type == napi_object) {
                 napi_value tempString;
-                napi_coerce_to_string(env, source, &tempString);
+                if (napi_coerce_to_string(env, source, &tempString) != napi_ok) {
+                        return 0;
+                }
                 napi_get_value_string_utf16(env, tempString, NULL, 0, (uint64_t*)&contentBufferLength);
-                contentBufferLength *= 2;
-                concatLength = length + contentBufferLength;
-                reAlloc(env, me, buffer, metadata, concatLength + 2);
-                napi_get_value_string_utf16(env, tempString, *buffer + (length / 2), contentBufferLength + 2, 0);
-                (*metadata)[1] = concatLength;
+                getWritableTailBufferAndMetaData(env, me, buffer, metadata);
+                if (!appendString(env, me, tempString, contentBufferLength * 2, buffer, metadata)) {
+                        return 0;
+                }
+                countStat(env, me, type == napi_object ? statConvertedObjects : statConvertedPrimitives, 1);
+                return me;
         }
+        getWritableTailBufferAndMetaData(env, me, buffer, metadata);
         return me;
 }
 
-void getUTF16FromOutside(napi_env env, napi_value source, uint16_t** sourceData, int64_t* sourceDataLength, bool* freeAble) {
+// The data is allocated from the scratch arena unless freeAble is set, in which case it has to be freed.
+void getUTF16FromOutside(napi_env env, napi_value me, napi_value source, uint16_t** sourceData, int64_t* sourceDataLength, bool* freeAble) {
         napi_valuetype type;
         napi_typeof(env, source, &type);
         if (type == napi_string) {
                 size_t sourceDataSize;
                 napi_get_value_string_utf16(env, source, NULL, 0, &sourceDataSize);
                 ++sourceDataSize;
-                *sourceData = (uint16_t*)malloc(sourceDataSize * 2);
-                *freeAble = true;
+                *sourceData = (uint16_t*)allocateScratch(env, sourceDataSize * 2, freeAble);
                 napi_get_value_string_utf16(env, source, *sourceData, sourceDataSize, &sourceDataSize);
                 *sourceDataLength = sourceDataSize * 2;
+                countStat(env, me, statConvertedStrings, 1);
+                return;
         }else if(type == napi_object) {
                 bool isStringBuilder;
                 napi_value StringBuilder;
@@ -412,23 +888,20 @@ void getUTF16FromOutside(napi_env env, napi_value source, uint16_t** sourceData,
                         getBufferAndMetaData(env, source, sourceData, &metadata);
                         *sourceDataLength = metadata[1];
                         *freeAble = false;
+                        countStat(env, me, statConvertedStringBuilders, 1);
                         return;
                 }
                 bool isBuffer;
                 napi_is_buffer(env, source, &isBuffer);
                 if(isBuffer) {
-                        char* utf8Data;
+                        uint8_t* utf8Data;
                         size_t utf8DataLength;
                         napi_get_buffer_info(env, source, (void**)(&utf8Data), &utf8DataLength);
-                        napi_value tempString;
-                        napi_create_string_utf8(env, utf8Data, utf8DataLength, &tempString);
-                        size_t sourceDataSize;
-                        napi_get_value_string_utf16(env, tempString, NULL, 0, &sourceDataSize);
-                        ++sourceDataSize;
-                        *sourceData = (uint16_t*)malloc(sourceDataSize * 2);
-                        *freeAble = true;
-                        napi_get_value_string_utf16(env, tempString, *sourceData, sourceDataSize, &sourceDataSize);
+                        int64_t sourceDataSize = decodeUTF8(utf8Data, utf8DataLength, NULL);
+                        *sourceData = (uint16_t*)allocateScratch(env, sourceDataSize * 2, freeAble);
+                        decodeUTF8(utf8Data, utf8DataLength, *sourceData);
                         *sourceDataLength = sourceDataSize * 2;
+                        countStat(env, me, statConvertedBuffers, 1);
                         return;
                 }
                 bool isReadStream;
@@ -444,28 +917,78 @@ void getUTF16FromOutside(napi_env env, napi_value source, uint16_t** sourceData,
                         napi_call_function(env, source, ReadFileStream, 1, args, &result);
                         napi_get_buffer_info(env, result, (void**)sourceData, (uint64_t*)sourceDataLength);
                         *freeAble = false;
+                        countStat(env, me, statConvertedStreams, 1);
                         return;
                 }
-                type = napi_boolean;
         }else if(type == napi_boolean || type == napi_number) {
+                uint16_t text[24];
+                int64_t textLength = formatPrimitive(env, source, type, text);
+                if (textLength >= 0) {
+                        *sourceData = (uint16_t*)allocateScratch(env, textLength * 2, freeAble);
+                        memcpy(*sourceData, text, textLength * 2);
+                        *sourceDataLength = textLength * 2;
+                        countStat(env, me, statConvertedPrimitives, 1);
+                        return;
+                }
+        }
+        if(type == napi_boolean || type == napi_number || type == napi_object) {
                 napi_value tempString;
-                napi_coerce_to_string(env, source, &tempString);
+                if (napi_coerce_to_string(env, source, &tempString) != napi_ok) {
+                        *sourceDataLength = 0;
+                        *freeAble = false;
+                        return;
+                }
                 size_t sourceDataSize;
                 napi_get_value_string_utf16(env, tempString, NULL, 0, &sourceDataSize);
                 ++sourceDataSize;
-                *sourceData = (uint16_t*)malloc(sourceDataSize * 2);
-                *freeAble = true;
+                *sourceData = (uint16_t*)allocateScratch(env, sourceDataSize * 2, freeAble);
                 napi_get_value_string_utf16(env, tempString, *sourceData, sourceDataSize, &sourceDataSize);
                 *sourceDataLength = sourceDataSize * 2;
+                countStat(env, me, type == napi_object ? statConvertedObjects : statConvertedPrimitives, 1);
         }else{
                 *sourceDataLength = 0;
                 *freeAble = false;
         }
 }
 
-void getRealIndex (napi_env env, int64_t* metadata, napi_value source, int64_t* realIndex) {
-        int64_t length = metadata[1];
-        int64_t index;
+// Like getUTF16FromOutside, but the text of me itself is copied, because me may be reallocated before the data is used.
+void getUTF16ToAppend(napi_env env, napi_value me, napi_value source, uint16_t** sourceData, int64_t* sourceDataLength, bool* freeAble) {
+        getUTF16FromOutside(env, me, source, sourceData, sourceDataLength, freeAble);
+        bool isMe;
+        napi_strict_equals(env, source, me, &isMe);
+        if (isMe) {
+                uint16_t* data = (uint16_t*)allocateScratch(env, *sourceDataLength, freeAble);
+                memcpy(data, *sourceData, *sourceDataLength);
+                *sourceData = data;
+        }
+}
+
+// Like getUTF16FromOutside, but a string is copied into stackBuffer (which has stackBufferSize code units) instead of the scratch arena if it fits, and is not copied at all if requiredLength is not negative and the length of the string is different from it.
+void getUTF16FromOutsideForComparison(napi_env env, napi_value me, napi_value source, uint16_t* stackBuffer, int64_t requiredLength, uint16_t** sourceData, int64_t* sourceDataLength, bool* freeAble) {
+        napi_valuetype type;
+        napi_typeof(env, source, &type);
+        if (type != napi_string) {
+                getUTF16FromOutside(env, me, source, sourceData, sourceDataLength, freeAble);
+                return;
+        }
+        size_t sourceDataSize;
+        napi_get_value_string_utf16(env, source, NULL, 0, &sourceDataSize);
+        *sourceDataLength = sourceDataSize * 2;
+        *sourceData = stackBuffer;
+        *freeAble = false;
+        if (requiredLength >= 0 && *sourceDataLength != requiredLength) {
+                return;
+        }
+        ++sourceDataSize;
+        if (sourceDataSize > stackBufferSize) {
+                *sourceData = (uint16_t*)allocateScratch(env, sourceDataSize * 2, freeAble);
+        }
+        napi_get_value_string_utf16(env, source, *sourceData, sourceDataSize, &sourceDataSize);
+}
+
+void getRealIndex (napi_env env, int64_t* metadata, napi_value source, int64_t* realIndex) {
+        int64_t length = metadata[1];
+        int64_t index = 0;
         napi_get_value_int64(env, source, &index);
         int64_t halfLength = length / 2;
         if (index < 0) {
@@ -481,14 +1004,148 @@ void getRealIndex (napi_env env, int64_t* metadata, napi_value source, int64_t*
         *realIndex = index;
 };
 
-bool isTrimmable(uint16_t characterCode) {
-        return characterCode <= 32 || characterCode == 12288;
+// Extend the incremental CRC-32C over the text appended to the tail since the last update
+void updateIncrementalHash(uint16_t* buffer, int64_t* metadata) {
+        int64_t start = metadata[8] - metadata[3];
+        if (metadata[8] < 0 || start < 0) {
+                return;
+        }
+        metadata[7] = updateCRC32C((uint32_t)metadata[7], (uint8_t*)buffer + start, metadata[1] - start);
+        metadata[8] = metadata[3] + metadata[1];
+}
+
+// Get the CRC-32C of the whole text, turning on the incremental hashing, and catching up through the sealed segments without flattening them
+uint32_t getIncrementalHash(napi_env env, napi_value me, uint16_t* buffer, int64_t* metadata) {
+        if (metadata[8] < 0) {
+                metadata[7] = 0xFFFFFFFF;
+                metadata[8] = 0;
+        }
+        if (metadata[8] < metadata[3]) {
+                napi_value segments;
+                uint32_t i, segmentsLength;
+                int64_t offset = 0;
+                napi_get_element(env, me, 1, &segments);
+                napi_get_array_length(env, segments, &segmentsLength);
+                for (i = 0; i < segmentsLength; ++i) {
+                        napi_value segment;
+                        uint8_t* segmentRaw;
+                        napi_get_element(env, segments, i, &segment);
+                        napi_get_buffer_info(env, segment, (void**)(&segmentRaw), 0);
+                        int64_t segmentLength = ((int64_t*)segmentRaw)[1];
+                        if (metadata[8] < offset + segmentLength) {
+                                int64_t skip = metadata[8] - offset;
+                                metadata[7] = updateCRC32C((uint32_t)metadata[7], segmentRaw + headerSize + ((int64_t*)segmentRaw)[4] + skip, segmentLength - skip);
+                                metadata[8] = offset + segmentLength;
+                        }
+                        offset += segmentLength;
+                }
+        }
+        updateIncrementalHash(buffer, metadata);
+        return (uint32_t)metadata[7] ^ 0xFFFFFFFF;
+}
+
+// Element 2 of a StringBuilder is its line index, a buffer of int64_t: [0] capacity, [1] number of line starts, [2] length of the text (in bytes) scanned, followed by the indices of the line starts except the first line. It is brought up to date when it is read, by scanning only the text which has been appended or modified since then.
+int64_t* getLineIndex(napi_env env, napi_value me, uint16_t* buffer, int64_t* metadata) {
+        napi_value _index;
+        int64_t* index;
+        napi_get_element(env, me, 2, &_index);
+        if (napi_get_buffer_info(env, _index, (void**)(&index), 0) != napi_ok) {
+                napi_create_buffer(env, (3 + 64) * 8, (void**)(&index), &_index);
+                index[0] = 64;
+                index[1] = 0;
+                index[2] = 0;
+                napi_set_element(env, me, 2, _index);
+        }
+        if (metadata[9] < index[2]) {
+                // drop the line starts following a line feed at or after the modified position
+                int64_t low = 0, high = index[1];
+                while (low < high) {
+                        int64_t middle = (low + high) / 2;
+                        if (index[3 + middle] * 2 <= metadata[9]) {
+                                low = middle + 1;
+                        } else {
+                                high = middle;
+                        }
+                }
+                index[1] = low;
+                index[2] = metadata[9];
+        }
+        int64_t length = metadata[1];
+        if (index[2] < length) {
+                int64_t count = findCodeUnits(buffer, index[2] / 2, length / 2, 10, 0, NULL);
+                if (index[1] + count > index[0]) {
+                        int64_t newCapacity = max(index[0] * 2, index[1] + count);
+                        napi_value _newIndex;
+                        int64_t* newIndex;
+                        napi_create_buffer(env, (3 + newCapacity) * 8, (void**)(&newIndex), &_newIndex);
+                        memcpy(newIndex, index, (3 + index[1]) * 8);
+                        newIndex[0] = newCapacity;
+                        index = newIndex;
+                        napi_set_element(env, me, 2, _newIndex);
+                }
+                findCodeUnits(buffer, index[2] / 2, length / 2, 10, 0, index + 3 + index[1]);
+                index[1] += count;
+                index[2] = length;
+        }
+        // a clone sharing the header may have a line index which is not up to date
+        if (metadata[5] == 0) {
+                metadata[9] = length;
+        }
+        return index;
+}
+
+void dropLineIndex(napi_env env, napi_value me) {
+        napi_value undefined;
+        napi_get_undefined(env, &undefined);
+        napi_set_element(env, me, 2, undefined);
 }
 
-int64_t log2Floor(int64_t n) {
-        return (int64_t)floor(log2(n));
+// Get the line of the code unit at index, the number of line starts not after it
+int64_t lineOfIndex(int64_t* index, int64_t i) {
+        int64_t low = 0, high = index[1];
+        while (low < high) {
+                int64_t middle = (low + high) / 2;
+                if (index[3 + middle] <= i) {
+                        low = middle + 1;
+                } else {
+                        high = middle;
+                }
+        }
+        return low;
 }
 
+// Search a single code unit without building the Boyer-Moore tables, matches of one code unit never overlap so it serves both indexOf and indexOfSkip
+napi_value indexOfCodeUnit(napi_env env, uint16_t* source, int64_t sourceLength, uint16_t unit, int64_t offset, int64_t limit){
+        if (offset < 0 || offset >= sourceLength) {
+                return createEmptyArray(env);
+        }
+        if(limit <= 0) {
+                limit = 1000;
+        }
+
+        uint32_t* buffer;
+        napi_value arrayBuffer;
+        napi_create_arraybuffer(env, limit * 4, (void**)(&buffer), &arrayBuffer);
+
+        int64_t positions[64];
+        int64_t resultListLength = 0;
+        while (resultListLength < limit) {
+                int64_t want = limit - resultListLength;
+                int64_t count = findCodeUnits(source, offset, sourceLength, unit, want < 64 ? want : 64, positions);
+                int64_t i;
+                for (i = 0; i < count; ++i) {
+                        buffer[resultListLength++] = (uint32_t)(positions[i] - 1);
+                }
+                if (count < 64) {
+                        break;
+                }
+                offset = positions[count - 1];
+        }
+
+        napi_value resultList;
+        napi_create_typedarray(env, napi_uint32_array, resultListLength, arrayBuffer, 0, &resultList);
+        return resultList;
+}
 
 // TODO -----Getters-----
 
@@ -502,7 +1159,7 @@ napi_value Length(napi_env env, napi_callback_info info){
         getMetaData(env, me, &metadata);
 
         napi_value result;
-        napi_create_int64(env, metadata[1] / 2, &result);
+        napi_create_int64(env, (metadata[1] + metadata[3]) / 2, &result);
         return result;
 };
 
@@ -516,7 +1173,7 @@ napi_value Capacity(napi_env env, napi_callback_info info){
         getMetaData(env, me, &metadata);
 
         napi_value result;
-        napi_create_int64(env, metadata[0] / 2, &result);
+        napi_create_int64(env, (metadata[0] + metadata[3]) / 2, &result);
         return result;
 };
 
@@ -533,40 +1190,45 @@ napi_value Replace(napi_env env, napi_callback_info info){
                 return me;
         }
 
+        // convert the content before taking the buffer, because its toString may clone, view or modify me
+        uint16_t* contentBuffer;
+        int64_t contentBufferLength;
+        bool freeAble;
+        getUTF16ToAppend(env, me, args[argsLength < 3 ? argsLength - 1 : 2], &contentBuffer, &contentBufferLength, &freeAble);
+
         uint16_t* buffer;
         int64_t* metadata;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t start, end, length = metadata[1];
-        napi_value content;
         switch(argsLength) {
         case 1:
                 start = 0;
                 end = length;
-                content = args[0];
                 break;
         case 2:
                 getRealIndex(env, metadata, args[0], &start);
                 end = length;
-                content = args[1];
                 break;
         default:
                 getRealIndex(env, metadata, args[0], &start);
                 getRealIndex(env, metadata, args[1], &end);
-                content = args[2];
         }
-        uint16_t* contentBuffer;
-        int64_t contentBufferLength;
-        bool freeAble;
-        getUTF16FromOutside(env, content, &contentBuffer, &contentBufferLength, &freeAble);
+        markTextModified(metadata, start);
         int64_t replaceLength = end - start;
         int64_t concatLength = length + contentBufferLength - replaceLength;
-        reAlloc(env, me, &buffer, &metadata, concatLength);
+        if (!reAlloc(env, me, &buffer, &metadata, concatLength)) {
+                if(freeAble) {
+                        free(contentBuffer);
+                }
+                return 0;
+        }
         if (end == length || contentBufferLength == replaceLength) {
                 memcpy(buffer + (start / 2), contentBuffer, contentBufferLength);
         }else{
                 memmove(buffer + ((start + contentBufferLength) / 2), buffer + (end / 2), length - end);
+                countStat(env, me, statBytesMoved, length - end);
                 memcpy(buffer + (start / 2), contentBuffer, contentBufferLength);
         }
         metadata[1] = concatLength;
@@ -587,32 +1249,36 @@ napi_value Insert(napi_env env, napi_callback_info info){
                 return me;
         }
 
+        // convert the content before taking the buffer, because its toString may clone, view or modify me
+        uint16_t* contentBuffer;
+        int64_t contentBufferLength;
+        bool freeAble;
+        getUTF16ToAppend(env, me, args[argsLength == 1 ? 0 : 1], &contentBuffer, &contentBufferLength, &freeAble);
+
         uint16_t* buffer;
         int64_t* metadata;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t offset, length = metadata[1];
-        napi_value content;
-        switch(argsLength) {
-        case 1:
+        if (argsLength == 1) {
                 offset = 0;
-                content = args[0];
-                break;
-        default:
+        } else {
                 getRealIndex(env, metadata, args[0], &offset);
-                content = args[1];
         }
-        uint16_t* contentBuffer;
-        int64_t contentBufferLength;
-        bool freeAble;
-        getUTF16FromOutside(env, content, &contentBuffer, &contentBufferLength, &freeAble);
+        markTextModified(metadata, offset);
         int64_t concatLength = length + contentBufferLength;
-        reAlloc(env, me, &buffer, &metadata, concatLength);
+        if (!reAlloc(env, me, &buffer, &metadata, concatLength)) {
+                if(freeAble) {
+                        free(contentBuffer);
+                }
+                return 0;
+        }
         if (offset == length) {
                 memcpy(buffer + (offset / 2), contentBuffer, contentBufferLength);
         }else{
                 memmove(buffer + ((offset + contentBufferLength) / 2), buffer + (offset / 2), length - offset);
+                countStat(env, me, statBytesMoved, length - offset);
                 memcpy(buffer + (offset / 2), contentBuffer, contentBufferLength);
         }
         metadata[1] = concatLength;
@@ -626,10 +1292,82 @@ napi_value Clear(napi_env env, napi_callback_info info){
         napi_value me;
         napi_get_cb_info(env, info, 0, 0, &me, 0);
 
+        uint16_t* buffer;
         int64_t* metadata;
 
-        getMetaData(env, me, &metadata);
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
+        unshareBuffer(env, me, &buffer, &metadata, 0);
+        ++metadata[6];
+        markTextModified(metadata, 0);
+        metadata[0] += metadata[4];
+        metadata[1] = 0;
+        metadata[4] = 0;
+        ++metadata[11];
+        if (metadata[3] > 0) {
+                dropSegments(env, me, metadata);
+        }
+        return me;
+}
+
+napi_value Reset(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        // undefined, null, NaN and Infinity do not limit the capacity
+        double maxCapacity = INFINITY;
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                if (type == napi_number) {
+                        napi_get_value_double(env, args[0], &maxCapacity);
+                        if (maxCapacity < 0) {
+                                napi_throw_range_error(env, 0, "The maxCapacity has to be a non-negative number");
+                                return 0;
+                        }
+                } else if (type != napi_undefined && type != napi_null) {
+                        napi_throw_type_error(env, 0, "The maxCapacity has to be a number");
+                        return 0;
+                }
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
+        unshareBuffer(env, me, &buffer, &metadata, 0);
+        ++metadata[6];
+        metadata[0] += metadata[4];
         metadata[1] = 0;
+        metadata[2] = 0;
+        metadata[8] = -1;
+        metadata[9] = 0;
+        metadata[4] = 0;
+        ++metadata[11];
+        if (metadata[3] > 0) {
+                dropSegments(env, me, metadata);
+        }
+        dropLineIndex(env, me);
+        if (isfinite(maxCapacity) && maxCapacity * 2 < metadata[0]) {
+                int64_t count = ((int64_t)maxCapacity * 2 + blockSize - 1) / blockSize;
+                if (count == 0) {
+                        count = 1;
+                }
+                int64_t newCapacity = count * blockSize;
+                if (newCapacity < metadata[0]) {
+                        napi_value _raw;
+                        uint8_t* raw;
+                        if (!createStorage(env, newCapacity, &raw, &_raw)) {
+                                return 0;
+                        }
+                        memcpy(raw, metadata, headerSize);
+                        ((int64_t*)raw)[0] = newCapacity;
+                        ++((int64_t*)raw)[11];
+                        napi_set_element(env, me, 0, _raw);
+                }
+        }
         return me;
 }
 
@@ -647,7 +1385,7 @@ napi_value Delete(napi_env env, napi_callback_info info){
         uint16_t* buffer;
         int64_t* metadata;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t start, end, length = metadata[1];
         switch(argsLength) {
@@ -662,10 +1400,12 @@ napi_value Delete(napi_env env, napi_callback_info info){
         if (start >= end) {
                 return me;
         }
+        markTextModified(metadata, start);
         if (end == length) {
                 metadata[1] = start;
         } else {
                 memmove(buffer + (start / 2), buffer + (end / 2), length - end);
+                countStat(env, me, statBytesMoved, length - end);
                 metadata[1] = length - (end - start);
         }
         return me;
@@ -685,16 +1425,18 @@ napi_value DeleteCharAt(napi_env env, napi_callback_info info){
         uint16_t* buffer;
         int64_t* metadata;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t index, length = metadata[1];
         getRealIndex(env, metadata, args[0], &index);
         if (index == length) {
                 return me;
         }
+        markTextModified(metadata, index);
         metadata[1] -= 2;
         if (index != length - 1) {
                 memmove(buffer + (index / 2), buffer + ((index + 2) / 2), length - index - 1);
+                countStat(env, me, statBytesMoved, length - index - 2);
         }
         return me;
 }
@@ -709,7 +1451,7 @@ napi_value Substring(napi_env env, napi_callback_info info){
         uint16_t* buffer;
         int64_t* metadata;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t start, end;
         switch(argsLength) {
@@ -728,6 +1470,7 @@ napi_value Substring(napi_env env, napi_callback_info info){
                 break;
         }
         }
+        markTextModified(metadata, start == 0 ? end : 0);
         if (start >= end) {
                 metadata[1] = 0;
                 return me;
@@ -737,6 +1480,7 @@ napi_value Substring(napi_env env, napi_callback_info info){
         } else {
                 metadata[1] = end - start;
                 memmove(buffer, buffer + (start / 2), metadata[1]);
+                countStat(env, me, statBytesMoved, metadata[1]);
         }
         return me;
 }
@@ -751,7 +1495,7 @@ napi_value Substr(napi_env env, napi_callback_info info){
         uint16_t* buffer;
         int64_t* metadata;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t start, length;
         switch(argsLength) {
@@ -771,14 +1515,17 @@ napi_value Substr(napi_env env, napi_callback_info info){
         }
         }
         if (length <= 0) {
+                markTextModified(metadata, 0);
                 metadata[1] = 0;
                 return me;
         }else if(start + length > metadata[1]) {
                 length = metadata[1] - start;
         }
+        markTextModified(metadata, start == 0 ? length : 0);
         metadata[1] = length;
         if (start > 0) {
                 memmove(buffer, buffer + (start / 2), length);
+                countStat(env, me, statBytesMoved, length);
         }
         return me;
 }
@@ -796,10 +1543,11 @@ napi_value Append(napi_env env, napi_callback_info info){
 
         uint16_t* buffer;
         int64_t* metadata;
-
-        getBufferAndMetaData(env, me, &buffer, &metadata);
-
-        return appendUTF16FromOutside(env, me, args[0], &buffer, &metadata);
+        if (!appendUTF16FromOutside(env, me, args[0], &buffer, &metadata)) {
+                return 0;
+        }
+        updateIncrementalHash(buffer, metadata);
+        return me;
 }
 
 napi_value AppendRepeat(napi_env env, napi_callback_info info){
@@ -813,11 +1561,6 @@ napi_value AppendRepeat(napi_env env, napi_callback_info info){
                 return me;
         }
 
-        uint16_t* buffer;
-        int64_t* metadata;
-
-        getBufferAndMetaData(env, me, &buffer, &metadata);
-
         int64_t repeatCount;
         switch(argsLength) {
         case 1:
@@ -834,11 +1577,19 @@ napi_value AppendRepeat(napi_env env, napi_callback_info info){
         uint16_t* contentBuffer;
         int64_t contentBufferLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &contentBuffer, &contentBufferLength, &freeAble);
+        getUTF16FromOutside(env, me, args[0], &contentBuffer, &contentBufferLength, &freeAble);
+
+        uint16_t* buffer;
+        int64_t* metadata;
 
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (contentBufferLength == 0 || !reAllocForAppend(env, me, &buffer, &metadata, multiplySizes(contentBufferLength, repeatCount))) {
+                if(freeAble) {
+                        free(contentBuffer);
+                }
+                return contentBufferLength == 0 ? me : 0;
+        }
         int64_t length = metadata[1];
-        int64_t concatLength = length + (contentBufferLength * repeatCount);
-        reAlloc(env, me, &buffer, &metadata, concatLength);
 
         // log2 copy
         int64_t log2Count = log2Floor(repeatCount);
@@ -857,6 +1608,7 @@ napi_value AppendRepeat(napi_env env, napi_callback_info info){
                 length += contentBufferLength;
         }
         metadata[1] = length;
+        updateIncrementalHash(buffer, metadata);
         if(freeAble) {
                 free(contentBuffer);
         }
@@ -872,149 +1624,1008 @@ napi_value AppendLine(napi_env env, napi_callback_info info){
 
         uint16_t* buffer;
         int64_t* metadata;
-        getBufferAndMetaData(env, me, &buffer, &metadata);
-
-        if(argsLength > 0) {
-                appendUTF16FromOutside(env, me, args[0], &buffer, &metadata);
+        if (argsLength == 0) {
+                getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        } else if (!appendUTF16FromOutside(env, me, args[0], &buffer, &metadata)) {
+                return 0;
         }
-        if(metadata[0] == metadata[1]) {
-                reAlloc(env, me, &buffer, &metadata, metadata[0] + 2);
+        if (!reAllocForAppend(env, me, &buffer, &metadata, 2)) {
+                return 0;
         }
         buffer[metadata[1] / 2] = 10;
         metadata[1] += 2;
+        updateIncrementalHash(buffer, metadata);
         return me;
 }
 
-napi_value Reverse(napi_env env, napi_callback_info info){
-        napi_value me;
-        napi_get_cb_info(env, info, 0, 0, &me, 0);
+// A compiled template is an instance of StringBuilderTemplate. Element 0 is a buffer of int64 values: [0] the number of slots n, [1] the total length of the literals, then the start and the length of the n + 1 literals, followed by the literals in UTF-16. Element 1 is the array of the slot names.
+napi_value CompileTemplate(napi_env env, napi_callback_info info){
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, 0, 0);
 
-        uint16_t* buffer;
-        int64_t* metadata;
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        uint16_t* source = 0;
+        int64_t sourceLength = 0;
+        bool freeAble = false;
+        if (argsLength > 0) {
+                getUTF16FromOutside(env, NULL, args[0], &source, &sourceLength, &freeAble);
+        }
+        sourceLength /= 2;
+
+        bool literalsFreeAble, tableFreeAble;
+        uint16_t* literals = (uint16_t*)allocateScratch(env, sourceLength * 2 + 2, &literalsFreeAble);
+        int64_t* table = (int64_t*)allocateScratch(env, (sourceLength / 3 + 1) * 2 * 8, &tableFreeAble);
+        napi_value names;
+        napi_create_array(env, &names);
+
+        int64_t literalsLength = 0, literalStart = 0, slotCount = 0, i = 0;
+        while (i < sourceLength) {
+                uint16_t c = source[i];
+                if (c == '\\' && i + 2 < sourceLength && source[i + 1] == '$' && source[i + 2] == '{') {
+                        // \${ is a literal ${
+                        literals[literalsLength++] = '$';
+                        literals[literalsLength++] = '{';
+                        i += 3;
+                        continue;
+                }
+                if (c == '$' && i + 1 < sourceLength && source[i + 1] == '{') {
+                        int64_t nameStart = i + 2, nameEnd = nameStart;
+                        while (nameEnd < sourceLength && source[nameEnd] != '}') {
+                                ++nameEnd;
+                        }
+                        int64_t slotEnd = nameEnd;
+                        while (nameStart < nameEnd && isWhiteSpace(source[nameStart])) {
+                                ++nameStart;
+                        }
+                        while (nameEnd > nameStart && isWhiteSpace(source[nameEnd - 1])) {
+                                --nameEnd;
+                        }
+                        if (slotEnd == sourceLength || nameStart == nameEnd) {
+                                napi_throw_error(env, 0, "Every ${ in the template has to be closed by } with a name inside");
+                                if (freeAble) {
+                                        free(source);
+                                }
+                                if (literalsFreeAble) {
+                                        free(literals);
+                                }
+                                if (tableFreeAble) {
+                                        free(table);
+                                }
+                                return 0;
+                        }
+                        napi_value name;
+                        napi_create_string_utf16(env, source + nameStart, nameEnd - nameStart, &name);
+                        napi_set_element(env, names, slotCount, name);
+                        table[slotCount * 2] = literalStart;
+                        table[slotCount * 2 + 1] = literalsLength - literalStart;
+                        ++slotCount;
+                        literalStart = literalsLength;
+                        i = slotEnd + 1;
+                        continue;
+                }
+                literals[literalsLength++] = c;
+                ++i;
+        }
+        table[slotCount * 2] = literalStart;
+        table[slotCount * 2 + 1] = literalsLength - literalStart;
 
-        reAlloc(env, me, &buffer, &metadata, metadata[1] * 2);
-        int64_t length_div_2 = metadata[1] / 2;
-        int64_t i, capacity_dec_2_div_2 = (metadata[0] - 2) / 2;
-        for (i = 0; i < length_div_2; ++i) {
-                memmove(buffer + capacity_dec_2_div_2 - i, buffer + i, 2);
+        napi_value StringBuilderTemplate;
+        napi_get_reference_value(env, StringBuilderTemplateRef, &StringBuilderTemplate);
+        napi_value result;
+        napi_new_instance(env, StringBuilderTemplate, 0, 0, &result);
+
+        napi_value _compiled;
+        int64_t* compiled;
+        int64_t tableSize = (2 + (slotCount + 1) * 2) * 8;
+        napi_create_buffer(env, tableSize + literalsLength * 2, (void**)(&compiled), &_compiled);
+        compiled[0] = slotCount;
+        compiled[1] = literalsLength;
+        memcpy(compiled + 2, table, (slotCount + 1) * 2 * 8);
+        memcpy((uint8_t*)compiled + tableSize, literals, literalsLength * 2);
+        napi_set_element(env, result, 0, _compiled);
+        napi_set_element(env, result, 1, names);
+
+        if (freeAble) {
+                free(source);
         }
-        memmove(buffer, buffer + ((metadata[0] - metadata[1]) / 2), metadata[1]);
-        return me;
+        if (literalsFreeAble) {
+                free(literals);
+        }
+        if (tableFreeAble) {
+                free(table);
+        }
+        return result;
 }
 
-napi_value UpperCase(napi_env env, napi_callback_info info){
+napi_value templateConstructor(napi_env env, napi_callback_info info){
         napi_value me;
         napi_get_cb_info(env, info, 0, 0, &me, 0);
-
-        uint16_t* buffer;
-        int64_t* metadata;
-        getBufferAndMetaData(env, me, &buffer, &metadata);
-
-        int64_t i, length = metadata[1] / 2;
-        for (i = 0; i < length; i++) {
-                uint16_t v = buffer[i];
-                if (v >= 97 && v <= 122) {
-                        buffer[i] -= 32;
-                }
-        }
         return me;
 }
 
-napi_value LowerCase(napi_env env, napi_callback_info info){
+typedef struct {
+        napi_value string;
+        uint16_t* data;
+        int64_t length;
+        bool freeAble;
+} TemplateValue;
+
+napi_value AppendTemplate(napi_env env, napi_callback_info info){
         napi_value me;
-        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        bool isTemplate = false;
+        if (argsLength > 0) {
+                napi_value StringBuilderTemplate;
+                napi_get_reference_value(env, StringBuilderTemplateRef, &StringBuilderTemplate);
+                napi_instanceof(env, args[0], StringBuilderTemplate, &isTemplate);
+        }
+        if (!isTemplate) {
+                napi_throw_type_error(env, 0, "The template has to be compiled by StringBuilder.compileTemplate");
+                return 0;
+        }
+
+        napi_value _compiled, names;
+        int64_t* compiled;
+        napi_get_element(env, args[0], 0, &_compiled);
+        napi_get_element(env, args[0], 1, &names);
+        napi_get_buffer_info(env, _compiled, (void**)(&compiled), 0);
+        int64_t slotCount = compiled[0];
+
+        napi_valuetype valuesType = napi_undefined;
+        if (argsLength > 1) {
+                napi_typeof(env, args[1], &valuesType);
+        }
+
+        // measure every value first, undefined and null are rendered as nothing
+        bool valuesFreeAble;
+        TemplateValue* values = (TemplateValue*)allocateScratch(env, slotCount * sizeof(TemplateValue) + 1, &valuesFreeAble);
+        int64_t totalLength = compiled[1];
+        int64_t i;
+        for (i = 0; i < slotCount; ++i) {
+                TemplateValue* value = values + i;
+                value->string = 0;
+                value->data = 0;
+                value->length = 0;
+                value->freeAble = false;
+                if (valuesType != napi_object && valuesType != napi_function) {
+                        continue;
+                }
+                napi_value name, v;
+                napi_get_element(env, names, i, &name);
+                napi_get_property(env, args[1], name, &v);
+                napi_valuetype type;
+                napi_typeof(env, v, &type);
+                if (type == napi_undefined || type == napi_null) {
+                        continue;
+                }
+                if (type == napi_string) {
+                        size_t length;
+                        napi_get_value_string_utf16(env, v, NULL, 0, &length);
+                        value->string = v;
+                        value->length = length;
+                } else {
+                        getUTF16ToAppend(env, me, v, &value->data, &value->length, &value->freeAble);
+                        value->length /= 2;
+                }
+                totalLength += value->length;
+        }
 
         uint16_t* buffer;
         int64_t* metadata;
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        // N-API writes a terminator after a string, like in appendString. Without room for it, a string at the end is copied through a temporary buffer.
+        bool tight = false;
+        bool reserved = reAllocForAppend(env, me, &buffer, &metadata, totalLength * 2 + 2);
+        if (!reserved) {
+                napi_value error;
+                napi_get_and_clear_last_exception(env, &error);
+                reserved = tight = reAllocForAppend(env, me, &buffer, &metadata, totalLength * 2);
+        }
+        if (!reserved) {
+                for (i = 0; i < slotCount; ++i) {
+                        if (values[i].freeAble) {
+                                free(values[i].data);
+                        }
+                }
+                if (valuesFreeAble) {
+                        free(values);
+                }
+                return 0;
+        }
 
-        int64_t i, length = metadata[1] / 2;
-        for (i = 0; i < length; i++) {
-                uint16_t v = buffer[i];
-                if (v >= 65 && v <= 90) {
-                        buffer[i] += 32;
+        uint16_t* output = buffer + metadata[1] / 2;
+        uint16_t* end = output + totalLength;
+        uint16_t* literals = (uint16_t*)(compiled + 2 + (slotCount + 1) * 2);
+        for (i = 0; i <= slotCount; ++i) {
+                int64_t literalLength = compiled[3 + i * 2];
+                memcpy(output, literals + compiled[2 + i * 2], literalLength * 2);
+                output += literalLength;
+                if (i == slotCount) {
+                        break;
+                }
+                TemplateValue* value = values + i;
+                if (value->string && tight && output + value->length == end) {
+                        uint16_t* temporary = (uint16_t*)malloc(value->length * 2 + 2);
+                        napi_get_value_string_utf16(env, value->string, temporary, value->length + 1, 0);
+                        memcpy(output, temporary, value->length * 2);
+                        free(temporary);
+                } else if (value->string) {
+                        napi_get_value_string_utf16(env, value->string, output, value->length + 1, 0);
+                } else if (value->length > 0) {
+                        memcpy(output, value->data, value->length * 2);
                 }
+                if (value->freeAble) {
+                        free(value->data);
+                }
+                output += value->length;
+        }
+        metadata[1] += totalLength * 2;
+        updateIncrementalHash(buffer, metadata);
+
+        if (valuesFreeAble) {
+                free(values);
         }
         return me;
 }
 
-napi_value ReplacePattern(napi_env env, napi_callback_info info){
-        size_t argsLength = 4;
-        napi_value args[4];
-
+napi_value appendEscaped(napi_env env, napi_callback_info info, int kind){
         napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
         napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
-        if(argsLength < 2) {
+        if(argsLength == 0) {
                 return me;
         }
 
-        uint16_t* buffer;
-        int64_t* metadata;
+        uint16_t* data;
+        int64_t length;
+        bool freeAble;
+        getUTF16ToAppend(env, me, args[0], &data, &length, &freeAble);
+        length /= 2;
 
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        // a CSV field is quoted only if it contains a comma, a quote or a line break
+        bool quoted = kind == escapeCSV && findEscape(data, 0, length, kind) < length;
+        int64_t escapedLength = escapeText(data, length, kind, NULL) + (quoted ? 2 : 0);
 
-        uint16_t* pattern;
-        int64_t patternLength;
-        bool patternFreeAble;
-        int64_t offset, limit;
-        switch(argsLength) {
-        case 2: {
-                offset = 0;
-                limit = 1;
-                break;
-        }
-        case 3: {
-                getRealIndex(env, metadata, args[2], &offset);
-                limit = 1;
-                break;
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (!reAllocForAppend(env, me, &buffer, &metadata, escapedLength * 2)) {
+                if(freeAble) {
+                        free(data);
+                }
+                return 0;
         }
-        default: {
-                getRealIndex(env, metadata, args[2], &offset);
-                getRealIndex(env, metadata, args[3], &limit);
-                break;
+        uint16_t* output = buffer + metadata[1] / 2;
+        if (quoted) {
+                output[0] = '"';
+                escapeText(data, length, kind, output + 1);
+                output[escapedLength - 1] = '"';
+        } else {
+                escapeText(data, length, kind, output);
         }
+        metadata[1] += escapedLength * 2;
+        updateIncrementalHash(buffer, metadata);
+
+        if(freeAble) {
+                free(data);
         }
+        return me;
+}
 
-        getUTF16FromOutside(env, args[0], &pattern, &patternLength, &patternFreeAble);
+napi_value AppendHtmlEscaped(napi_env env, napi_callback_info info){
+        return appendEscaped(env, info, escapeHTML);
+}
 
-        int64_t* resultList;
-        int64_t resultListLength;
-        boyerMooreMagicLenSkipPure(buffer, metadata[1] / 2, pattern, patternLength / 2, offset, limit, &resultList, &resultListLength);
-        if (resultListLength <= 0) {
-                if(resultListLength == 0) {
-                        free(resultList);
-                }
-                if(patternFreeAble) {
-                        free(pattern);
-                }
-                return me;
-        }
+napi_value AppendJsonEscaped(napi_env env, napi_callback_info info){
+        return appendEscaped(env, info, escapeJSON);
+}
 
+napi_value AppendCsvField(napi_env env, napi_callback_info info){
+        return appendEscaped(env, info, escapeCSV);
+}
+
+napi_value AppendUrlEncoded(napi_env env, napi_callback_info info){
+        return appendEscaped(env, info, escapeURL);
+}
+
+#define maxJSONDepth 4096
+
+// The state of appendJSON. The JSON text is written piece by piece into a private buffer and appended at once, because toJSON, getters and proxies may run any code on the StringBuilder (even append to it or clone it) while it is being written.
+typedef struct {
+        napi_env env;
+        napi_value me;
+        // the JSON text in code units
+        uint16_t* text;
+        int64_t length;
+        int64_t capacity;
+        uint16_t indent[11];
+        size_t indentLength;
+        // the objects being serialized, for the cycle detection
+        napi_value* stack;
+        int64_t depth;
+        int64_t stackCapacity;
+        napi_value toJSON, Number, String, Boolean, BigInt, Array, ObjectPrototype, ArrayPrototype, keys, isArray;
+} JSONWriter;
+
+uint16_t* reserveJSON(JSONWriter* writer, int64_t length) {
+        if (writer->capacity - writer->length < length) {
+                // grow geometrically, because the text is written in many small pieces
+                int64_t capacity = max(writer->length + length, writer->capacity * 2 + 256);
+                uint16_t* buffer;
+                int64_t* metadata;
+                getTailBufferAndMetaData(writer->env, writer->me, &buffer, &metadata);
+                if (writer->length + length > getMaxCapacity(writer->env, metadata) / 2) {
+                        throwCapacityError(writer->env);
+                        return NULL;
+                }
+                uint16_t* text = (uint16_t*)realloc(writer->text, capacity * 2);
+                if (text == NULL) {
+                        napi_throw_range_error(writer->env, capacityErrorCode, "The buffer of the StringBuilder cannot be allocated");
+                        return NULL;
+                }
+                writer->text = text;
+                writer->capacity = capacity;
+        }
+        return writer->text + writer->length;
+}
+
+bool writeJSONASCII(JSONWriter* writer, const char* text) {
+        int64_t length = strlen(text), i;
+        uint16_t* output = reserveJSON(writer, length);
+        if (!output) {
+                return false;
+        }
+        for (i = 0; i < length; ++i) {
+                output[i] = text[i];
+        }
+        writer->length += length;
+        return true;
+}
+
+bool writeJSONIndent(JSONWriter* writer, int64_t depth) {
+        uint16_t* output = reserveJSON(writer, 1 + writer->indentLength * depth);
+        if (!output) {
+                return false;
+        }
+        int64_t i;
+        *output++ = '\n';
+        for (i = 0; i < depth; ++i) {
+                memcpy(output, writer->indent, writer->indentLength * 2);
+                output += writer->indentLength;
+        }
+        writer->length += 1 + writer->indentLength * depth;
+        return true;
+}
+
+bool writeJSONString(JSONWriter* writer, napi_value string) {
+        napi_env env = writer->env;
+        size_t length;
+        napi_get_value_string_utf16(env, string, NULL, 0, &length);
+        // copy the string straight into the buffer, and only escape the rest from the first character which needs escaping
+        uint16_t* output = reserveJSON(writer, length + 3);
+        if (!output) {
+                return false;
+        }
+        output[0] = '"';
+        napi_get_value_string_utf16(env, string, output + 1, length + 1, 0);
+        int64_t first = findEscape(output + 1, 0, length, escapeJSON);
+        if (first == (int64_t)length) {
+                output[length + 1] = '"';
+                writer->length += length + 2;
+                return true;
+        }
+        writer->length += first + 1;
+        ScratchArena* arena = getScratchArena(env);
+        size_t mark = arena->used;
+        int64_t restLength = length - first;
+        bool freeAble;
+        uint16_t* rest = (uint16_t*)allocateScratch(env, restLength * 2, &freeAble);
+        memcpy(rest, output + 1 + first, restLength * 2);
+        int64_t escapedLength = escapeText(rest, restLength, escapeJSON, NULL);
+        output = reserveJSON(writer, escapedLength + 1);
+        if (output) {
+                escapeText(rest, restLength, escapeJSON, output);
+                output[escapedLength] = '"';
+                writer->length += escapedLength + 1;
+        }
+        if (freeAble) {
+                free(rest);
+        }
+        arena->used = mark;
+        return output != NULL;
+}
+
+// Call toJSON and unwrap Number, String and Boolean objects like JSON.stringify. Return false if an exception is pending.
+bool resolveJSONValue(JSONWriter* writer, napi_value key, uint32_t index, napi_value* value, napi_valuetype* type) {
+        napi_env env = writer->env;
+        napi_typeof(env, *value, type);
+        if (*type == napi_object || *type == napi_function || *type == napi_bigint) {
+                napi_value toJSON;
+                napi_valuetype toJSONType;
+                if (napi_get_property(env, *value, writer->toJSON, &toJSON) != napi_ok) {
+                        return false;
+                }
+                napi_typeof(env, toJSON, &toJSONType);
+                if (toJSONType == napi_function) {
+                        if (!key) {
+                                napi_value number;
+                                napi_create_uint32(env, index, &number);
+                                napi_coerce_to_string(env, number, &key);
+                        }
+                        if (napi_call_function(env, *value, toJSON, 1, &key, value) != napi_ok) {
+                                return false;
+                        }
+                        napi_typeof(env, *value, type);
+                }
+        }
+        if (*type == napi_object) {
+                // plain objects and arrays are not wrappers of primitives
+                napi_value prototype;
+                bool isPlain, isArray;
+                napi_get_prototype(env, *value, &prototype);
+                napi_strict_equals(env, prototype, writer->ObjectPrototype, &isPlain);
+                napi_strict_equals(env, prototype, writer->ArrayPrototype, &isArray);
+                if (isPlain || isArray) {
+                        return true;
+                }
+                bool isNumber, isString, isBoolean, isBigInt;
+                napi_instanceof(env, *value, writer->Number, &isNumber);
+                napi_instanceof(env, *value, writer->String, &isString);
+                napi_instanceof(env, *value, writer->Boolean, &isBoolean);
+                napi_instanceof(env, *value, writer->BigInt, &isBigInt);
+                napi_status status = napi_ok;
+                if (isBigInt) {
+                        napi_throw_type_error(env, 0, "Do not know how to serialize a BigInt");
+                        return false;
+                } else if (isNumber) {
+                        status = napi_coerce_to_number(env, *value, value);
+                } else if (isString) {
+                        status = napi_coerce_to_string(env, *value, value);
+                } else if (isBoolean) {
+                        napi_value valueOf;
+                        napi_get_named_property(env, *value, "valueOf", &valueOf);
+                        status = napi_call_function(env, *value, valueOf, 0, 0, value);
+                }
+                if (status != napi_ok) {
+                        return false;
+                }
+                napi_typeof(env, *value, type);
+        }
+        return true;
+}
+
+bool writeJSONValue(JSONWriter* writer, napi_value value, napi_valuetype type);
+
+bool writeJSONArray(JSONWriter* writer, napi_value array) {
+        napi_env env = writer->env;
+        uint32_t length, i;
+        if (napi_get_array_length(env, array, &length) != napi_ok) {
+                // a Proxy of an array
+                napi_value _length;
+                if (napi_get_named_property(env, array, "length", &_length) != napi_ok) {
+                        return false;
+                }
+                length = 0;
+                napi_get_value_uint32(env, _length, &length);
+        }
+        if (!writeJSONASCII(writer, "[")) {
+                return false;
+        }
+        for (i = 0; i < length; ++i) {
+                if (i > 0 && !writeJSONASCII(writer, ",")) {
+                        return false;
+                }
+                if (writer->indentLength > 0 && !writeJSONIndent(writer, writer->depth)) {
+                        return false;
+                }
+                napi_value element;
+                napi_valuetype type;
+                bool ok = napi_get_element(env, array, i, &element) == napi_ok && resolveJSONValue(writer, 0, i, &element, &type);
+                if (ok) {
+                        if (type == napi_undefined || type == napi_function || type == napi_symbol) {
+                                ok = writeJSONASCII(writer, "null");
+                        } else {
+                                ok = writeJSONValue(writer, element, type);
+                        }
+                }
+                if (!ok) {
+                        return false;
+                }
+        }
+        if (length > 0 && writer->indentLength > 0 && !writeJSONIndent(writer, writer->depth - 1)) {
+                return false;
+        }
+        return writeJSONASCII(writer, "]");
+}
+
+bool writeJSONProperties(JSONWriter* writer, napi_value object) {
+        napi_env env = writer->env;
+        napi_value keys;
+        // Object.keys gives the same keys in the same order as napi_get_all_property_names, but it is faster because V8 caches them
+        if (napi_call_function(env, object, writer->keys, 1, &object, &keys) != napi_ok) {
+                return false;
+        }
+        uint32_t count, i;
+        napi_get_array_length(env, keys, &count);
+        if (!writeJSONASCII(writer, "{")) {
+                return false;
+        }
+        bool empty = true;
+        for (i = 0; i < count; ++i) {
+                napi_value key, value;
+                napi_valuetype type;
+                napi_get_element(env, keys, i, &key);
+                bool ok = napi_get_property(env, object, key, &value) == napi_ok && resolveJSONValue(writer, key, 0, &value, &type);
+                if (ok && type != napi_undefined && type != napi_function && type != napi_symbol) {
+                        ok = (empty || writeJSONASCII(writer, ",")) && (writer->indentLength == 0 || writeJSONIndent(writer, writer->depth)) && writeJSONString(writer, key) && writeJSONASCII(writer, writer->indentLength > 0 ? ": " : ":") && writeJSONValue(writer, value, type);
+                        empty = false;
+                }
+                if (!ok) {
+                        return false;
+                }
+        }
+        if (!empty && writer->indentLength > 0 && !writeJSONIndent(writer, writer->depth - 1)) {
+                return false;
+        }
+        return writeJSONASCII(writer, "}");
+}
+
+bool writeJSONValue(JSONWriter* writer, napi_value value, napi_valuetype type) {
+        napi_env env = writer->env;
+        switch (type) {
+        case napi_null:
+                return writeJSONASCII(writer, "null");
+        case napi_boolean:
+        case napi_number: {
+                uint16_t text[24];
+                int64_t length = formatPrimitive(env, value, type, text);
+                if (length >= 0) {
+                        uint16_t* output = reserveJSON(writer, length);
+                        if (!output) {
+                                return false;
+                        }
+                        memcpy(output, text, length * 2);
+                        writer->length += length;
+                        return true;
+                }
+                double number;
+                napi_get_value_double(env, value, &number);
+                if (!isfinite(number)) {
+                        return writeJSONASCII(writer, "null");
+                }
+                // only integers are formatted natively, V8 gives the shortest representation of the others
+                napi_value string;
+                size_t stringLength;
+                napi_coerce_to_string(env, value, &string);
+                napi_get_value_string_utf16(env, string, NULL, 0, &stringLength);
+                uint16_t* output = reserveJSON(writer, stringLength + 1);
+                if (!output) {
+                        return false;
+                }
+                napi_get_value_string_utf16(env, string, output, stringLength + 1, 0);
+                writer->length += stringLength;
+                return true;
+        }
+        case napi_string:
+                return writeJSONString(writer, value);
+        case napi_bigint:
+                napi_throw_type_error(env, 0, "Do not know how to serialize a BigInt");
+                return false;
+        default:
+                break;
+        }
+        int64_t i;
+        for (i = 0; i < writer->depth; ++i) {
+                bool same;
+                napi_strict_equals(env, writer->stack[i], value, &same);
+                if (same) {
+                        napi_throw_type_error(env, 0, "Converting circular structure to JSON");
+                        return false;
+                }
+        }
+        if (writer->depth == maxJSONDepth) {
+                napi_throw_range_error(env, 0, "The value is nested too deeply to be serialized");
+                return false;
+        }
+        if (writer->depth == writer->stackCapacity) {
+                writer->stackCapacity = writer->stackCapacity * 2 + 16;
+                writer->stack = (napi_value*)realloc(writer->stack, writer->stackCapacity * sizeof(napi_value));
+        }
+        writer->stack[writer->depth++] = value;
+        // the handles created for the members of an object are released with it
+        napi_handle_scope scope;
+        napi_open_handle_scope(env, &scope);
+        bool isArray;
+        napi_is_array(env, value, &isArray);
+        if (!isArray) {
+                // napi_is_array does not see through a Proxy, but Array.isArray does like JSON.stringify
+                napi_value result;
+                if (napi_call_function(env, writer->Array, writer->isArray, 1, &value, &result) != napi_ok) {
+                        napi_close_handle_scope(env, scope);
+                        --writer->depth;
+                        return false;
+                }
+                napi_get_value_bool(env, result, &isArray);
+        }
+        bool ok = isArray ? writeJSONArray(writer, value) : writeJSONProperties(writer, value);
+        napi_close_handle_scope(env, scope);
+        --writer->depth;
+        return ok;
+}
+
+napi_value AppendJSON(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        if(argsLength == 0) {
+                return me;
+        }
+
+        JSONWriter writer;
+        memset(&writer, 0, sizeof(JSONWriter));
+        writer.env = env;
+        writer.me = me;
+
+        if (argsLength > 1) {
+                napi_valuetype optionsType;
+                napi_typeof(env, args[1], &optionsType);
+                if (optionsType == napi_object) {
+                        napi_value indent;
+                        napi_valuetype indentType;
+                        napi_get_named_property(env, args[1], "indent", &indent);
+                        napi_typeof(env, indent, &indentType);
+                        if (indentType == napi_number) {
+                                // like the space argument of JSON.stringify, at most 10 spaces or characters
+                                double spaces;
+                                napi_get_value_double(env, indent, &spaces);
+                                for (; writer.indentLength < 10 && writer.indentLength + 1 <= spaces; ++writer.indentLength) {
+                                        writer.indent[writer.indentLength] = ' ';
+                                }
+                        } else if (indentType == napi_string) {
+                                napi_get_value_string_utf16(env, indent, writer.indent, 11, &writer.indentLength);
+                        }
+                }
+        }
+
+        napi_value global, key, value = args[0];
+        napi_valuetype type;
+        napi_get_global(env, &global);
+        napi_get_named_property(env, global, "Number", &writer.Number);
+        napi_get_named_property(env, global, "String", &writer.String);
+        napi_get_named_property(env, global, "Boolean", &writer.Boolean);
+        napi_get_named_property(env, global, "BigInt", &writer.BigInt);
+        napi_value Object;
+        napi_get_named_property(env, global, "Object", &Object);
+        napi_get_named_property(env, global, "Array", &writer.Array);
+        napi_get_named_property(env, Object, "prototype", &writer.ObjectPrototype);
+        napi_get_named_property(env, Object, "keys", &writer.keys);
+        napi_get_named_property(env, writer.Array, "prototype", &writer.ArrayPrototype);
+        napi_get_named_property(env, writer.Array, "isArray", &writer.isArray);
+        napi_create_string_utf8(env, "toJSON", 6, &writer.toJSON);
+        napi_create_string_utf8(env, "", 0, &key);
+        if (!resolveJSONValue(&writer, key, 0, &value, &type)) {
+                return me;
+        }
+        if (type == napi_undefined || type == napi_function || type == napi_symbol) {
+                return me;
+        }
+
+        bool ok = writeJSONValue(&writer, value, type);
+        free(writer.stack);
+        if (!ok) {
+                free(writer.text);
+                return me;
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (reAllocForAppend(env, me, &buffer, &metadata, writer.length * 2)) {
+                memcpy(buffer + metadata[1] / 2, writer.text, writer.length * 2);
+                metadata[1] += writer.length * 2;
+                updateIncrementalHash(buffer, metadata);
+        }
+        free(writer.text);
+        return me;
+}
+
+// Get the bytes of a Buffer, a TypedArray, a DataView or an ArrayBuffer, or throw a TypeError
+bool getBinaryFromOutside(napi_env env, napi_value source, uint8_t** data, size_t* length) {
+        bool is;
+        napi_is_buffer(env, source, &is);
+        if (is) {
+                napi_get_buffer_info(env, source, (void**)data, length);
+                return true;
+        }
+        napi_is_typedarray(env, source, &is);
+        if (is) {
+                napi_typedarray_type type;
+                size_t elementCount;
+                napi_get_typedarray_info(env, source, &type, &elementCount, (void**)data, 0, 0);
+                static const size_t elementSizes[] = {1, 1, 1, 2, 2, 4, 4, 4, 8, 8, 8};
+                *length = elementCount * elementSizes[type];
+                return true;
+        }
+        napi_is_dataview(env, source, &is);
+        if (is) {
+                napi_get_dataview_info(env, source, length, (void**)data, 0, 0);
+                return true;
+        }
+        napi_is_arraybuffer(env, source, &is);
+        if (is) {
+                napi_get_arraybuffer_info(env, source, (void**)data, length);
+                return true;
+        }
+        napi_throw_type_error(env, 0, "The data has to be a Buffer, a TypedArray, a DataView or an ArrayBuffer");
+        return false;
+}
+
+napi_value AppendBase64(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        if(argsLength == 0) {
+                return me;
+        }
+
+        uint8_t* data;
+        size_t length;
+        if (!getBinaryFromOutside(env, args[0], &data, &length)) {
+                return me;
+        }
+
+        bool url = false;
+        if (argsLength > 1) {
+                napi_valuetype optionsType;
+                napi_typeof(env, args[1], &optionsType);
+                if (optionsType == napi_object) {
+                        napi_value _url;
+                        napi_get_named_property(env, args[1], "url", &_url);
+                        napi_coerce_to_bool(env, _url, &_url);
+                        napi_get_value_bool(env, _url, &url);
+                }
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (!reAllocForAppend(env, me, &buffer, &metadata, (length + 2) / 3 * 8)) {
+                return 0;
+        }
+        metadata[1] += encodeBase64(data, length, url, buffer + metadata[1] / 2) * 2;
+        updateIncrementalHash(buffer, metadata);
+        return me;
+}
+
+napi_value AppendHex(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        if(argsLength == 0) {
+                return me;
+        }
+
+        uint8_t* data;
+        size_t length;
+        if (!getBinaryFromOutside(env, args[0], &data, &length)) {
+                return me;
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (!reAllocForAppend(env, me, &buffer, &metadata, length * 4)) {
+                return 0;
+        }
+        encodeHex(data, length, buffer + metadata[1] / 2);
+        metadata[1] += length * 4;
+        updateIncrementalHash(buffer, metadata);
+        return me;
+}
+
+napi_value DecodeBase64(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t start = 0, end = metadata[1];
+        if (argsLength > 0) {
+                getRealIndex(env, metadata, args[0], &start);
+        }
+        if (argsLength > 1) {
+                getRealIndex(env, metadata, args[1], &end);
+        }
+        if (end < start) {
+                end = start;
+        }
+
+        // decode in one pass into a buffer for the longest possible result, which is only sliced if characters were skipped
+        int64_t length = (end - start) / 2;
+        int64_t capacity = length / 4 * 3 + (length % 4) - (length % 4 > 0);
+        napi_value result;
+        uint8_t* output;
+        napi_create_buffer(env, capacity, (void**)(&output), &result);
+        int64_t count = decodeBase64(buffer + start / 2, length, output);
+        if (count < capacity) {
+                napi_value subarray, args[2];
+                napi_get_named_property(env, result, "subarray", &subarray);
+                napi_create_int64(env, 0, &args[0]);
+                napi_create_int64(env, count, &args[1]);
+                napi_call_function(env, result, subarray, 2, args, &result);
+        }
+        return result;
+}
+
+napi_value Reverse(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        char unit[16] = "codeUnit";
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                if (type == napi_string) {
+                        napi_get_value_string_utf8(env, args[0], unit, 16, 0);
+                }
+        }
+
+        markTextModified(metadata, 0);
+        int64_t length = metadata[1] / 2;
+        if (strcmp(unit, "grapheme") == 0) {
+                reverseGraphemeClusters(buffer, length);
+        } else if (strcmp(unit, "codePoint") == 0) {
+                reverseSurrogatePairs(buffer, length);
+        }
+        reverseCodeUnits(buffer, length);
+        return me;
+}
+
+napi_value UpperCase(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        markTextModified(metadata, 0);
+        convertCase(buffer, metadata[1] / 2, true);
+        return me;
+}
+
+napi_value LowerCase(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        markTextModified(metadata, 0);
+        convertCase(buffer, metadata[1] / 2, false);
+        return me;
+}
+
+napi_value ReplacePattern(napi_env env, napi_callback_info info){
+        size_t argsLength = 4;
+        napi_value args[4];
+
+        napi_value me;
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        if(argsLength < 2) {
+                return me;
+        }
+
+        // convert the arguments before taking the buffer, because their toString may clone, view or modify me
+        uint16_t* pattern;
+        int64_t patternLength;
+        bool patternFreeAble;
+        getUTF16FromOutside(env, me, args[0], &pattern, &patternLength, &patternFreeAble);
         uint16_t* content;
         int64_t contentLength;
         bool contentFreeAble;
-        getUTF16FromOutside(env, args[1], &content, &contentLength, &contentFreeAble);
+        getUTF16ToAppend(env, me, args[1], &content, &contentLength, &contentFreeAble);
+
+        uint16_t* buffer;
+        int64_t* metadata;
 
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t offset, limit;
+        switch(argsLength) {
+        case 2: {
+                offset = 0;
+                limit = 1;
+                break;
+        }
+        case 3: {
+                getRealIndex(env, metadata, args[2], &offset);
+                limit = 1;
+                break;
+        }
+        default: {
+                getRealIndex(env, metadata, args[2], &offset);
+                getRealIndex(env, metadata, args[3], &limit);
+                break;
+        }
+        }
+
+        int64_t* resultList;
+        int64_t resultListLength;
+        boyerMooreMagicLenSkipPure(buffer, metadata[1] / 2, pattern, patternLength / 2, offset / 2, limit, &resultList, &resultListLength);
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, metadata[1] - offset);
+        if (resultListLength <= 0) {
+                if(resultListLength == 0) {
+                        free(resultList);
+                }
+                if(patternFreeAble) {
+                        free(pattern);
+                }
+                if(contentFreeAble) {
+                        free(content);
+                }
+                return me;
+        }
+
+        markTextModified(metadata, resultList[0] * 2);
         int64_t i, diffLength = contentLength - patternLength;
         int64_t length = metadata[1];
         int64_t concatLength = length + (diffLength * resultListLength);
-        reAlloc(env, me, &buffer, &metadata, concatLength);
+        // several matches are replaced into the space after the text, and then moved back
+        int64_t biggerLength = max(contentLength, length);
+        if (!reAlloc(env, me, &buffer, &metadata, contentLength == patternLength || resultListLength == 1 ? concatLength : biggerLength + concatLength)) {
+                free(resultList);
+                if(patternFreeAble) {
+                        free(pattern);
+                }
+                if(contentFreeAble) {
+                        free(content);
+                }
+                return 0;
+        }
         if (contentLength == patternLength) {
                 for (i = resultListLength - 1; i >= 0; --i) {
                         memcpy(buffer + resultList[i], content, contentLength);
                 }
         } else {
                 if(resultListLength == 1) {
-                        reAlloc(env, me, &buffer, &metadata, concatLength);
                         int64_t start = resultList[0] * 2;
                         int64_t end = start + patternLength;
                         memmove(buffer + ((start + contentLength) / 2), buffer + (end / 2), length - end);
+                        countStat(env, me, statBytesMoved, length - end);
                         memcpy(buffer + (start / 2), content, contentLength);
                 }else{
-                        int64_t biggerLength = max(contentLength, length);
-                        reAlloc(env, me, &buffer, &metadata, biggerLength * 2);
                         int64_t originalIndex = 0, index, concatIndex = biggerLength / 2, l, pl = patternLength / 2, cl = contentLength / 2;
                         for (i = 0; i < resultListLength; ++i) {
                                 index = resultList[i];
@@ -1027,6 +2638,7 @@ napi_value ReplacePattern(napi_env env, napi_callback_info info){
                         }
                         memmove(buffer + concatIndex, buffer + originalIndex, length - (originalIndex * 2));
                         memmove(buffer, buffer + (biggerLength / 2), concatLength);
+                        countStat(env, me, statBytesMoved, length - resultListLength * patternLength + concatLength);
                 }
         }
         metadata[1] = concatLength;
@@ -1034,6 +2646,9 @@ napi_value ReplacePattern(napi_env env, napi_callback_info info){
         if(patternFreeAble) {
                 free(pattern);
         }
+        if(contentFreeAble) {
+                free(content);
+        }
         return me;
 }
 
@@ -1047,20 +2662,26 @@ napi_value ReplaceAll(napi_env env, napi_callback_info info){
                 return me;
         }
 
-        uint16_t* buffer;
-        int64_t* metadata;
-
-        getBufferAndMetaData(env, me, &buffer, &metadata);
-
+        // convert the arguments before taking the buffer, because their toString may clone, view or modify me
         uint16_t* pattern;
         int64_t patternLength;
         bool patternFreeAble;
+        getUTF16FromOutside(env, me, args[0], &pattern, &patternLength, &patternFreeAble);
+        uint16_t* content;
+        int64_t contentLength;
+        bool contentFreeAble;
+        getUTF16ToAppend(env, me, args[1], &content, &contentLength, &contentFreeAble);
 
-        getUTF16FromOutside(env, args[0], &pattern, &patternLength, &patternFreeAble);
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
 
         int64_t* resultList;
         int64_t resultListLength;
         boyerMooreMagicLenSkipPure(buffer, metadata[1] / 2, pattern, patternLength / 2, 0, 0, &resultList, &resultListLength);
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, metadata[1]);
         if (resultListLength <= 0) {
                 if(resultListLength == 0) {
                         free(resultList);
@@ -1068,32 +2689,40 @@ napi_value ReplaceAll(napi_env env, napi_callback_info info){
                 if(patternFreeAble) {
                         free(pattern);
                 }
+                if(contentFreeAble) {
+                        free(content);
+                }
                 return me;
         }
 
-        uint16_t* content;
-        int64_t contentLength;
-        bool contentFreeAble;
-        getUTF16FromOutside(env, args[1], &content, &contentLength, &contentFreeAble);
-
+        markTextModified(metadata, resultList[0] * 2);
         int64_t i, diffLength = contentLength - patternLength;
         int64_t length = metadata[1];
         int64_t concatLength = length + (diffLength * resultListLength);
+        // several matches are replaced into the space after the text, and then moved back
+        int64_t biggerLength = max(contentLength, length);
+        if (!reAlloc(env, me, &buffer, &metadata, contentLength == patternLength || resultListLength == 1 ? concatLength : biggerLength + concatLength)) {
+                free(resultList);
+                if(patternFreeAble) {
+                        free(pattern);
+                }
+                if(contentFreeAble) {
+                        free(content);
+                }
+                return 0;
+        }
         if (contentLength == patternLength) {
-                reAlloc(env, me, &buffer, &metadata, concatLength);
                 for (i = resultListLength - 1; i >= 0; --i) {
                         memcpy(buffer + resultList[i], content, contentLength);
                 }
         } else {
                 if(resultListLength == 1) {
-                        reAlloc(env, me, &buffer, &metadata, concatLength);
                         int64_t start = resultList[0] * 2;
                         int64_t end = start + patternLength;
                         memmove(buffer + ((start + contentLength) / 2), buffer + (end / 2), length - end);
+                        countStat(env, me, statBytesMoved, length - end);
                         memcpy(buffer + (start / 2), content, contentLength);
                 }else{
-                        int64_t biggerLength = max(contentLength, length);
-                        reAlloc(env, me, &buffer, &metadata, biggerLength * 2);
                         int64_t originalIndex = 0, index, concatIndex = biggerLength / 2, l, pl = patternLength / 2, cl = contentLength / 2;
                         for (i = 0; i < resultListLength; ++i) {
                                 index = resultList[i];
@@ -1106,179 +2735,624 @@ napi_value ReplaceAll(napi_env env, napi_callback_info info){
                         }
                         memmove(buffer + concatIndex, buffer + originalIndex, length - (originalIndex * 2));
                         memmove(buffer, buffer + (biggerLength / 2), concatLength);
+                        countStat(env, me, statBytesMoved, length - resultListLength * patternLength + concatLength);
+                }
+        }
+        metadata[1] = concatLength;
+        free(resultList);
+        if(patternFreeAble) {
+                free(pattern);
+        }
+        if(contentFreeAble) {
+                free(content);
+        }
+        return me;
+}
+
+// Leading whitespace is removed by moving the offset of the text instead of moving the text.
+napi_value trimWhiteSpace(napi_env env, napi_callback_info info, bool trimStart, bool trimEnd){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t length = metadata[1] / 2;
+        int64_t start = 0, end = length;
+        if (trimStart) {
+                start = skipWhiteSpaceForward(buffer, 0, length);
+        }
+        if (trimEnd) {
+                end = skipWhiteSpaceBackward(buffer, start, length);
+        }
+        start *= 2;
+        end *= 2;
+        markTextModified(metadata, start == 0 ? end : 0);
+        metadata[0] -= start;
+        metadata[1] = end - start;
+        if (start > 0) {
+                metadata[4] += start;
+                ++metadata[11];
+        }
+        return me;
+}
+
+napi_value Trim(napi_env env, napi_callback_info info){
+        return trimWhiteSpace(env, info, true, true);
+}
+
+napi_value TrimStart(napi_env env, napi_callback_info info){
+        return trimWhiteSpace(env, info, true, false);
+}
+
+napi_value TrimEnd(napi_env env, napi_callback_info info){
+        return trimWhiteSpace(env, info, false, true);
+}
+
+napi_value Repeat(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        int64_t repeatCount;
+        if(argsLength < 1) {
+                repeatCount = 1;
+        }else{
+                napi_get_value_int64(env, args[0], &repeatCount);
+                if(repeatCount < 1) {
+                        return me;
+                }
+        }
+
+        // nothing changes without text, so a shared buffer is not copied and the views stay valid
+        uint16_t* buffer;
+        int64_t* metadata;
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+        if (metadata[1] == 0) {
+                return me;
+        }
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t length = metadata[1];
+        int64_t finalLength = length + multiplySizes(length, repeatCount);
+        int64_t originalLength = length;
+        if (!reAlloc(env, me, &buffer, &metadata, finalLength)) {
+                return 0;
+        }
+        // log2 copy
+        int64_t log2Count = log2Floor(repeatCount);
+        memcpy(buffer + (originalLength / 2), buffer, originalLength);
+        int64_t i;
+        for (i = 1; i <= log2Count; ++i) {
+                int64_t addedLength = pow(2, i - 1) * originalLength;
+                memcpy(buffer + ((originalLength + addedLength) / 2), buffer + (originalLength / 2), addedLength);
+        }
+        int64_t realAddedCount = pow(2, log2Count);
+        length += originalLength * realAddedCount;
+        // normal copy
+        int64_t remainCount = repeatCount - realAddedCount;
+        for (i = 0; i < remainCount; ++i) {
+                memcpy(buffer + (length / 2), buffer, originalLength);
+                length += originalLength;
+        }
+        metadata[1] = finalLength;
+        return me;
+}
+
+napi_value ExpandCapacity(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t newCapacity;
+        bool returnUpdatedCapacity;
+        switch(argsLength) {
+        case 0:
+                newCapacity = metadata[0];
+                returnUpdatedCapacity = false;
+                break;
+        case 1:
+                napi_get_value_int64(env, args[0], &newCapacity);
+                returnUpdatedCapacity = false;
+                break;
+        default:
+                napi_get_value_int64(env, args[0], &newCapacity);
+                napi_get_value_bool(env, args[1], &returnUpdatedCapacity);
+                break;
+        }
+        if (!reAlloc(env, me, &buffer, &metadata, multiplySizes(newCapacity, 2))) {
+                return 0;
+        }
+        if (returnUpdatedCapacity) {
+                napi_value result;
+                napi_create_int64(env, metadata[0] / 2, &result);
+                return result;
+        }
+        return me;
+}
+
+napi_value ShrinkCapacity(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableBufferAndMetaData(env, me, &buffer, &metadata);
+
+        bool returnUpdatedCapacity;
+        if(argsLength == 0) {
+                returnUpdatedCapacity = false;
+        }else{
+                napi_get_value_bool(env, args[0], &returnUpdatedCapacity);
+        }
+
+        if (metadata[4] > 0) {
+                memmove((uint8_t*)metadata + headerSize, buffer, metadata[1]);
+                countStat(env, me, statBytesMoved, metadata[1]);
+                metadata[0] += metadata[4];
+                metadata[4] = 0;
+                ++metadata[11];
+        }
+        int64_t count = (metadata[1] + blockSize - 1) / blockSize;
+        if (count == 0) {
+                count = 1;
+        }
+        int64_t newCapacity = count * blockSize;
+        if (newCapacity < metadata[0]) {
+                napi_value _new_raw;
+                uint8_t* newRaw;
+                napi_create_buffer_copy(env, headerSize + newCapacity, (void*)metadata, (void**)(&newRaw), &_new_raw);
+                countStat(env, me, statReallocations, 1);
+                countStat(env, me, statBytesCopied, metadata[1]);
+                metadata = (int64_t*)newRaw;
+                metadata[0] = newCapacity;
+                ++metadata[11];
+                napi_set_element(env, me, 0, _new_raw);
+        }
+
+        if (returnUpdatedCapacity) {
+                napi_value result;
+                napi_create_int64(env, metadata[0] / 2, &result);
+                return result;
+        }
+        return me;
+}
+
+// A Uint16Array over the text, or with the `spare` option, over the capacity after the text (growing it to at least `spare` code units), without copying. It stays valid as long as the storage generation does not change.
+napi_value UnsafeView(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        int64_t spare = -1;
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                bool hasSpare = false;
+                if (type == napi_object) {
+                        napi_has_named_property(env, args[0], "spare", &hasSpare);
                 }
+                if (hasSpare) {
+                        napi_value _spare;
+                        napi_get_named_property(env, args[0], "spare", &_spare);
+                        spare = 0;
+                        napi_get_value_int64(env, _spare, &spare);
+                        if (spare < 0) {
+                                napi_throw_range_error(env, 0, "The spare capacity has to be a non-negative number");
+                                return 0;
+                        }
+                }
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        int64_t start, length;
+        if (spare < 0) {
+                getBufferAndMetaData(env, me, &buffer, &metadata);
+                start = 0;
+                length = metadata[1] / 2;
+        } else {
+                // the spare capacity is written, so it must not be shared with a clone
+                getTailBufferAndMetaData(env, me, &buffer, &metadata);
+                unshareBuffer(env, me, &buffer, &metadata, metadata[1]);
+                if (!reAllocForAppend(env, me, &buffer, &metadata, multiplySizes(spare, 2))) {
+                        return 0;
+                }
+                start = metadata[1] / 2;
+                length = (metadata[0] - metadata[1]) / 2;
+        }
+
+        napi_value _raw, arrayBuffer, result;
+        size_t byteOffset;
+        napi_get_element(env, me, 0, &_raw);
+        napi_get_typedarray_info(env, _raw, 0, 0, 0, &arrayBuffer, &byteOffset);
+        napi_create_typedarray(env, napi_uint16_array, length, arrayBuffer, byteOffset + headerSize + metadata[4] + start * 2, &result);
+        return result;
+}
+
+napi_value StorageGeneration(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
+
+        napi_value result;
+        napi_create_int64(env, metadata[11], &result);
+        return result;
+}
+
+// Append the first n code units of the spare capacity, written through unsafeView.
+napi_value Commit(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t count = 0;
+        if (argsLength > 0) {
+                napi_get_value_int64(env, args[0], &count);
         }
-        metadata[1] = concatLength;
-        free(resultList);
-        if(patternFreeAble) {
-                free(pattern);
+        if (count < 0 || count > (metadata[0] - metadata[1]) / 2) {
+                napi_throw_range_error(env, 0, "The count has to be between 0 and the spare capacity");
+                return 0;
         }
+        // a clone made after unsafeView shares the written code units too
+        unshareBuffer(env, me, &buffer, &metadata, metadata[1] + count * 2);
+        ++metadata[6];
+        metadata[1] += count * 2;
+        updateIncrementalHash(buffer, metadata);
         return me;
 }
 
-napi_value Trim(napi_env env, napi_callback_info info){
+napi_value Segment(napi_env env, napi_callback_info info){
         napi_value me;
-        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
-        getBufferAndMetaData(env, me, &buffer, &metadata);
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
 
-        int64_t length = metadata[1] / 2;
-        int64_t start = 0, end = length - 1;
-        for (; start < length; ++start) {
-                uint16_t v = buffer[start];
-                if (isTrimmable(v)) {
-                        continue;
-                }
-                break;
+        int64_t segmentCapacity = 0;
+        if (argsLength > 0) {
+                napi_get_value_int64(env, args[0], &segmentCapacity);
         }
-        for (; end > start; --end) {
-                uint16_t v = buffer[end];
-                if (isTrimmable(v)) {
-                        continue;
-                }
-                break;
+        if (segmentCapacity > 0) {
+                // like reAlloc, a capacity is never bigger than the maximum capacity, which also keeps the rounding from overflowing
+                segmentCapacity = min(multiplySizes(segmentCapacity, 2), getMaxCapacity(env, metadata));
+                segmentCapacity = (segmentCapacity + blockSize - 1) / blockSize * blockSize;
+        } else {
+                segmentCapacity = 0;
         }
-        start *= 2;
-        end = end * 2 + 2;
-        if (start >= end) {
-                metadata[1] = 0;
+        if (segmentCapacity == metadata[2] && (segmentCapacity > 0 || metadata[3] == 0)) {
                 return me;
         }
-        if (start == 0) {
-                metadata[1] = end;
-        } else {
-                metadata[1] = end - start;
-                memmove(buffer, buffer + (start / 2), metadata[1]);
+        // the text does not change, so the views stay valid. Only the header has to be copied if it is shared with a clone.
+        unshareBuffer(env, me, &buffer, &metadata, metadata[1]);
+        if (segmentCapacity == 0 && metadata[3] > 0) {
+                flattenSegments(env, me, &buffer, &metadata);
         }
+        metadata[2] = segmentCapacity;
         return me;
 }
 
-napi_value Repeat(napi_env env, napi_callback_info info){
-        napi_value me;
+// TODO -----Unchangers-----
 
-        size_t argsLength = 1;
-        napi_value args[1];
+napi_value ToBuffer(napi_env env, napi_callback_info info){
+        size_t argsLength = 2;
+        napi_value args[2];
+
+        napi_value me;
         napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
+
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
-        int64_t repeatCount;
-        if(argsLength < 1) {
-                repeatCount = 1;
-        }else{
-                napi_get_value_int64(env, args[0], &repeatCount);
-                if(repeatCount < 1) {
-                        return me;
+        int64_t start, end;
+        switch(argsLength) {
+        case 0:
+                start = 0;
+                end = metadata[1];
+                break;
+        case 1: {
+                getRealIndex(env, metadata, args[0], &start);
+                end = metadata[1];
+                break;
+        }
+        case 2: {
+                getRealIndex(env, metadata, args[0], &start);
+                getRealIndex(env, metadata, args[1], &end);
+                break;
+        }
+        }
+        napi_value tempString;
+        napi_create_string_utf16(env, buffer + (start / 2), (end - start) / 2, &tempString);
+        size_t sourceDataSize;
+        napi_get_value_string_utf8(env, tempString, NULL, 0, &sourceDataSize);
+        ++sourceDataSize;
+        char* utf8Data = (char*)malloc(sizeof(char) * sourceDataSize);
+        napi_get_value_string_utf8(env, tempString, utf8Data, sourceDataSize, &sourceDataSize);
+        napi_value result;
+        char* data;
+        napi_create_buffer_copy(env, sourceDataSize, utf8Data, (void**)(&data), &result);
+        free(utf8Data);
+        return result;
+}
+
+napi_value ToBuffers(napi_env env, napi_callback_info info){
+        size_t argsLength = 1;
+        napi_value args[1];
+
+        napi_value me;
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        bool utf16 = false;
+        if (argsLength > 0) {
+                char encoding[16];
+                size_t encodingLength;
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                if (type == napi_string) {
+                        napi_get_value_string_utf8(env, args[0], encoding, 16, &encodingLength);
+                        utf16 = strcmp(encoding, "utf16le") == 0 || strcmp(encoding, "utf-16le") == 0 || strcmp(encoding, "ucs2") == 0 || strcmp(encoding, "ucs-2") == 0;
                 }
         }
 
-        int64_t length = metadata[1];
-        int64_t finalLength = length * (repeatCount + 1);
-        int64_t originalLength = length;
-        reAlloc(env, me, &buffer, &metadata, finalLength);
-        // log2 copy
-        int64_t log2Count = log2Floor(repeatCount);
-        memcpy(buffer + (originalLength / 2), buffer, originalLength);
-        int64_t i;
-        for (i = 1; i <= log2Count; ++i) {
-                int64_t addedLength = pow(2, i - 1) * originalLength;
-                memcpy(buffer + ((originalLength + addedLength) / 2), buffer + (originalLength / 2), addedLength);
+        int64_t* metadata;
+        getMetaData(env, me, &metadata);
+
+        napi_value segments = 0;
+        uint32_t i, segmentsLength = 0;
+        if (metadata[3] > 0) {
+                napi_get_element(env, me, 1, &segments);
+                napi_get_array_length(env, segments, &segmentsLength);
         }
-        int64_t realAddedCount = pow(2, log2Count);
-        length += originalLength * realAddedCount;
-        // normal copy
-        int64_t remainCount = repeatCount - realAddedCount;
-        for (i = 0; i < remainCount; ++i) {
-                memcpy(buffer + (length / 2), buffer, originalLength);
-                length += originalLength;
+
+        napi_value result;
+        napi_create_array_with_length(env, segmentsLength + 1, &result);
+        bool skipFirst = false;
+        for (i = 0; i <= segmentsLength; ++i) {
+                napi_value segment, output;
+                uint16_t* data;
+                int64_t dataLength;
+                getSegment(env, me, segments, i, segmentsLength, &segment, &data, &dataLength);
+                if (utf16) {
+                        napi_value arrayBuffer;
+                        uint8_t* raw;
+                        size_t byteOffset;
+                        napi_get_typedarray_info(env, segment, 0, 0, (void**)(&raw), &arrayBuffer, &byteOffset);
+                        napi_create_typedarray(env, napi_uint8_array, dataLength, arrayBuffer, byteOffset + ((uint8_t*)data - raw), &output);
+                        napi_set_element(env, result, i, output);
+                        continue;
+                }
+                // a surrogate pair split by the segment boundary is encoded together with the former segment
+                uint32_t pairedCodePoint = 0;
+                if (i < segmentsLength && dataLength > 0 && data[dataLength / 2 - 1] >= 0xD800 && data[dataLength / 2 - 1] <= 0xDBFF) {
+                        napi_value nextSegment;
+                        uint16_t* nextData;
+                        int64_t nextDataLength;
+                        getSegment(env, me, segments, i + 1, segmentsLength, &nextSegment, &nextData, &nextDataLength);
+                        if (nextDataLength > 0 && nextData[0] >= 0xDC00 && nextData[0] <= 0xDFFF) {
+                                pairedCodePoint = 0x10000 + ((data[dataLength / 2 - 1] - 0xD800) << 10) + (nextData[0] - 0xDC00);
+                                dataLength -= 2;
+                        }
+                }
+                if (skipFirst) {
+                        data += 1;
+                        dataLength -= 2;
+                }
+                int64_t utf8Length = utf8LengthOfUTF16(data, dataLength / 2) + (pairedCodePoint > 0 ? 4 : 0);
+                uint8_t* utf8Data;
+                napi_create_buffer(env, utf8Length, (void**)(&utf8Data), &output);
+                utf8Data = encodeUTF16ToUTF8(data, dataLength / 2, utf8Data);
+                if (pairedCodePoint > 0) {
+                        encodeUTF8CodePoint(pairedCodePoint, utf8Data);
+                }
+                skipFirst = pairedCodePoint > 0;
+                napi_set_element(env, result, i, output);
         }
-        metadata[1] = finalLength;
-        return me;
+        return result;
 }
 
-napi_value ExpandCapacity(napi_env env, napi_callback_info info){
+napi_value SegmentCount(napi_env env, napi_callback_info info){
         napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        int64_t* metadata;
+        getMetaData(env, me, &metadata);
+
+        uint32_t segmentsLength = 0;
+        if (metadata[3] > 0) {
+                napi_value segments;
+                napi_get_element(env, me, 1, &segments);
+                napi_get_array_length(env, segments, &segmentsLength);
+        }
+
+        napi_value result;
+        napi_create_uint32(env, segmentsLength + 1, &result);
+        return result;
+}
 
+napi_value ToString(napi_env env, napi_callback_info info){
         size_t argsLength = 2;
         napi_value args[2];
+
+        napi_value me;
         napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
+
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
-        int64_t newCapacity;
-        bool returnUpdatedCapacity;
+        int64_t start, end;
         switch(argsLength) {
         case 0:
-                newCapacity = metadata[0];
-                returnUpdatedCapacity = false;
+                start = 0;
+                end = metadata[1];
                 break;
-        case 1:
-                napi_get_value_int64(env, args[0], &newCapacity);
-                returnUpdatedCapacity = false;
+        case 1: {
+                getRealIndex(env, metadata, args[0], &start);
+                end = metadata[1];
                 break;
-        default:
-                napi_get_value_int64(env, args[0], &newCapacity);
-                napi_get_value_bool(env, args[1], &returnUpdatedCapacity);
+        }
+        case 2: {
+                getRealIndex(env, metadata, args[0], &start);
+                getRealIndex(env, metadata, args[1], &end);
                 break;
         }
-        reAlloc(env, me, &buffer, &metadata, newCapacity * 2);
-        if (returnUpdatedCapacity) {
-                napi_value result;
-                napi_create_int64(env, metadata[0] / 2, &result);
-                return result;
         }
-        return me;
+        napi_value result;
+        napi_create_string_utf16(env, buffer + (start / 2), (end - start) / 2, &result);
+        return result;
 }
 
-napi_value ShrinkCapacity(napi_env env, napi_callback_info info){
+napi_value Inspect(napi_env env, napi_callback_info info){
         napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
 
-        size_t argsLength = 1;
-        napi_value args[1];
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        napi_value result;
+        napi_create_string_utf16(env, buffer, metadata[1] / 2, &result);
+        return result;
+}
+
+napi_value View(napi_env env, napi_callback_info info){
+        size_t argsLength = 2;
+        napi_value args[2];
+
+        napi_value me;
         napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
+
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
-        bool returnUpdatedCapacity;
-        if(argsLength == 0) {
-                returnUpdatedCapacity = false;
-        }else{
-                napi_get_value_bool(env, args[0], &returnUpdatedCapacity);
+        int64_t start, end;
+        switch(argsLength) {
+        case 0:
+                start = 0;
+                end = metadata[1];
+                break;
+        case 1: {
+                getRealIndex(env, metadata, args[0], &start);
+                end = metadata[1];
+                break;
         }
-
-        int64_t count = (metadata[1] + blockSize - 1) / blockSize;
-        if (count == 0) {
-                count = 1;
+        case 2: {
+                getRealIndex(env, metadata, args[0], &start);
+                getRealIndex(env, metadata, args[1], &end);
+                break;
         }
-        int64_t newCapacity = count * blockSize;
-        if (newCapacity < metadata[0]) {
-                napi_value _new_raw;
-                uint8_t* newRaw;
-                napi_create_buffer_copy(env, 16 + newCapacity, (void*)metadata, (void**)(&newRaw), &_new_raw);
-                metadata = (int64_t*)newRaw;
-                metadata[0] = newCapacity;
-                napi_set_element(env, me, 0, _new_raw);
+        }
+        if (end < start) {
+                end = start;
         }
 
-        if (returnUpdatedCapacity) {
-                napi_value result;
-                napi_create_int64(env, metadata[0] / 2, &result);
-                return result;
+        napi_value StringBuilderView;
+        napi_get_reference_value(env, StringBuilderViewRef, &StringBuilderView);
+        napi_value view;
+        napi_new_instance(env, StringBuilderView, 0, 0, &view);
+
+        napi_value _raw;
+        int64_t* raw;
+        napi_create_buffer(env, headerSize, (void**)(&raw), &_raw);
+        memset(raw, 0, headerSize);
+        raw[0] = end - start;
+        raw[1] = end - start;
+        raw[4] = start;
+        raw[6] = metadata[6];
+        napi_set_element(env, view, 0, me);
+        napi_set_element(env, view, 1, _raw);
+        return view;
+}
+
+napi_value Clone(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getTailBufferAndMetaData(env, me, &buffer, &metadata);
+
+        napi_value newMe;
+
+        napi_value StringBuilder;
+        napi_get_reference_value(env, StringBuilderRef, &StringBuilder);
+
+        napi_value vFalse = createFalse(env);
+        napi_value args[3];
+        args[0] = vFalse;
+        args[1] = vFalse;
+        args[2] = vFalse;
+        napi_new_instance(env, StringBuilder, 3, args, &newMe);
+
+        // share the buffer (and the sealed segments, which are never written) instead of copying
+        napi_value _raw;
+        napi_get_element(env, me, 0, &_raw);
+        napi_set_element(env, newMe, 0, _raw);
+        ++metadata[5];
+        if (metadata[3] > 0) {
+                napi_value segments, newSegments;
+                uint32_t i, segmentsLength;
+                napi_get_element(env, me, 1, &segments);
+                napi_get_array_length(env, segments, &segmentsLength);
+                napi_create_array_with_length(env, segmentsLength, &newSegments);
+                for (i = 0; i < segmentsLength; ++i) {
+                        napi_value segment;
+                        napi_get_element(env, segments, i, &segment);
+                        napi_set_element(env, newSegments, i, segment);
+                }
+                napi_set_element(env, newMe, 1, newSegments);
         }
-        return me;
+        return newMe;
 }
 
-// TODO -----Unchangers-----
+napi_value Count(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        napi_value result;
+        napi_create_int64(env, countWordsUTF16(buffer, metadata[1] / 2), &result);
+        return result;
+}
 
-napi_value ToBuffer(napi_env env, napi_callback_info info){
+napi_value Stats(napi_env env, napi_callback_info info){
         size_t argsLength = 2;
         napi_value args[2];
 
@@ -1296,181 +3370,231 @@ napi_value ToBuffer(napi_env env, napi_callback_info info){
                 start = 0;
                 end = metadata[1];
                 break;
-        case 1: {
+        case 1:
                 getRealIndex(env, metadata, args[0], &start);
                 end = metadata[1];
                 break;
-        }
-        case 2: {
+        default:
                 getRealIndex(env, metadata, args[0], &start);
                 getRealIndex(env, metadata, args[1], &end);
                 break;
         }
+        if (end < start) {
+                end = start;
         }
-        napi_value tempString;
-        napi_create_string_utf16(env, buffer + (start / 2), (end - start) / 2, &tempString);
-        size_t sourceDataSize;
-        napi_get_value_string_utf8(env, tempString, NULL, 0, &sourceDataSize);
-        ++sourceDataSize;
-        char* utf8Data = (char*)malloc(sizeof(char) * sourceDataSize);
-        napi_get_value_string_utf8(env, tempString, utf8Data, sourceDataSize, &sourceDataSize);
+
+        TextStatistics statistics;
+        measureUTF16(buffer + (start / 2), (end - start) / 2, true, &statistics);
+
+        napi_value result, value;
+        napi_create_object(env, &result);
+        napi_create_int64(env, (end - start) / 2, &value);
+        napi_set_named_property(env, result, "length", value);
+        napi_create_int64(env, statistics.words, &value);
+        napi_set_named_property(env, result, "words", value);
+        napi_create_int64(env, statistics.lines, &value);
+        napi_set_named_property(env, result, "lines", value);
+        napi_create_int64(env, statistics.codePoints, &value);
+        napi_set_named_property(env, result, "codePoints", value);
+        napi_create_int64(env, statistics.utf8Length, &value);
+        napi_set_named_property(env, result, "utf8Length", value);
+        return result;
+}
+
+napi_value LineCount(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t* index = getLineIndex(env, me, buffer, metadata);
         napi_value result;
-        char* data;
-        napi_create_buffer_copy(env, sourceDataSize, utf8Data, (void**)(&data), &result);
-        free(utf8Data);
+        napi_create_int64(env, index[1] + 1, &result);
         return result;
 }
 
-napi_value ToString(napi_env env, napi_callback_info info){
-        size_t argsLength = 2;
-        napi_value args[2];
+napi_value GetLine(napi_env env, napi_callback_info info){
+        size_t argsLength = 1;
+        napi_value args[1];
 
         napi_value me;
         napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
-
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
-        int64_t start, end;
-        switch(argsLength) {
-        case 0:
-                start = 0;
-                end = metadata[1];
-                break;
-        case 1: {
-                getRealIndex(env, metadata, args[0], &start);
-                end = metadata[1];
-                break;
-        }
-        case 2: {
-                getRealIndex(env, metadata, args[0], &start);
-                getRealIndex(env, metadata, args[1], &end);
-                break;
+        int64_t* index = getLineIndex(env, me, buffer, metadata);
+        int64_t line = 0;
+        if (argsLength > 0) {
+                napi_get_value_int64(env, args[0], &line);
         }
+        if (line < 0) {
+                line += index[1] + 1;
         }
         napi_value result;
-        napi_create_string_utf16(env, buffer + (start / 2), (end - start) / 2, &result);
+        if (line < 0 || line > index[1]) {
+                napi_get_undefined(env, &result);
+                return result;
+        }
+        int64_t start = line == 0 ? 0 : index[3 + line - 1];
+        int64_t end = line == index[1] ? metadata[1] / 2 : index[3 + line] - 1;
+        napi_create_string_utf16(env, buffer + start, end - start, &result);
         return result;
 }
 
-napi_value Inspect(napi_env env, napi_callback_info info){
+napi_value LineOf(napi_env env, napi_callback_info info){
+        size_t argsLength = 1;
+        napi_value args[1];
+
         napi_value me;
-        napi_get_cb_info(env, info, 0, 0, &me, 0);
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t* index = getLineIndex(env, me, buffer, metadata);
+        int64_t i = 0;
+        if (argsLength > 0) {
+                getRealIndex(env, metadata, args[0], &i);
+        }
+        napi_value result;
+        napi_create_int64(env, lineOfIndex(index, i / 2), &result);
+        return result;
+}
+
+napi_value ColumnOf(napi_env env, napi_callback_info info){
+        size_t argsLength = 1;
+        napi_value args[1];
+
+        napi_value me;
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
+        uint16_t* buffer;
+        int64_t* metadata;
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
+        int64_t* index = getLineIndex(env, me, buffer, metadata);
+        int64_t i = 0;
+        if (argsLength > 0) {
+                getRealIndex(env, metadata, args[0], &i);
+        }
+        i /= 2;
+        int64_t line = lineOfIndex(index, i);
         napi_value result;
-        napi_create_string_utf16(env, buffer, metadata[1] / 2, &result);
+        napi_create_int64(env, line == 0 ? i : i - index[3 + line - 1], &result);
         return result;
 }
 
-napi_value Clone(napi_env env, napi_callback_info info){
+napi_value Hash(napi_env env, napi_callback_info info){
+        size_t argsLength = 3;
+        napi_value args[3];
+
         napi_value me;
-        napi_get_cb_info(env, info, 0, 0, &me, 0);
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
-        uint8_t* raw;
-        uint64_t rawLength;
+        char algorithm[16] = "xxh3";
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[argsLength - 1], &type);
+                if (type == napi_object) {
+                        bool hasAlgorithm;
+                        napi_has_named_property(env, args[argsLength - 1], "algorithm", &hasAlgorithm);
+                        if (hasAlgorithm) {
+                                napi_value value;
+                                napi_get_named_property(env, args[argsLength - 1], "algorithm", &value);
+                                napi_get_value_string_utf8(env, value, algorithm, 16, 0);
+                        }
+                        --argsLength;
+                }
+        }
+        bool isXXH3 = strcmp(algorithm, "xxh3") == 0, isWyhash = strcmp(algorithm, "wyhash") == 0, isCRC32C = strcmp(algorithm, "crc32c") == 0;
+        if (!isXXH3 && !isWyhash && !isCRC32C) {
+                napi_throw_type_error(env, 0, "The algorithm should be xxh3, wyhash or crc32c");
+                return me;
+        }
 
-        getRawData(env, me, &raw, &rawLength);
-        napi_value _new_raw;
-        uint8_t* newRaw;
+        uint16_t* buffer;
+        int64_t* metadata;
+        napi_value result;
 
-        napi_create_buffer_copy(env, rawLength, raw, (void**)(&newRaw), &_new_raw);
+        if (isCRC32C && argsLength == 0) {
+                getTailBufferAndMetaData(env, me, &buffer, &metadata);
+                napi_create_uint32(env, getIncrementalHash(env, me, buffer, metadata), &result);
+                return result;
+        }
 
-        napi_value newMe;
+        getBufferAndMetaData(env, me, &buffer, &metadata);
 
-        napi_value StringBuilder;
-        napi_get_reference_value(env, StringBuilderRef, &StringBuilder);
+        int64_t start, end;
+        switch(argsLength) {
+        case 0:
+                start = 0;
+                end = metadata[1];
+                break;
+        case 1: {
+                getRealIndex(env, metadata, args[0], &start);
+                end = metadata[1];
+                break;
+        }
+        default: {
+                getRealIndex(env, metadata, args[0], &start);
+                getRealIndex(env, metadata, args[1], &end);
+                break;
+        }
+        }
+        if (end < start) {
+                end = start;
+        }
 
-        napi_value vFalse = createFalse(env);
-        napi_value args[3];
-        args[0] = vFalse;
-        args[1] = vFalse;
-        args[2] = vFalse;
-        napi_new_instance(env, StringBuilder, 3, args, &newMe);
-        napi_set_element(env, newMe, 0, _new_raw);
-        return newMe;
+        uint8_t* data = (uint8_t*)buffer + start;
+        if (isCRC32C) {
+                napi_create_uint32(env, updateCRC32C(0xFFFFFFFF, data, end - start) ^ 0xFFFFFFFF, &result);
+        } else if (isWyhash) {
+                napi_create_bigint_uint64(env, wyhash(data, end - start, 0), &result);
+        } else {
+                napi_create_bigint_uint64(env, xxh3(data, end - start), &result);
+        }
+        return result;
 }
 
-napi_value Count(napi_env env, napi_callback_info info){
+napi_value ByteLength(napi_env env, napi_callback_info info){
+        size_t argsLength = 1;
+        napi_value args[1];
+
         napi_value me;
-        napi_get_cb_info(env, info, 0, 0, &me, 0);
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
 
         uint16_t* buffer;
         int64_t* metadata;
 
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
-        uint8_t mode = 0; //0: nornal, 1: appending, 2: integer, 3: prefloat, 4: float
-        int64_t sum = 0, i, length = metadata[1] / 2;
-        for (i = 0; i < length; ++i) {
-                int64_t v = buffer[i];
-                if (v >= 48 && v <= 57) {
-                        switch (mode) {
-                        case 0:
-                                mode = 2;
-                                break;
-                        case 3:
-                                mode = 4;
-                                break;
-                        default:
-                                break;
-                        }
-                } else if ((v >= 65 && v <= 90) || (v >= 97 && v <= 122)) {
-                        switch (mode) {
-                        case 0:
-                                mode = 1;
-                                break;
-                        case 2:
-                                mode = 1;
-                                break;
-                        case 3:
-                        case 4:
-                                ++sum;
-                                mode = 1;
-                                break;
-                        default:
-                                break;
-                        }
-                } else if (v > 127) {
-                        switch (mode) {
-                        case 0:
-                                ++sum;
-                                break;
-                        default:
-                                sum += 2;
-                                mode = 0;
-                                break;
-                        }
-                } else {
-                        switch (mode) {
-                        case 0:
-                                break;
-                        case 2:
-                                if (v == 46) {
-                                        mode = 3;
-                                } else {
-                                        ++sum;
-                                        mode = 0;
-                                }
-                                break;
-                        default:
-                                ++sum;
-                                mode = 0;
-                                break;
-                        }
+        char encoding[16] = "utf8";
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                if (type == napi_string) {
+                        napi_get_value_string_utf8(env, args[0], encoding, 16, 0);
                 }
         }
-        if (mode != 0) {
-                ++sum;
+
+        int64_t byteLength;
+        if (strcmp(encoding, "utf16le") == 0 || strcmp(encoding, "utf-16le") == 0 || strcmp(encoding, "ucs2") == 0 || strcmp(encoding, "ucs-2") == 0) {
+                byteLength = metadata[1];
+        } else if (strcmp(encoding, "latin1") == 0 || strcmp(encoding, "binary") == 0 || strcmp(encoding, "ascii") == 0) {
+                byteLength = metadata[1] / 2;
+        } else {
+                TextStatistics statistics;
+                measureUTF16(buffer, metadata[1] / 2, false, &statistics);
+                byteLength = statistics.utf8Length;
         }
+
         napi_value result;
-        napi_create_int64(env, sum, &result);
+        napi_create_int64(env, byteLength, &result);
         return result;
 }
 
@@ -1490,37 +3614,22 @@ napi_value EqualsIgnoreCase(napi_env env, napi_callback_info info){
 
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
+        uint16_t stackBuffer[stackBufferSize];
         uint16_t* dataBuffer;
         int64_t dataLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
+        getUTF16FromOutsideForComparison(env, me, args[0], stackBuffer, metadata[1], &dataBuffer, &dataLength, &freeAble);
         if (dataLength != metadata[1]) {
-                if(freeAble) {
-                        free(dataBuffer);
-                }
                 return createFalse(env);
         }
-        int64_t i, length = metadata[1] / 2;
-        for (i = 0; i < length; ++i) {
-                uint16_t v1 = buffer[i];
-                uint16_t v2 = dataBuffer[i];
-                if (v1 >= 97 && v1 <= 122) {
-                        v1 -= 32;
-                }
-                if (v2 >= 97 && v2 <= 122) {
-                        v2 -= 32;
-                }
-                if (v1 != v2) {
-                        if(freeAble) {
-                                free(dataBuffer);
-                        }
-                        return createFalse(env);
-                }
-        }
+        int c = compareUTF16IgnoreCase(buffer, metadata[1] / 2, dataBuffer, dataLength / 2);
         if(freeAble) {
                 free(dataBuffer);
         }
-        return createTrue(env);
+        if(c == 0) {
+                return createTrue(env);
+        }
+        return createFalse(env);
 }
 
 napi_value Equals(napi_env env, napi_callback_info info){
@@ -1539,26 +3648,80 @@ napi_value Equals(napi_env env, napi_callback_info info){
 
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
+        uint16_t stackBuffer[stackBufferSize];
         uint16_t* dataBuffer;
         int64_t dataLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
+        getUTF16FromOutsideForComparison(env, me, args[0], stackBuffer, metadata[1], &dataBuffer, &dataLength, &freeAble);
         if (dataLength != metadata[1]) {
-                if(freeAble) {
-                        free(dataBuffer);
-                }
                 return createFalse(env);
         }
-        int64_t c = memcmp(dataBuffer, buffer, dataLength);
+        int64_t c = findMismatch(buffer, dataBuffer, dataLength / 2);
         if(freeAble) {
                 free(dataBuffer);
         }
-        if(c == 0) {
+        if(c == dataLength / 2) {
                 return createTrue(env);
         }
         return createFalse(env);
 }
 
+napi_value Compare(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        uint16_t stackBuffer[stackBufferSize];
+        uint16_t* dataBuffer = stackBuffer;
+        int64_t dataLength = 0;
+        bool freeAble = false;
+        if(argsLength > 0) {
+                getUTF16FromOutsideForComparison(env, me, args[0], stackBuffer, -1, &dataBuffer, &dataLength, &freeAble);
+        }
+        int c = compareUTF16(buffer, metadata[1] / 2, dataBuffer, dataLength / 2);
+        if(freeAble) {
+                free(dataBuffer);
+        }
+        napi_value result;
+        napi_create_int32(env, c, &result);
+        return result;
+}
+
+napi_value CompareIgnoreCase(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        uint16_t stackBuffer[stackBufferSize];
+        uint16_t* dataBuffer = stackBuffer;
+        int64_t dataLength = 0;
+        bool freeAble = false;
+        if(argsLength > 0) {
+                getUTF16FromOutsideForComparison(env, me, args[0], stackBuffer, -1, &dataBuffer, &dataLength, &freeAble);
+        }
+        int c = compareUTF16IgnoreCase(buffer, metadata[1] / 2, dataBuffer, dataLength / 2);
+        if(freeAble) {
+                free(dataBuffer);
+        }
+        napi_value result;
+        napi_create_int32(env, c, &result);
+        return result;
+}
+
 napi_value StartsWith(napi_env env, napi_callback_info info){
         napi_value me;
 
@@ -1575,21 +3738,22 @@ napi_value StartsWith(napi_env env, napi_callback_info info){
 
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
+        uint16_t stackBuffer[stackBufferSize];
         uint16_t* dataBuffer;
         int64_t dataLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
+        getUTF16FromOutsideForComparison(env, me, args[0], stackBuffer, -1, &dataBuffer, &dataLength, &freeAble);
         if (dataLength > metadata[1]) {
                 if(freeAble) {
                         free(dataBuffer);
                 }
                 return createFalse(env);
         }
-        int64_t c = memcmp(dataBuffer, buffer, dataLength);
+        int64_t c = findMismatch(buffer, dataBuffer, dataLength / 2);
         if(freeAble) {
                 free(dataBuffer);
         }
-        if(c == 0) {
+        if(c == dataLength / 2) {
                 return createTrue(env);
         }
         return createFalse(env);
@@ -1611,21 +3775,22 @@ napi_value EndsWith(napi_env env, napi_callback_info info){
 
         getBufferAndMetaData(env, me, &buffer, &metadata);
 
+        uint16_t stackBuffer[stackBufferSize];
         uint16_t* dataBuffer;
         int64_t dataLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
+        getUTF16FromOutsideForComparison(env, me, args[0], stackBuffer, -1, &dataBuffer, &dataLength, &freeAble);
         if (dataLength > metadata[1]) {
                 if(freeAble) {
                         free(dataBuffer);
                 }
                 return createFalse(env);
         }
-        int64_t c = memcmp(dataBuffer, buffer + ((metadata[1] - dataLength) / 2), dataLength);
+        int64_t c = findMismatch(buffer + ((metadata[1] - dataLength) / 2), dataBuffer, dataLength / 2);
         if(freeAble) {
                 free(dataBuffer);
         }
-        if(c == 0) {
+        if(c == dataLength / 2) {
                 return createTrue(env);
         }
         return createFalse(env);
@@ -1665,10 +3830,16 @@ napi_value IndexOf(napi_env env, napi_callback_info info){
         uint16_t* dataBuffer;
         int64_t dataLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
+        getUTF16FromOutside(env, me, args[0], &dataBuffer, &dataLength, &freeAble);
 
         napi_value result;
-        result = boyerMooreMagicLen(env, buffer, metadata[1] / 2, dataBuffer, dataLength / 2, offset / 2, limit);
+        if (dataLength == 2) {
+                result = indexOfCodeUnit(env, buffer, metadata[1] / 2, dataBuffer[0], offset / 2, limit);
+        } else {
+                result = boyerMooreMagicLen(env, buffer, metadata[1] / 2, dataBuffer, dataLength / 2, offset / 2, limit);
+        }
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, metadata[1] - offset);
 
         if(freeAble) {
                 free(dataBuffer);
@@ -1722,6 +3893,8 @@ napi_value IndexOfRegExp(napi_env env, napi_callback_info info){
         t_args[1] = s;
         t_args[2] = o;
         t_args[3] = l;
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, metadata[1] - offset);
         napi_call_function(env, me, RegExpSearch, 4, t_args, &result);
         return result;
 }
@@ -1757,14 +3930,139 @@ napi_value IndexOfSkip(napi_env env, napi_callback_info info){
                 napi_get_value_int64(env, args[2], &limit);
         }
 
-        uint16_t* dataBuffer;
-        int64_t dataLength;
-        bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
-
-        napi_value result;
-        result = boyerMooreMagicLenSkip(env, buffer, metadata[1] / 2, dataBuffer, dataLength / 2, offset / 2, limit);
-
+        uint16_t* dataBuffer;
+        int64_t dataLength;
+        bool freeAble;
+        getUTF16FromOutside(env, me, args[0], &dataBuffer, &dataLength, &freeAble);
+
+        napi_value result;
+        if (dataLength == 2) {
+                result = indexOfCodeUnit(env, buffer, metadata[1] / 2, dataBuffer[0], offset / 2, limit);
+        } else {
+                result = boyerMooreMagicLenSkip(env, buffer, metadata[1] / 2, dataBuffer, dataLength / 2, offset / 2, limit);
+        }
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, metadata[1] - offset);
+
+        if(freeAble) {
+                free(dataBuffer);
+        }
+        return result;
+}
+
+napi_value Split(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t length = metadata[1] / 2;
+
+        napi_value result, token;
+        napi_valuetype type = napi_undefined;
+        if (argsLength > 0) {
+                napi_typeof(env, args[0], &type);
+        }
+        if (type == napi_object) {
+                napi_value global, regExp;
+                bool isRegExp;
+                napi_get_global(env, &global);
+                napi_get_named_property(env, global, "RegExp", &regExp);
+                napi_instanceof(env, args[0], regExp, &isRegExp);
+                if (isRegExp) {
+                        // a regular expression is left to String.prototype.split
+                        napi_value text, function;
+                        napi_create_string_utf16(env, buffer, length, &text);
+                        napi_get_named_property(env, text, "split", &function);
+                        napi_call_function(env, text, function, argsLength, args, &result);
+                        return result;
+                }
+        }
+
+        // like String.prototype.split, the limit is converted to uint32 and an undefined limit means no limit
+        int64_t limit = 4294967295;
+        if (argsLength > 1) {
+                napi_valuetype limitType;
+                napi_typeof(env, args[1], &limitType);
+                if (limitType != napi_undefined) {
+                        napi_value _limit;
+                        uint32_t limit32 = 0;
+                        napi_coerce_to_number(env, args[1], &_limit);
+                        napi_get_value_uint32(env, _limit, &limit32);
+                        limit = limit32;
+                }
+        }
+
+        napi_create_array(env, &result);
+        if (limit == 0) {
+                return result;
+        }
+
+        if (type == napi_undefined) {
+                napi_create_string_utf16(env, buffer, length, &token);
+                napi_set_element(env, result, 0, token);
+                return result;
+        }
+
+        uint16_t* dataBuffer;
+        int64_t dataLength;
+        bool freeAble;
+        getUTF16FromOutside(env, me, args[0], &dataBuffer, &dataLength, &freeAble);
+        dataLength /= 2;
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, length * 2);
+
+        int64_t count = 0;
+        if (dataLength == 0) {
+                for (; count < length && count < limit; ++count) {
+                        napi_create_string_utf16(env, buffer + count, 1, &token);
+                        napi_set_element(env, result, (uint32_t)count, token);
+                }
+        } else {
+                int64_t start = 0;
+                if (dataLength == 1) {
+                        int64_t positions[64];
+                        while (count < limit) {
+                                int64_t want = limit - count;
+                                int64_t found = findCodeUnits(buffer, start, length, dataBuffer[0], want < 64 ? want : 64, positions);
+                                int64_t i;
+                                for (i = 0; i < found; ++i) {
+                                        napi_create_string_utf16(env, buffer + start, positions[i] - 1 - start, &token);
+                                        napi_set_element(env, result, (uint32_t)count++, token);
+                                        start = positions[i];
+                                }
+                                if (found < 64) {
+                                        break;
+                                }
+                        }
+                } else {
+                        int64_t* resultList;
+                        int64_t resultListLength;
+                        int64_t maxMatches = length / dataLength;
+                        boyerMooreMagicLenSkipPure(buffer, length, dataBuffer, dataLength, 0, limit < maxMatches ? limit : maxMatches, &resultList, &resultListLength);
+                        int64_t i;
+                        for (i = 0; i < resultListLength; ++i) {
+                                napi_create_string_utf16(env, buffer + start, resultList[i] - start, &token);
+                                napi_set_element(env, result, (uint32_t)count++, token);
+                                start = resultList[i] + dataLength;
+                        }
+                        if (resultListLength >= 0) {
+                                free(resultList);
+                        }
+                }
+                // the rest after the last separator is the last string
+                if (count < limit) {
+                        napi_create_string_utf16(env, buffer + start, length - start, &token);
+                        napi_set_element(env, result, (uint32_t)count, token);
+                }
+        }
+
         if(freeAble) {
                 free(dataBuffer);
         }
@@ -1805,10 +4103,12 @@ napi_value LastIndexOf(napi_env env, napi_callback_info info){
         uint16_t* dataBuffer;
         int64_t dataLength;
         bool freeAble;
-        getUTF16FromOutside(env, args[0], &dataBuffer, &dataLength, &freeAble);
+        getUTF16FromOutside(env, me, args[0], &dataBuffer, &dataLength, &freeAble);
 
         napi_value result;
         result = boyerMooreMagicLenRev(env, buffer, metadata[1] / 2, dataBuffer, dataLength / 2, offset / 2, limit);
+        countStat(env, me, statSearches, 1);
+        countStat(env, me, statBytesScanned, offset);
 
         if(freeAble) {
                 free(dataBuffer);
@@ -1832,7 +4132,104 @@ napi_value CharAt(napi_env env, napi_callback_info info){
         getRealIndex(env, metadata, args[0], &index);
 
         napi_value result;
-        napi_create_string_utf16(env, buffer + index, 1, &result);
+        napi_create_string_utf16(env, buffer + index / 2, 1, &result);
+        return result;
+};
+
+// Like String.prototype.charCodeAt, but a negative index counts from the end. An index out of range gives NaN.
+napi_value CharCodeAt(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t index;
+        getRealIndex(env, metadata, args[0], &index);
+
+        napi_value result;
+        if (index >= metadata[1]) {
+                napi_create_double(env, NAN, &result);
+        } else {
+                napi_create_uint32(env, buffer[index / 2], &result);
+        }
+        return result;
+};
+
+// Like String.prototype.codePointAt, but a negative index counts from the end. An index out of range gives undefined.
+napi_value CodePointAt(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t index;
+        getRealIndex(env, metadata, args[0], &index);
+
+        napi_value result;
+        if (index >= metadata[1]) {
+                napi_get_undefined(env, &result);
+                return result;
+        }
+        int64_t i = index / 2, length = metadata[1] / 2;
+        uint32_t codePoint = buffer[i];
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && i + 1 < length && buffer[i + 1] >= 0xDC00 && buffer[i + 1] <= 0xDFFF) {
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (buffer[i + 1] - 0xDC00);
+        }
+        napi_create_uint32(env, codePoint, &result);
+        return result;
+};
+
+// Copy the code units from start into a Uint16Array, as many as fit. Return the number of them.
+napi_value ReadInto(napi_env env, napi_callback_info info){
+        napi_value me;
+
+        size_t argsLength = 2;
+        napi_value args[2];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        bool isTypedArray = false;
+        napi_typedarray_type type;
+        size_t elementCount;
+        uint16_t* target;
+        if (argsLength > 0) {
+                napi_is_typedarray(env, args[0], &isTypedArray);
+        }
+        if (isTypedArray) {
+                napi_get_typedarray_info(env, args[0], &type, &elementCount, (void**)&target, 0, 0);
+        }
+        if (!isTypedArray || type != napi_uint16_array) {
+                napi_throw_type_error(env, 0, "The target has to be a Uint16Array.");
+                return 0;
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+
+        getBufferAndMetaData(env, me, &buffer, &metadata);
+
+        int64_t start = 0;
+        if (argsLength > 1) {
+                getRealIndex(env, metadata, args[1], &start);
+        }
+        int64_t count = min((int64_t)elementCount, (metadata[1] - start) / 2);
+        if (count > 0) {
+                memcpy(target, (uint8_t*)buffer + start, count * 2);
+        }
+
+        napi_value result;
+        napi_create_int64(env, count, &result);
         return result;
 };
 
@@ -1887,41 +4284,537 @@ napi_value constructor(napi_env env, napi_callback_info info){
                 freeAble = false;
                 break;
         case 1:
-                getUTF16FromOutside(env, args[0], &contentBuffer, &contentLength, &freeAble);
+                getUTF16FromOutside(env, me, args[0], &contentBuffer, &contentLength, &freeAble);
                 initialCapacity = blockSize / 2;
                 break;
         case 2:
-                getUTF16FromOutside(env, args[0], &contentBuffer, &contentLength, &freeAble);
+                getUTF16FromOutside(env, me, args[0], &contentBuffer, &contentLength, &freeAble);
                 napi_get_value_int64(env, args[1], &initialCapacity);
                 break;
         default:
                 return me;
         }
-        int64_t capacityLength = max(initialCapacity * 2, contentLength);
-        int64_t count = (capacityLength + blockSize - 1) / blockSize;
+        int64_t capacityLength = max(multiplySizes(max(initialCapacity, 0), 2), contentLength);
+        int64_t maxCapacity = getInstanceData(env)->maxCapacity;
+        if (maxCapacity == 0) {
+                maxCapacity = maxSize;
+        }
+        if (contentLength > maxCapacity) {
+                if(freeAble) {
+                        free(contentBuffer);
+                }
+                throwCapacityError(env);
+                return 0;
+        }
+        int64_t count = (min(capacityLength, maxCapacity) + blockSize - 1) / blockSize;
         if(count == 0) {
                 count = 1;
         }
-        int64_t capacity = count * blockSize;
+        int64_t capacity = min(count * blockSize, maxCapacity);
 
         napi_value _raw;
         uint8_t* raw;
-        napi_create_buffer(env, 16 + capacity, (void**)(&raw), &_raw);
+        if (!createStorage(env, capacity, &raw, &_raw)) {
+                if(freeAble) {
+                        free(contentBuffer);
+                }
+                return 0;
+        }
 
         int64_t* metadata = (int64_t*)raw;
+        memset(metadata, 0, headerSize);
         metadata[0] = capacity;
         metadata[1] = contentLength;
+        metadata[8] = -1;
 
         napi_set_element(env, me, 0, _raw);
 
-        memcpy(raw + 16, contentBuffer, contentLength);
+        memcpy(raw + headerSize, contentBuffer, contentLength);
         if(freeAble) {
                 free(contentBuffer);
         }
         return me;
 }
 
+napi_value viewConstructor(napi_env env, napi_callback_info info){
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+        return me;
+}
+
+// Read a capacity in characters for setMaxCapacity, 0 (or undefined, Infinity) means no limit. Return -1 with a RangeError thrown if it is invalid.
+int64_t getMaxCapacityArgument(napi_env env, size_t argsLength, napi_value* args) {
+        int64_t maxCapacity = 0;
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                if (type != napi_undefined && type != napi_null) {
+                        double value;
+                        napi_value _value;
+                        napi_coerce_to_number(env, args[0], &_value);
+                        napi_get_value_double(env, _value, &value);
+                        if (!(value >= 0)) {
+                                napi_throw_range_error(env, 0, "The maxCapacity has to be a non-negative number");
+                                return -1;
+                        }
+                        maxCapacity = value < maxSize / 2 ? (int64_t)value * 2 : 0;
+                }
+        }
+        return maxCapacity;
+}
+
+napi_value createMaxCapacity(napi_env env, int64_t maxCapacity) {
+        napi_value result;
+        if (maxCapacity == 0 || maxCapacity >= maxSize) {
+                napi_get_global(env, &result);
+                napi_get_named_property(env, result, "Infinity", &result);
+        } else {
+                napi_create_int64(env, maxCapacity / 2, &result);
+        }
+        return result;
+}
+
+napi_value SetMaxCapacity(napi_env env, napi_callback_info info) {
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        int64_t maxCapacity = getMaxCapacityArgument(env, argsLength, args);
+        if (maxCapacity < 0) {
+                return 0;
+        }
+
+        uint16_t* buffer;
+        int64_t* metadata;
+        getWritableTailBufferAndMetaData(env, me, &buffer, &metadata);
+        if (maxCapacity > 0 && metadata[3] + metadata[1] > maxCapacity) {
+                throwCapacityError(env);
+                return 0;
+        }
+        if (maxCapacity > 0 && metadata[3] + metadata[0] > maxCapacity) {
+                // shrink the tail buffer, so that the capacity never exceeds the limit
+                napi_value _raw;
+                uint8_t* raw;
+                int64_t newCapacity = maxCapacity - metadata[3];
+                if (!createStorage(env, newCapacity, &raw, &_raw)) {
+                        return 0;
+                }
+                memcpy(raw, metadata, headerSize);
+                memcpy(raw + headerSize, buffer, metadata[1]);
+                metadata = (int64_t*)raw;
+                metadata[0] = newCapacity;
+                metadata[4] = 0;
+                ++metadata[11];
+                napi_set_element(env, me, 0, _raw);
+        }
+        metadata[10] = maxCapacity;
+        return me;
+}
+
+napi_value MaxCapacity(napi_env env, napi_callback_info info) {
+        napi_value me;
+        napi_get_cb_info(env, info, 0, 0, &me, 0);
+
+        int64_t* metadata;
+        getMetaData(env, me, &metadata);
+        return createMaxCapacity(env, getMaxCapacity(env, metadata));
+}
+
+napi_value SetGlobalMaxCapacity(napi_env env, napi_callback_info info) {
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, 0, 0);
+
+        int64_t maxCapacity = getMaxCapacityArgument(env, argsLength, args);
+        if (maxCapacity < 0) {
+                return 0;
+        }
+        getInstanceData(env)->maxCapacity = maxCapacity;
+        napi_value undefined;
+        napi_get_undefined(env, &undefined);
+        return undefined;
+}
+
+napi_value GlobalMaxCapacity(napi_env env, napi_callback_info info) {
+        return createMaxCapacity(env, getInstanceData(env)->maxCapacity);
+}
+
+napi_value ScratchArenaStats(napi_env env, napi_callback_info info) {
+        ScratchArena* arena = getScratchArena(env);
+        napi_value result, value;
+        napi_create_object(env, &result);
+        napi_create_int64(env, arena->capacity, &value);
+        napi_set_named_property(env, result, "capacity", value);
+        napi_create_int64(env, arena->highWaterMark, &value);
+        napi_set_named_property(env, result, "highWaterMark", value);
+        napi_create_int64(env, arena->growths, &value);
+        napi_set_named_property(env, result, "growths", value);
+        napi_create_int64(env, arena->overflows, &value);
+        napi_set_named_property(env, result, "overflows", value);
+        return result;
+}
+
+// Switch to the kernel table with the name given, if any, then describe the selected table and the ones this CPU supports.
+napi_value Kernels(napi_env env, napi_callback_info info) {
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, 0, 0);
+
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                if (type != napi_undefined) {
+                        char name[16];
+                        size_t nameLength;
+                        napi_value _name;
+                        napi_coerce_to_string(env, args[0], &_name);
+                        napi_get_value_string_utf8(env, _name, name, sizeof(name), &nameLength);
+                        if (!selectKernels(name)) {
+                                napi_throw_range_error(env, 0, "The kernel table is unknown or not supported by this CPU.");
+                                return 0;
+                        }
+                }
+        }
+
+        napi_value result, value, supported;
+        napi_create_object(env, &result);
+        napi_create_string_utf8(env, selectedKernels()->name, NAPI_AUTO_LENGTH, &value);
+        napi_set_named_property(env, result, "selected", value);
+        napi_create_array(env, &supported);
+        int i;
+        uint32_t supportedLength = 0;
+        for (i = 0; i < kernelTablesLength; ++i) {
+                if (isKernelTableSupported(kernelTables[i])) {
+                        napi_create_string_utf8(env, kernelTables[i]->name, NAPI_AUTO_LENGTH, &value);
+                        napi_set_element(env, supported, supportedLength++, value);
+                }
+        }
+        napi_set_named_property(env, result, "supported", supported);
+        return result;
+}
+
+// Read the `reset` option of runtimeStats, globalStats and profilingReport.
+bool getResetOption(napi_env env, size_t argsLength, napi_value* args) {
+        if (argsLength == 0) {
+                return false;
+        }
+        napi_valuetype type;
+        napi_typeof(env, args[0], &type);
+        if (type != napi_object) {
+                return false;
+        }
+        bool hasReset;
+        napi_has_named_property(env, args[0], "reset", &hasReset);
+        if (!hasReset) {
+                return false;
+        }
+        napi_value _reset;
+        bool reset;
+        napi_get_named_property(env, args[0], "reset", &_reset);
+        napi_coerce_to_bool(env, _reset, &_reset);
+        napi_get_value_bool(env, _reset, &reset);
+        return reset;
+}
+
+#if defined(RUNTIME_STATS)
+napi_value createRuntimeStats(napi_env env, int64_t* stats) {
+        napi_value result, conversions, value;
+        napi_create_object(env, &result);
+        napi_create_int64(env, stats[statReallocations], &value);
+        napi_set_named_property(env, result, "reallocations", value);
+        napi_create_int64(env, stats[statBytesCopied], &value);
+        napi_set_named_property(env, result, "bytesCopied", value);
+        napi_create_int64(env, stats[statBytesMoved], &value);
+        napi_set_named_property(env, result, "bytesMoved", value);
+        napi_create_int64(env, stats[statSearches], &value);
+        napi_set_named_property(env, result, "searches", value);
+        napi_create_int64(env, stats[statBytesScanned], &value);
+        napi_set_named_property(env, result, "bytesScanned", value);
+        napi_create_int64(env, stats[statPeakCapacity], &value);
+        napi_set_named_property(env, result, "peakCapacity", value);
+        napi_create_object(env, &conversions);
+        napi_create_int64(env, stats[statConvertedStrings], &value);
+        napi_set_named_property(env, conversions, "string", value);
+        napi_create_int64(env, stats[statConvertedPrimitives], &value);
+        napi_set_named_property(env, conversions, "primitive", value);
+        napi_create_int64(env, stats[statConvertedStringBuilders], &value);
+        napi_set_named_property(env, conversions, "stringBuilder", value);
+        napi_create_int64(env, stats[statConvertedBuffers], &value);
+        napi_set_named_property(env, conversions, "buffer", value);
+        napi_create_int64(env, stats[statConvertedStreams], &value);
+        napi_set_named_property(env, conversions, "stream", value);
+        napi_create_int64(env, stats[statConvertedObjects], &value);
+        napi_set_named_property(env, conversions, "object", value);
+        napi_set_named_property(env, result, "conversions", conversions);
+        return result;
+}
+#endif
+
+napi_value TrackRuntimeStats(napi_env env, napi_callback_info info) {
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+#if defined(RUNTIME_STATS)
+        bool enable = true;
+        if (argsLength > 0) {
+                napi_value _enable;
+                napi_coerce_to_bool(env, args[0], &_enable);
+                napi_get_value_bool(env, _enable, &enable);
+        }
+
+        napi_value _stats;
+        int64_t* stats;
+        napi_get_element(env, me, 3, &_stats);
+        bool tracked = napi_get_buffer_info(env, _stats, (void**)(&stats), 0) == napi_ok;
+        if (enable && !tracked) {
+                int64_t* metadata;
+                getMetaData(env, me, &metadata);
+                napi_create_buffer(env, statsLength * sizeof(int64_t), (void**)(&stats), &_stats);
+                memset(stats, 0, statsLength * sizeof(int64_t));
+                stats[statPeakCapacity] = metadata[3] + metadata[0];
+                napi_set_element(env, me, 3, _stats);
+                ++getInstanceData(env)->trackedInstances;
+        } else if (!enable && tracked) {
+                napi_value undefined;
+                napi_get_undefined(env, &undefined);
+                napi_set_element(env, me, 3, undefined);
+        }
+#endif
+        return me;
+}
+
+napi_value RuntimeStats(napi_env env, napi_callback_info info) {
+        napi_value me;
+
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, &me, 0);
+
+        napi_value result;
+        napi_get_null(env, &result);
+#if defined(RUNTIME_STATS)
+        napi_value _stats;
+        int64_t* stats;
+        napi_get_element(env, me, 3, &_stats);
+        if (napi_get_buffer_info(env, _stats, (void**)(&stats), 0) == napi_ok) {
+                result = createRuntimeStats(env, stats);
+                if (getResetOption(env, argsLength, args)) {
+                        int64_t* metadata;
+                        getMetaData(env, me, &metadata);
+                        memset(stats, 0, statsLength * sizeof(int64_t));
+                        stats[statPeakCapacity] = metadata[3] + metadata[0];
+                }
+        }
+#endif
+        return result;
+}
+
+napi_value GlobalStats(napi_env env, napi_callback_info info) {
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, 0, 0);
+
+        napi_value result;
+        napi_get_null(env, &result);
+#if defined(RUNTIME_STATS)
+        InstanceData* data = getInstanceData(env);
+        result = createRuntimeStats(env, data->stats);
+        if (getResetOption(env, argsLength, args)) {
+                memset(data->stats, 0, sizeof(data->stats));
+        }
+#endif
+        return result;
+}
+
+#if defined(PROFILING)
+const char* sizeClassNames[sizeClassesLength] = {"64", "1024", "16384", "262144", "4194304", "+Inf"};
+
+typedef struct {
+        char* data;
+        size_t length;
+        size_t capacity;
+} TextOutput;
+
+void printText(TextOutput* output, const char* format, ...) {
+        va_list args;
+        for (;;) {
+                va_start(args, format);
+                int n = vsnprintf(output->data + output->length, output->capacity - output->length, format, args);
+                va_end(args);
+                if (n < 0) {
+                        return;
+                }
+                if (output->length + n < output->capacity) {
+                        output->length += n;
+                        return;
+                }
+                output->capacity = (output->length + n + 1) * 2;
+                output->data = (char*)realloc(output->data, output->capacity);
+        }
+}
+
+napi_value createProfilingReport(napi_env env, InstanceData* data) {
+        napi_value result, methods, value;
+        napi_create_object(env, &result);
+        napi_get_boolean(env, data->profiling, &value);
+        napi_set_named_property(env, result, "enabled", value);
+        napi_create_object(env, &methods);
+        int64_t i;
+        for (i = 0; i < data->profiledMethodsLength; ++i) {
+                ProfiledMethod* profiled = data->profiledMethods + i;
+                if (profiled->histograms == NULL) {
+                        continue;
+                }
+                napi_value sizeClasses = NULL;
+                int sizeClass;
+                for (sizeClass = 0; sizeClass < sizeClassesLength; ++sizeClass) {
+                        Histogram* histogram = profiled->histograms + sizeClass;
+                        if (histogram->count == 0) {
+                                continue;
+                        }
+                        if (sizeClasses == NULL) {
+                                napi_create_object(env, &sizeClasses);
+                                napi_set_named_property(env, methods, profiled->name, sizeClasses);
+                        }
+                        napi_value _histogram, buckets;
+                        napi_create_object(env, &_histogram);
+                        napi_create_int64(env, histogram->count, &value);
+                        napi_set_named_property(env, _histogram, "count", value);
+                        napi_create_int64(env, histogram->sum, &value);
+                        napi_set_named_property(env, _histogram, "sum", value);
+                        napi_create_int64(env, histogram->max, &value);
+                        napi_set_named_property(env, _histogram, "max", value);
+                        napi_create_array_with_length(env, histogramLength, &buckets);
+                        int bucket;
+                        for (bucket = 0; bucket < histogramLength; ++bucket) {
+                                napi_create_int64(env, histogram->buckets[bucket], &value);
+                                napi_set_element(env, buckets, bucket, value);
+                        }
+                        napi_set_named_property(env, _histogram, "buckets", buckets);
+                        napi_set_named_property(env, sizeClasses, sizeClassNames[sizeClass], _histogram);
+                }
+        }
+        napi_set_named_property(env, result, "methods", methods);
+        return result;
+}
+
+// The histograms in the Prometheus text format, in seconds
+napi_value createPrometheusProfilingReport(napi_env env, InstanceData* data) {
+        TextOutput output = {(char*)malloc(4096), 0, 4096};
+        printText(&output, "# HELP stringbuilder_method_duration_seconds The time of StringBuilder method calls, by the length of the text in code units.\n# TYPE stringbuilder_method_duration_seconds histogram\n");
+        int64_t i;
+        for (i = 0; i < data->profiledMethodsLength; ++i) {
+                ProfiledMethod* profiled = data->profiledMethods + i;
+                if (profiled->histograms == NULL) {
+                        continue;
+                }
+                int sizeClass;
+                for (sizeClass = 0; sizeClass < sizeClassesLength; ++sizeClass) {
+                        Histogram* histogram = profiled->histograms + sizeClass;
+                        if (histogram->count == 0) {
+                                continue;
+                        }
+                        const char* name = profiled->name;
+                        const char* size = sizeClassNames[sizeClass];
+                        int64_t cumulative = 0;
+                        int bucket;
+                        for (bucket = 0; bucket < histogramLength - 1; ++bucket) {
+                                cumulative += histogram->buckets[bucket];
+                                printText(&output, "stringbuilder_method_duration_seconds_bucket{method=\"%s\",size=\"%s\",le=\"%.9g\"} %lld\n", name, size, (double)(2LL << bucket) / 1e9, (long long)cumulative);
+                        }
+                        printText(&output, "stringbuilder_method_duration_seconds_bucket{method=\"%s\",size=\"%s\",le=\"+Inf\"} %lld\n", name, size, (long long)histogram->count);
+                        printText(&output, "stringbuilder_method_duration_seconds_sum{method=\"%s\",size=\"%s\"} %.9f\n", name, size, (double)histogram->sum / 1e9);
+                        printText(&output, "stringbuilder_method_duration_seconds_count{method=\"%s\",size=\"%s\"} %lld\n", name, size, (long long)histogram->count);
+                }
+        }
+        napi_value result;
+        napi_create_string_utf8(env, output.data, output.length, &result);
+        free(output.data);
+        return result;
+}
+#endif
+
+napi_value EnableProfiling(napi_env env, napi_callback_info info) {
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, 0, 0);
+
+#if defined(PROFILING)
+        bool enable = true;
+        if (argsLength > 0) {
+                napi_value _enable;
+                napi_coerce_to_bool(env, args[0], &_enable);
+                napi_get_value_bool(env, _enable, &enable);
+        }
+        enableProfiling(env, getInstanceData(env), enable);
+        return createTrue(env);
+#else
+        return createFalse(env);
+#endif
+}
+
+napi_value ProfilingReport(napi_env env, napi_callback_info info) {
+        size_t argsLength = 1;
+        napi_value args[1];
+        napi_get_cb_info(env, info, &argsLength, args, 0, 0);
+
+        napi_value result;
+        napi_get_null(env, &result);
+#if defined(PROFILING)
+        InstanceData* data = getInstanceData(env);
+        bool prometheus = false;
+        if (argsLength > 0) {
+                napi_valuetype type;
+                napi_typeof(env, args[0], &type);
+                bool hasFormat = false;
+                if (type == napi_object) {
+                        napi_has_named_property(env, args[0], "format", &hasFormat);
+                }
+                if (hasFormat) {
+                        napi_value format;
+                        char formatName[16];
+                        size_t formatNameLength;
+                        napi_get_named_property(env, args[0], "format", &format);
+                        napi_coerce_to_string(env, format, &format);
+                        napi_get_value_string_utf8(env, format, formatName, sizeof(formatName), &formatNameLength);
+                        if (strcmp(formatName, "prometheus") == 0) {
+                                prometheus = true;
+                        } else if (strcmp(formatName, "json") != 0) {
+                                napi_throw_range_error(env, 0, "The format has to be \"json\" or \"prometheus\".");
+                                return 0;
+                        }
+                }
+        }
+        result = prometheus ? createPrometheusProfilingReport(env, data) : createProfilingReport(env, data);
+        if (getResetOption(env, argsLength, args)) {
+                int64_t i;
+                for (i = 0; i < data->profiledMethodsLength; ++i) {
+                        if (data->profiledMethods[i].histograms != NULL) {
+                                memset(data->profiledMethods[i].histograms, 0, sizeClassesLength * sizeof(Histogram));
+                        }
+                }
+        }
+#endif
+        return result;
+}
+
 napi_value Init (napi_env env, napi_value exports) {
+        InstanceData* data = (InstanceData*)calloc(1, sizeof(InstanceData));
+        // an empty arena (if its block cannot be allocated) grows on the first call that needs it
+        data->arena.data = (uint8_t*)malloc(scratchArenaInitialCapacity);
+        if (data->arena.data != NULL) {
+                data->arena.capacity = scratchArenaInitialCapacity;
+                int64_t externalMemory;
+                napi_adjust_external_memory(env, scratchArenaInitialCapacity, &externalMemory);
+        }
+        napi_set_instance_data(env, data, finalizeInstanceData, 0);
+        initializeKernels();
+
         napi_property_descriptor allDesc[] = {
                 {"from", 0, from, 0, 0, 0, napi_default, 0},
                 {"_initialize", 0, initialize, 0, 0, 0, napi_default, 0}
@@ -1933,46 +4826,123 @@ napi_value Init (napi_env env, napi_value exports) {
                 {"inspect", 0, Inspect, 0, 0, 0, napi_default, 0},
                 {"toString", 0, ToString, 0, 0, 0, napi_default, 0},
                 {"toBuffer", 0, ToBuffer, 0, 0, 0, napi_default, 0},
+                {"toBuffers", 0, ToBuffers, 0, 0, 0, napi_default, 0},
+                {"segmentCount", 0, SegmentCount, 0, 0, 0, napi_default, 0},
                 {"clone", 0, Clone, 0, 0, 0, napi_default, 0},
+                {"view", 0, View, 0, 0, 0, napi_default, 0},
                 {"count", 0, Count, 0, 0, 0, napi_default, 0},
-                {"equalsIgnoreCase", 0, EqualsIgnoreCase, 0, 0, 0, napi_default, 0},
-                {"equals", 0, Equals, 0, 0, 0, napi_default, 0},
-                {"startsWith", 0, StartsWith, 0, 0, 0, napi_default, 0},
-                {"endsWith", 0, EndsWith, 0, 0, 0, napi_default, 0},
-                {"indexOf", 0, IndexOf, 0, 0, 0, napi_default, 0},
-                {"indexOfSkip", 0, IndexOfSkip, 0, 0, 0, napi_default, 0},
+                {"stats", 0, Stats, 0, 0, 0, napi_default, 0},
+                {"byteLength", 0, ByteLength, 0, 0, 0, napi_default, 0},
+                {"hash", 0, Hash, 0, 0, 0, napi_default, 0},
+                {"lineCount", 0, LineCount, 0, 0, 0, napi_default, 0},
+                {"getLine", 0, GetLine, 0, 0, 0, napi_default, 0},
+                {"lineOf", 0, LineOf, 0, 0, 0, napi_default, 0},
+                {"columnOf", 0, ColumnOf, 0, 0, 0, napi_default, 0},
+                {"equalsIgnoreCase", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)EqualsIgnoreCase},
+                {"equals", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)Equals},
+                {"compare", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)Compare},
+                {"compareIgnoreCase", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)CompareIgnoreCase},
+                {"startsWith", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)StartsWith},
+                {"endsWith", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)EndsWith},
+                {"indexOf", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)IndexOf},
+                {"indexOfSkip", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)IndexOfSkip},
                 {"indexOfRegExp", 0, IndexOfRegExp, 0, 0, 0, napi_default, 0},
-                {"lastIndexOf", 0, LastIndexOf, 0, 0, 0, napi_default, 0},
+                {"split", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)Split},
+                {"lastIndexOf", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)LastIndexOf},
                 {"charAt", 0, CharAt, 0, 0, 0, napi_default, 0},
+                {"charCodeAt", 0, CharCodeAt, 0, 0, 0, napi_default, 0},
+                {"codePointAt", 0, CodePointAt, 0, 0, 0, napi_default, 0},
+                {"readInto", 0, ReadInto, 0, 0, 0, napi_default, 0},
                 {"length", 0, Length, 0, 0, 0, napi_default, 0},
                 {"capacity", 0, Capacity, 0, 0, 0, napi_default, 0},
-                {"replace", 0, Replace, 0, 0, 0, napi_default, 0},
-                {"insert", 0, Insert, 0, 0, 0, napi_default, 0},
+                {"replace", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)Replace},
+                {"insert", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)Insert},
                 {"clear", 0, Clear, 0, 0, 0, napi_default, 0},
+                {"reset", 0, Reset, 0, 0, 0, napi_default, 0},
                 {"delete", 0, Delete, 0, 0, 0, napi_default, 0},
                 {"deleteCharAt", 0, DeleteCharAt, 0, 0, 0, napi_default, 0},
                 {"substring", 0, Substring, 0, 0, 0, napi_default, 0},
                 {"slice", 0, Substring, 0, 0, 0, napi_default, 0},
                 {"substr", 0, Substr, 0, 0, 0, napi_default, 0},
                 {"append", 0, Append, 0, 0, 0, napi_default, 0},
-                {"appendRepeat", 0, AppendRepeat, 0, 0, 0, napi_default, 0},
+                {"appendRepeat", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendRepeat},
                 {"appendLine", 0, AppendLine, 0, 0, 0, napi_default, 0},
+                {"appendTemplate", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendTemplate},
+                {"appendHtmlEscaped", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendHtmlEscaped},
+                {"appendJsonEscaped", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendJsonEscaped},
+                {"appendCsvField", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendCsvField},
+                {"appendUrlEncoded", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendUrlEncoded},
+                {"appendJSON", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)AppendJSON},
+                {"appendBase64", 0, AppendBase64, 0, 0, 0, napi_default, 0},
+                {"appendHex", 0, AppendHex, 0, 0, 0, napi_default, 0},
+                {"decodeBase64", 0, DecodeBase64, 0, 0, 0, napi_default, 0},
+                {"compileTemplate", 0, callWithScratchArena, 0, 0, 0, napi_static, (void*)CompileTemplate},
                 {"reverse", 0, Reverse, 0, 0, 0, napi_default, 0},
                 {"upperCase", 0, UpperCase, 0, 0, 0, napi_default, 0},
                 {"toUpperCase", 0, UpperCase, 0, 0, 0, napi_default, 0},
                 {"lowerCase", 0, LowerCase, 0, 0, 0, napi_default, 0},
                 {"toLowerCase", 0, LowerCase, 0, 0, 0, napi_default, 0},
-                {"replacePattern", 0, ReplacePattern, 0, 0, 0, napi_default, 0},
-                {"replaceAll", 0, ReplaceAll, 0, 0, 0, napi_default, 0},
+                {"replacePattern", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)ReplacePattern},
+                {"replaceAll", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)ReplaceAll},
                 {"trim", 0, Trim, 0, 0, 0, napi_default, 0},
+                {"trimStart", 0, TrimStart, 0, 0, 0, napi_default, 0},
+                {"trimLeft", 0, TrimStart, 0, 0, 0, napi_default, 0},
+                {"trimEnd", 0, TrimEnd, 0, 0, 0, napi_default, 0},
+                {"trimRight", 0, TrimEnd, 0, 0, 0, napi_default, 0},
                 {"repeat", 0, Repeat, 0, 0, 0, napi_default, 0},
                 {"expandCapacity", 0, ExpandCapacity, 0, 0, 0, napi_default, 0},
-                {"shrinkCapacity", 0, ShrinkCapacity, 0, 0, 0, napi_default, 0}
+                {"shrinkCapacity", 0, ShrinkCapacity, 0, 0, 0, napi_default, 0},
+                {"setMaxCapacity", 0, SetMaxCapacity, 0, 0, 0, napi_default, 0},
+                {"maxCapacity", 0, MaxCapacity, 0, 0, 0, napi_default, 0},
+                {"setMaxCapacity", 0, SetGlobalMaxCapacity, 0, 0, 0, napi_static, 0},
+                {"maxCapacity", 0, GlobalMaxCapacity, 0, 0, 0, napi_static, 0},
+                {"unsafeView", 0, UnsafeView, 0, 0, 0, napi_default, 0},
+                {"storageGeneration", 0, StorageGeneration, 0, 0, 0, napi_default, 0},
+                {"commit", 0, Commit, 0, 0, 0, napi_default, 0},
+                {"segment", 0, Segment, 0, 0, 0, napi_default, 0},
+                {"scratchArenaStats", 0, ScratchArenaStats, 0, 0, 0, napi_static, 0},
+                {"trackRuntimeStats", 0, TrackRuntimeStats, 0, 0, 0, napi_default, 0},
+                {"runtimeStats", 0, RuntimeStats, 0, 0, 0, napi_default, 0},
+                {"globalStats", 0, GlobalStats, 0, 0, 0, napi_static, 0},
+                {"enableProfiling", 0, EnableProfiling, 0, 0, 0, napi_static, 0},
+                {"profilingReport", 0, ProfilingReport, 0, 0, 0, napi_static, 0},
+                {"kernels", 0, Kernels, 0, 0, 0, napi_static, 0}
         };
+#if defined(PROFILING)
+        profileMethods(data, stringBuilderAllDesc, sizeof(stringBuilderAllDesc) / sizeof(napi_property_descriptor));
+        const char* profile = getenv("STRINGBUILDER_PROFILE");
+        if (profile != NULL && profile[0] != 0 && strcmp(profile, "0") != 0) {
+                enableProfiling(env, data, true);
+        }
+#endif
         napi_value cons;
-        napi_define_class(env, "StringBuilder", -1, constructor, 0, 39, stringBuilderAllDesc, &cons);
+        napi_define_class(env, "StringBuilder", -1, callWithScratchArena, (void*)constructor, sizeof(stringBuilderAllDesc) / sizeof(napi_property_descriptor), stringBuilderAllDesc, &cons);
         napi_set_named_property(env, exports, "StringBuilder", cons);
         napi_create_reference(env, cons, 1, &StringBuilderRef);
+
+        // a view reads the text of its StringBuilder through the same accessors, so it shares the methods which do not modify the text
+        napi_property_descriptor stringBuilderViewAllDesc[] = {
+                {"inspect", 0, Inspect, 0, 0, 0, napi_default, 0},
+                {"toString", 0, ToString, 0, 0, 0, napi_default, 0},
+                {"toBuffer", 0, ToBuffer, 0, 0, 0, napi_default, 0},
+                {"length", 0, Length, 0, 0, 0, napi_default, 0},
+                {"charAt", 0, CharAt, 0, 0, 0, napi_default, 0},
+                {"charCodeAt", 0, CharCodeAt, 0, 0, 0, napi_default, 0},
+                {"codePointAt", 0, CodePointAt, 0, 0, 0, napi_default, 0},
+                {"readInto", 0, ReadInto, 0, 0, 0, napi_default, 0},
+                {"equals", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)Equals},
+                {"startsWith", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)StartsWith},
+                {"endsWith", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)EndsWith},
+                {"indexOf", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)IndexOf},
+                {"indexOfSkip", 0, callWithScratchArena, 0, 0, 0, napi_default, (void*)IndexOfSkip}
+        };
+        napi_value viewCons;
+        napi_define_class(env, "StringBuilderView", -1, viewConstructor, 0, sizeof(stringBuilderViewAllDesc) / sizeof(napi_property_descriptor), stringBuilderViewAllDesc, &viewCons);
+        napi_create_reference(env, viewCons, 1, &StringBuilderViewRef);
+
+        napi_value templateCons;
+        napi_define_class(env, "StringBuilderTemplate", -1, templateConstructor, 0, 0, 0, &templateCons);
+        napi_create_reference(env, templateCons, 1, &StringBuilderTemplateRef);
         return exports;
 }
 
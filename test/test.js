@@ -3,6 +3,9 @@
 const expect = require('chai').expect;
 
 const StringBuilder = require('../index');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
 
 describe('#append', function() {
   it('should append text', function() {
@@ -34,6 +37,111 @@ describe('#append', function() {
   });
 });
 
+describe('#appendReadStream', function() {
+  it('should append the text of a stream', async function() {
+    var file = path.join(os.tmpdir(), 'node-stringbuilder-' + process.pid + '.txt');
+    fs.writeFileSync(file, 'Hello, 世界');
+    try {
+      var sb = StringBuilder.from('> ');
+      expect(await sb.appendReadStream(fs.createReadStream(file))).to.equal(sb);
+      expect(sb.toString()).to.equal('> Hello, 世界');
+    } finally {
+      fs.unlinkSync(file);
+    }
+  });
+});
+
+describe('#appendTemplate', function() {
+  it('should render a compiled template', function() {
+    var template = StringBuilder.compileTemplate('<li>${ name } (${age})${none}</li>');
+    var sb = StringBuilder.from('<ul>');
+    sb.appendTemplate(template, {name: 'Magic', age: 25}).appendTemplate(template, {name: Buffer.from('Len'), age: true});
+    expect(sb.toString()).to.equal('<ul><li>Magic (25)</li><li>Len (true)</li>');
+  });
+
+  it('should fill the buffer up to exactly maxCapacity', function() {
+    var template = StringBuilder.compileTemplate('<${a}${b}');
+    var sb = StringBuilder.from('abc').setMaxCapacity(10);
+    sb.appendTemplate(template, {a: 'de', b: 'fghi'});
+    expect(sb.toString()).to.equal('abc<defghi');
+    expect(() => sb.appendTemplate(template, {})).to.throw(RangeError);
+    expect(sb.toString()).to.equal('abc<defghi');
+  });
+
+  it('should reject invalid templates', function() {
+    expect(() => StringBuilder.compileTemplate('${name')).to.throw();
+    expect(() => new StringBuilder().appendTemplate('${name}', {})).to.throw(TypeError);
+  });
+});
+
+describe('#appendEscaped', function() {
+  it('should escape HTML, JSON, CSV and URL components', function() {
+    var text = '<a href="x">Tom & \'Jerry\'</a>,\n\u0001 😀';
+    var sb = new StringBuilder();
+    expect(sb.appendHtmlEscaped(text).toString()).to.equal('&lt;a href=&quot;x&quot;&gt;Tom &amp; &#39;Jerry&#39;&lt;/a&gt;,\n\u0001 😀');
+    expect(sb.clear().appendJsonEscaped(text).toString()).to.equal(JSON.stringify(text).slice(1, -1));
+    expect(sb.clear().appendCsvField(text).toString()).to.equal('"' + text.replace(/"/g, '""') + '"');
+    expect(sb.clear().appendCsvField('plain').toString()).to.equal('plain');
+    expect(sb.clear().appendUrlEncoded(text).toString()).to.equal(encodeURIComponent(text));
+  });
+});
+
+describe('#appendJSON', function() {
+  it('should serialize like JSON.stringify', function() {
+    var value = {a: [1, -0.5, null, undefined, 'x"\n'], b: {c: true, d: () => 1}, e: new Date(0), f: NaN};
+    var sb = StringBuilder.from('>');
+    expect(sb.appendJSON(value).toString()).to.equal('>' + JSON.stringify(value));
+    expect(sb.clear().appendJSON(value, {indent: 2}).toString()).to.equal(JSON.stringify(value, null, 2));
+  });
+
+  it('should serialize proxies of arrays as arrays and reject boxed BigInts', function() {
+    var value = new Proxy([1, 'a', {b: 2}], {});
+    expect(StringBuilder.from('').appendJSON(value).toString()).to.equal(JSON.stringify(value));
+    var sb = StringBuilder.from('text');
+    expect(() => sb.appendJSON({a: Object(1n)})).to.throw(TypeError);
+    expect(() => sb.appendJSON([1n])).to.throw(TypeError);
+    expect(sb.toString()).to.equal('text');
+  });
+
+  it('should not be affected by callbacks using the StringBuilder', function() {
+    var sb = StringBuilder.from('a');
+    var clone;
+    var value = {b: {toJSON: function() {
+      clone = sb.clone();
+      sb.append('x');
+      return 1;
+    }}, c: 'y'.repeat(1000)};
+    sb.appendJSON(value);
+    expect(clone.toString()).to.equal('a');
+    expect(sb.toString()).to.equal('ax' + JSON.stringify({b: 1, c: 'y'.repeat(1000)}));
+    var view = sb.view(0, 2);
+    sb.appendJSON({get d() {
+      sb.clear();
+      return 'z'.repeat(1000);
+    }});
+    expect(sb.toString()).to.equal(JSON.stringify({d: 'z'.repeat(1000)}));
+    expect(() => view.toString()).to.throw();
+  });
+
+  it('should throw on cycles without appending anything', function() {
+    var value = {a: []};
+    value.a.push(value);
+    var sb = StringBuilder.from('text');
+    expect(() => sb.appendJSON(value)).to.throw(TypeError);
+    expect(sb.toString()).to.equal('text');
+  });
+});
+
+describe('#appendBase64', function() {
+  it('should encode and decode base64 and hex', function() {
+    var data = Buffer.from([0, 1, 2, 250, 251, 252, 253, 254, 255, 16, 32, 64, 128, 3, 5, 7, 11]);
+    var sb = StringBuilder.from('data:');
+    sb.appendBase64(data).append(',').appendBase64(data, {url: true}).append(',').appendHex(new Uint8Array(data));
+    expect(sb.toString()).to.equal('data:' + data.toString('base64') + ',' + data.toString('base64url') + ',' + data.toString('hex'));
+    expect(sb.decodeBase64(5, 5 + data.toString('base64').length).equals(data)).to.equal(true);
+  });
+});
+
 describe('#insert', function() {
   it('should insert text at head', function() {
     var sb = StringBuilder.from(', Second');
@@ -56,3 +164,593 @@ describe('#insert', function() {
     expect(result).to.equal('First, Second, Third');
   });
 });
+
+describe('#replaceAll', function() {
+  it('should replace many matches with a longer text', function() {
+    var sb = StringBuilder.from('a'.repeat(300));
+    sb.replaceAll('a', 'bc'.repeat(20));
+    expect(sb.toString()).to.equal('bc'.repeat(6000));
+    sb = StringBuilder.from('a'.repeat(300));
+    sb.replacePattern('a', 'bc'.repeat(20), 0, 300);
+    expect(sb.toString()).to.equal('bc'.repeat(6000));
+  });
+});
+
+describe('#replacePattern', function() {
+  it('should start searching at the offset', function() {
+    expect(StringBuilder.from('abcabcabc').replacePattern('abc', 'x', 3).toString()).to.equal('abcxabc');
+    expect(StringBuilder.from('abcabcabc').replacePattern('abc', 'x', 1, 2).toString()).to.equal('abcxx');
+    expect(StringBuilder.from('abcabcabc').replacePattern('abc', 'x', -3).toString()).to.equal('abcabcx');
+  });
+});
+
+describe('#repeat', function() {
+  it('should not copy a shared buffer or invalidate the views for no repetition', function() {
+    var sb = StringBuilder.from('ab');
+    var clone = sb.clone();
+    var view = sb.view(0, 1);
+    var generation = sb.storageGeneration();
+    sb.repeat(0).repeat(-1);
+    StringBuilder.from('').repeat(3);
+    expect(sb.storageGeneration()).to.equal(generation);
+    expect(view.toString()).to.equal('a');
+    sb.repeat(2);
+    expect(sb.toString()).to.equal('ababab');
+    expect(clone.toString()).to.equal('ab');
+    expect(() => view.toString()).to.throw();
+  });
+});
+
+describe('#segment', function() {
+  it('should clamp a huge segment capacity to the maximum capacity', function() {
+    [2 ** 62, 2 ** 63].forEach(function(segmentCapacity) {
+      var sb = StringBuilder.from('abc').setMaxCapacity(1000);
+      sb.trackRuntimeStats();
+      sb.segment(segmentCapacity);
+      for (var i = 0; i < 9; ++i) {
+        sb.append('d'.repeat(100));
+      }
+      expect(sb.length()).to.equal(903);
+      expect(() => sb.append('e'.repeat(100))).to.throw(RangeError);
+      if (StringBuilder.globalStats() !== null) {
+        // one segment of the maximum capacity instead of one for every append
+        expect(sb.runtimeStats().reallocations).to.equal(1);
+      }
+    });
+  });
+
+  it('should append text into segments without copying and flatten on demand', function() {
+    var sb = StringBuilder.from('').segment(128);
+    for (let i = 0; i < 100; ++i) {
+      sb.append('0123456789');
+    }
+    expect(sb.segmentCount()).to.above(1);
+    expect(sb.length()).to.equal(1000);
+    expect(Buffer.concat(sb.toBuffers()).toString()).to.equal('0123456789'.repeat(100));
+    expect(sb.indexOf('90').length).to.equal(99);
+    expect(sb.segmentCount()).to.equal(1);
+  });
+
+  it('should keep surrogate pairs across segment boundaries', function() {
+    var sb = StringBuilder.from('').segment(128);
+    sb.append('a'.repeat(126) + '\ud83d').append('\ude00b');
+    expect(sb.segmentCount()).to.equal(2);
+    expect(Buffer.concat(sb.toBuffers()).toString()).to.equal('a'.repeat(126) + '😀b');
+    expect(Buffer.concat(sb.toBuffers('utf16le')).toString('utf16le')).to.equal('a'.repeat(126) + '😀b');
+  });
+
+  it('should keep the views valid, since the text does not change', function() {
+    var sb = StringBuilder.from('abc');
+    var view = sb.view(1);
+    var generation = sb.storageGeneration();
+    sb.segment(128);
+    expect(sb.storageGeneration()).to.equal(generation);
+    expect(view.toString()).to.equal('bc');
+    sb.append('d'.repeat(300)).segment(0);
+    expect(sb.view(0, 3).toString()).to.equal('abc');
+    view = sb.view(1, 4);
+    sb.segment(64).segment(0);
+    expect(view.toString()).to.equal('bcd');
+  });
+});
+
+describe('#upperCase', function() {
+  it('should convert ASCII and non-ASCII letters to upper case', function() {
+    var sb = StringBuilder.from('Hello, world! ÀÉÎõü ǆ ωσς 𐐨 ß');
+    var result = sb.upperCase().toString();
+    expect(result).to.equal('HELLO, WORLD! ÀÉÎÕÜ Ǆ ΩΣΣ 𐐀 ß');
+  });
+
+  it('should convert ASCII and non-ASCII letters to lower case', function() {
+    var sb = StringBuilder.from('Hello, WORLD! ÀÉÎõü Ǆ ΩΣ 𐐀 İ');
+    var result = sb.lowerCase().toString();
+    expect(result).to.equal('hello, world! àéîõü ǆ ωσ 𐐨 i');
+  });
+});
+
+describe('#compare', function() {
+  it('should compare text by code units', function() {
+    var sb = StringBuilder.from('apple');
+    expect(sb.compare('apple')).to.equal(0);
+    expect(sb.compare('apples')).to.equal(-1);
+    expect(sb.compare('Apple')).to.equal(1);
+    expect(sb.compare(StringBuilder.from('banana'))).to.equal(-1);
+  });
+
+  it('should compare text ignoring the case of letters', function() {
+    var sb = StringBuilder.from('The quick brown fox jumps over the lazy dog. ΣΑΣ');
+    expect(sb.compareIgnoreCase('THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG. σας')).to.equal(0);
+    expect(sb.compareIgnoreCase('the quick brown fox jumps over the lazy cat.')).to.equal(1);
+    expect(sb.equalsIgnoreCase('the QUICK brown fox jumps over the lazy dog. ςας')).to.equal(true);
+  });
+});
+
+describe('#trim', function() {
+  it('should trim Unicode whitespace like String.prototype.trim', function() {
+    var text = '　﻿ \t\n First Second  \r\n        ';
+    expect(StringBuilder.from(text).trim().toString()).to.equal(text.trim());
+    expect(StringBuilder.from(text).trimStart().toString()).to.equal(text.trimStart());
+    expect(StringBuilder.from(text).trimEnd().toString()).to.equal(text.trimEnd());
+  });
+
+  it('should keep working after trimming the leading whitespace', function() {
+    var sb = StringBuilder.from('                First');
+    sb.trimStart().append(', Second').insert(0, '>').appendRepeat('!', 300);
+    expect(sb.toString()).to.equal('>First, Second' + '!'.repeat(300));
+  });
+});
+
+describe('#stats', function() {
+  it('should count words, lines, code points and UTF-8 bytes', function() {
+    var text = 'First line, 3.14 apples\nSecond 😀 line\n中文';
+    var stats = StringBuilder.from(text).stats();
+    expect(stats.length).to.equal(text.length);
+    expect(stats.words).to.equal(StringBuilder.from(text).count());
+    expect(stats.lines).to.equal(3);
+    expect(stats.codePoints).to.equal([...text].length);
+    expect(stats.utf8Length).to.equal(Buffer.byteLength(text));
+  });
+
+  it('should get the byte length without encoding', function() {
+    var sb = StringBuilder.from('Hello, 世界');
+    expect(sb.byteLength()).to.equal(13);
+    expect(sb.byteLength('utf16le')).to.equal(18);
+    expect(sb.stats(7).utf8Length).to.equal(6);
+  });
+});
+
+describe('#reverse', function() {
+  it('should reverse text in place without expanding the capacity', function() {
+    var sb = StringBuilder.from('The quick brown fox jumps over the lazy dog.');
+    var capacity = sb.capacity();
+    expect(sb.reverse().toString()).to.equal('.god yzal eht revo spmuj xof nworb kciuq ehT');
+    expect(sb.capacity()).to.equal(capacity);
+  });
+
+  it('should keep surrogate pairs and grapheme clusters', function() {
+    expect(StringBuilder.from('a😀b𝒳c').reverse('codePoint').toString()).to.equal('c𝒳b😀a');
+    expect(StringBuilder.from('née 👍🏽 🇹🇼 👩‍👩‍👧').reverse('grapheme').toString()).to.equal('👩‍👩‍👧 🇹🇼 👍🏽 eén');
+  });
+});
+
+describe('#reset', function() {
+  it('should shrink the capacity to maxCapacity', function() {
+    var sb = StringBuilder.from('x'.repeat(5000));
+    sb.reset(1000);
+    expect(sb.length()).to.equal(0);
+    expect(sb.capacity()).to.equal(1024);
+    expect(sb.append('abc').toString()).to.equal('abc');
+  });
+
+  it('should keep the capacity if maxCapacity is not limited', function() {
+    var sb = StringBuilder.from('x'.repeat(5000));
+    var capacity = sb.capacity();
+    sb.reset(Infinity);
+    expect(sb.capacity()).to.equal(capacity);
+    sb.reset(NaN).reset(null).reset(undefined).reset();
+    expect(sb.capacity()).to.equal(capacity);
+    var pool = StringBuilder.pool({maxRetainedCapacity: Infinity});
+    sb.append('x'.repeat(5000));
+    pool.release(sb);
+    expect(sb.capacity()).to.equal(capacity);
+  });
+
+  it('should reject a negative or non-numeric maxCapacity', function() {
+    var sb = StringBuilder.from('abc');
+    expect(function() { sb.reset(-1000); }).to.throw(RangeError);
+    expect(function() { sb.reset('1000'); }).to.throw(TypeError);
+    expect(function() { sb.reset({}); }).to.throw(TypeError);
+    expect(sb.toString()).to.equal('abc');
+  });
+});
+
+describe('#pool', function() {
+  it('should reuse released instances', function() {
+    var pool = StringBuilder.pool({maxIdle: 1, maxRetainedCapacity: 1024});
+    var sb = pool.acquire();
+    sb.append('x'.repeat(5000));
+    pool.release(sb);
+    expect(sb.length()).to.equal(0);
+    expect(sb.capacity()).to.equal(1024);
+    var sb2 = pool.acquire();
+    expect(sb2).to.equal(sb);
+    pool.acquire();
+    pool.release(sb2);
+    pool.release(StringBuilder.from(''));
+    expect(pool.stats()).to.deep.equal({hits: 1, misses: 2, dropped: 1, idle: 1});
+  });
+});
+
+describe('#scratchArenaStats', function() {
+  it('should convert arguments through the scratch arena', function() {
+    var sb = StringBuilder.from('x');
+    sb.append(Buffer.from([0xE4, 0xB8, 0x96, 0xF0, 0x9F, 0x98, 0x80, 0xE4, 0xB8, 0x41])).append(-42).append(true);
+    expect(sb.toString()).to.equal('x世😀\ufffdA-42true');
+    expect(sb.indexOf(Buffer.from('😀'))[0]).to.equal(2);
+    var pattern = 'y'.repeat(100000);
+    expect(StringBuilder.from(pattern).indexOf(pattern).length).to.equal(1);
+    var stats = StringBuilder.scratchArenaStats();
+    expect(stats.highWaterMark >= 200000).to.equal(true);
+    expect(stats.capacity >= stats.highWaterMark).to.equal(true);
+  });
+});
+
+describe('#runtimeStats', function() {
+  // the counters can be compiled out with -Druntime_stats=0, and then every read returns null
+  var compiled = StringBuilder.globalStats() !== null;
+
+  it('should count the work of a tracked instance', function() {
+    var sb = new StringBuilder();
+    expect(sb.runtimeStats()).to.equal(null);
+    sb.trackRuntimeStats();
+    if (!compiled) {
+      expect(sb.runtimeStats()).to.equal(null);
+      return;
+    }
+    sb.append('x'.repeat(200)).append(42).insert(0, Buffer.from('ab'));
+    expect(sb.indexOf('xx').length).to.equal(199);
+    var stats = sb.runtimeStats({reset: true});
+    expect(stats.reallocations >= 1).to.equal(true);
+    expect(stats.bytesMoved).to.equal(404);
+    expect(stats.searches).to.equal(1);
+    expect(stats.bytesScanned).to.equal(408);
+    expect(stats.peakCapacity >= 408).to.equal(true);
+    expect(stats.conversions).to.deep.equal({string: 2, primitive: 1, stringBuilder: 0, buffer: 1, stream: 0, object: 0});
+    expect(sb.runtimeStats().searches).to.equal(0);
+    expect(StringBuilder.globalStats().searches >= 1).to.equal(true);
+    sb.trackRuntimeStats(false);
+    expect(sb.runtimeStats()).to.equal(null);
+  });
+
+  it('should count the bytes scanned from the offset of replacePattern', function() {
+    var sb = StringBuilder.from('abcabcabc');
+    sb.trackRuntimeStats();
+    sb.replacePattern('abc', 'x', 3);
+    if (compiled) {
+      expect(sb.runtimeStats().bytesScanned).to.equal(12);
+    }
+  });
+});
+
+describe('#profilingReport', function() {
+  it('should time the calls into histograms by method and size', function() {
+    // profiling can be compiled out with -Dprofiling=0, and then it cannot be enabled
+    if (!StringBuilder.enableProfiling()) {
+      expect(StringBuilder.profilingReport()).to.equal(null);
+      return;
+    }
+    var sb = StringBuilder.from('x'.repeat(100));
+    sb.indexOf('x');
+    sb.indexOf('x');
+    StringBuilder.enableProfiling(false);
+    sb.indexOf('x');
+    var histogram = StringBuilder.profilingReport().methods.indexOf['1024'];
+    expect(histogram.count).to.equal(2);
+    expect(histogram.buckets.reduce((a, b) => a + b)).to.equal(2);
+    expect(histogram.max <= histogram.sum).to.equal(true);
+    var text = StringBuilder.profilingReport({format: 'prometheus', reset: true});
+    expect(text).to.contain('stringbuilder_method_duration_seconds_count{method="indexOf",size="1024"} 2\n');
+    expect(StringBuilder.profilingReport().methods).to.deep.equal({});
+  });
+});
+
+describe('#charAt', function() {
+  it('should return the character at an index of code units', function() {
+    var sb = StringBuilder.from('abcdef');
+    expect(sb.charAt(0)).to.equal('a');
+    expect(sb.charAt(1)).to.equal('b');
+    expect(sb.charAt(3)).to.equal('d');
+    expect(sb.charAt(-1)).to.equal('f');
+    expect(sb.tokens('').next().value).to.equal('a');
+  });
+});
+
+describe('#charCodeAt', function() {
+  it('should return code units and code points as numbers', function() {
+    var sb = StringBuilder.from('a\ud83d\ude00b');
+    expect(sb.charCodeAt(0)).to.equal(97);
+    expect(sb.charCodeAt(1)).to.equal(0xD83D);
+    expect(sb.charCodeAt(-1)).to.equal(98);
+    expect(isNaN(sb.charCodeAt(4))).to.equal(true);
+    expect(sb.codePointAt(1)).to.equal(0x1F600);
+    expect(sb.codePointAt(2)).to.equal(0xDE00);
+    expect(sb.codePointAt(4)).to.equal(undefined);
+    expect(sb.view(1, 3).codePointAt(0)).to.equal(0x1F600);
+  });
+});
+
+describe('#readInto', function() {
+  it('should copy code units in bulk into a Uint16Array', function() {
+    var sb = StringBuilder.from('Hello, world');
+    var chunk = new Uint16Array(5);
+    var text = '';
+    for (let start = 0, n; (n = sb.readInto(chunk, start)) > 0; start += n) {
+      text += String.fromCharCode.apply(null, chunk.subarray(0, n));
+    }
+    expect(text).to.equal('Hello, world');
+    expect(sb.readInto(chunk, 10)).to.equal(2);
+    expect(sb.view(7).readInto(chunk)).to.equal(5);
+    expect(String.fromCharCode.apply(null, chunk)).to.equal('world');
+    expect(() => sb.readInto(new Uint8Array(4), 0)).to.throw(TypeError);
+  });
+});
+
+describe('#unsafeView', function() {
+  it('should read the text without copying until its storage moves', function() {
+    var sb = StringBuilder.from('  abc');
+    var units = sb.unsafeView();
+    var generation = sb.storageGeneration();
+    expect(String.fromCharCode.apply(null, units)).to.equal('  abc');
+    sb.replace(4, 5, 'x');
+    expect(units[4]).to.equal(120);
+    expect(sb.storageGeneration()).to.equal(generation);
+    sb.trim();
+    expect(sb.storageGeneration()).not.to.equal(generation);
+    expect(String.fromCharCode.apply(null, sb.unsafeView())).to.equal('abx');
+    generation = sb.storageGeneration();
+    sb.append('d'.repeat(1000));
+    expect(sb.storageGeneration()).not.to.equal(generation);
+    expect(sb.unsafeView().length).to.equal(1003);
+  });
+
+  it('should fill the spare capacity in place with commit', function() {
+    var sb = StringBuilder.from('ab');
+    var clone = sb.clone();
+    var spare = sb.unsafeView({spare: 300});
+    expect(spare.length >= 300).to.equal(true);
+    spare[0] = 99;
+    spare[1] = 100;
+    expect(sb.commit(1).toString()).to.equal('abc');
+    expect(sb.commit(1).toString()).to.equal('abcd');
+    expect(clone.toString()).to.equal('ab');
+    expect(() => sb.commit(spare.length)).to.throw(RangeError);
+  });
+});
+
+describe('#kernels', function() {
+  it('should give the same results with every kernel table the CPU supports', function() {
+    var kernels = StringBuilder.kernels();
+    expect(kernels.supported).to.contain('scalar');
+    expect(kernels.supported).to.contain(kernels.selected);
+    var text = '  \t The Quick <Brown> Fox, "caf\u00e9" \u5b57\u4e32 \ud83d\ude00 & 3.5 dogs\n'.repeat(20) + ' \n ';
+    var results = kernels.supported.map((name) => {
+      expect(StringBuilder.kernels(name).selected).to.equal(name);
+      var sb = StringBuilder.from(text);
+      return [sb.indexOf('\n'), sb.stats(), sb.hash({algorithm: 'crc32c'}), sb.equals(text), new StringBuilder().appendJsonEscaped(text).appendHtmlEscaped(text).appendUrlEncoded(text).appendHex(Buffer.from(text)).toString(), sb.trim().upperCase().toString()];
+    });
+    StringBuilder.kernels(kernels.selected);
+    for (let result of results) {
+      expect(result).to.deep.equal(results[0]);
+    }
+    expect(results[0][5]).to.equal(text.trim().toUpperCase());
+    expect(() => StringBuilder.kernels('mmx')).to.throw(RangeError);
+  });
+});
+
+describe('#setMaxCapacity', function() {
+  it('should throw instead of growing beyond the limit', function() {
+    var sb = StringBuilder.from('abc').setMaxCapacity(10);
+    expect(sb.maxCapacity()).to.equal(10);
+    expect(sb.capacity()).to.equal(10);
+    sb.append('1234567');
+    var error = null;
+    try {
+      sb.append('x');
+    } catch (err) {
+      error = err;
+    }
+    expect(error instanceof RangeError).to.equal(true);
+    expect(error.code).to.equal('ERR_STRINGBUILDER_MAX_CAPACITY');
+    expect(() => sb.insert(0, 'x')).to.throw(RangeError);
+    expect(() => sb.appendJSON({a: 1})).to.throw(RangeError);
+    expect(sb.toString()).to.equal('abc1234567');
+    expect(() => sb.setMaxCapacity(5)).to.throw(RangeError);
+    expect(sb.setMaxCapacity().maxCapacity()).to.equal(Infinity);
+  });
+
+  it('should check the sizes of repeat and the global limit', function() {
+    expect(() => StringBuilder.from('abc').repeat(2 ** 60)).to.throw(RangeError);
+    expect(() => StringBuilder.from('abc').appendRepeat('xy', 2 ** 62)).to.throw(RangeError);
+    StringBuilder.setMaxCapacity(100);
+    try {
+      expect(() => new StringBuilder('x'.repeat(101))).to.throw(RangeError);
+      expect(new StringBuilder('', 1000).capacity()).to.equal(100);
+    } finally {
+      StringBuilder.setMaxCapacity();
+    }
+    expect(StringBuilder.maxCapacity()).to.equal(Infinity);
+  });
+});
+
+describe('#clone', function() {
+  it('should copy the shared buffer on the first write', function() {
+    var sb = StringBuilder.from('Hello, world');
+    var sb2 = sb.clone();
+    var sb3 = sb2.clone();
+    sb2.replaceAll('o', '0').append('!');
+    sb.upperCase();
+    expect(sb.toString()).to.equal('HELLO, WORLD');
+    expect(sb2.toString()).to.equal('Hell0, w0rld!');
+    expect(sb3.toString()).to.equal('Hello, world');
+    expect(sb3.clear().append('x').toString()).to.equal('x');
+    expect(sb.toString()).to.equal('HELLO, WORLD');
+  });
+
+  function cloneInToString(sb, text) {
+    return {toString: function() {
+      cloneInToString.clone = sb.clone();
+      return text;
+    }};
+  }
+
+  it('should not write into a clone taken while converting the argument of insert', function() {
+    var sb = StringBuilder.from('ab');
+    sb.insert(1, cloneInToString(sb, 'v'));
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['avb', 'ab']);
+  });
+
+  it('should not write into a clone taken while converting the argument of append', function() {
+    var sb = StringBuilder.from('ab');
+    sb.append(cloneInToString(sb, 'v'));
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['abv', 'ab']);
+    sb.appendLine(cloneInToString(sb, 'w'));
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['abvw\n', 'abv']);
+  });
+
+  it('should not write into a clone taken while converting the argument of replace', function() {
+    var sb = StringBuilder.from('abab');
+    sb.replace(0, 1, cloneInToString(sb, 'Z'));
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['Zbab', 'abab']);
+  });
+
+  it('should not write into a clone taken while converting the arguments of replacePattern', function() {
+    var sb = StringBuilder.from('abab');
+    sb.replacePattern(cloneInToString(sb, 'a'), 'Z');
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['Zbab', 'abab']);
+    sb.replacePattern('b', cloneInToString(sb, 'Y'));
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['ZYab', 'Zbab']);
+  });
+
+  it('should not write into a clone taken while converting the arguments of replaceAll', function() {
+    var sb = StringBuilder.from('abab');
+    sb.replaceAll('a', cloneInToString(sb, 'Z'));
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['ZbZb', 'abab']);
+    sb.replaceAll(cloneInToString(sb, 'b'), 'Y');
+    expect([sb.toString(), cloneInToString.clone.toString()]).to.deep.equal(['ZYZY', 'ZbZb']);
+  });
+});
+
+describe('#view', function() {
+  it('should read a range without modifying the text', function() {
+    var sb = StringBuilder.from('Hello, world! Hello!');
+    var view = sb.view(7, -1);
+    expect(view.toString()).to.equal('world! Hello');
+    expect(view.length()).to.equal(12);
+    expect(view.equals('world! Hello')).to.equal(true);
+    expect(view.startsWith('world')).to.equal(true);
+    expect(view.indexOf('o')[1]).to.equal(11);
+    expect(view.toBuffer().toString()).to.equal('world! Hello');
+    expect(sb.toString()).to.equal('Hello, world! Hello!');
+  });
+
+  it('should be invalidated by a modification', function() {
+    var sb = StringBuilder.from('Hello, world');
+    var view = sb.view(0, 5);
+    sb.clone().append('!');
+    expect(view.toString()).to.equal('Hello');
+    sb.append('!');
+    expect(function() {
+      view.toString();
+    }).to.throw();
+  });
+
+  it('should be invalidated by a write after the view was created while converting the argument', function() {
+    var view;
+    function viewInToString(sb, text) {
+      return {toString: function() {
+        view = sb.view(0, 2);
+        return text;
+      }};
+    }
+    var sb = StringBuilder.from('ab');
+    sb.insert(0, viewInToString(sb, 'Q'));
+    expect(sb.toString()).to.equal('Qab');
+    expect(() => view.toString()).to.throw();
+    sb.replace(0, 1, viewInToString(sb, 'R'));
+    expect(sb.toString()).to.equal('Rab');
+    expect(() => view.toString()).to.throw();
+    sb.replaceAll('a', viewInToString(sb, 'S'));
+    expect(sb.toString()).to.equal('RSb');
+    expect(() => view.toString()).to.throw();
+  });
+});
+
+describe('#hash', function() {
+  it('should hash the UTF-16 text', function() {
+    var sb = StringBuilder.from('Hello, world');
+    expect(sb.hash()).to.equal(1425833463883375228n);
+    expect(sb.hash(0, 5)).to.equal(StringBuilder.from('Hello').hash());
+    expect(StringBuilder.from('123456789').hash({algorithm: 'crc32c'})).to.equal(StringBuilder.from().append(Buffer.from('123456789')).hash(0, 9, {algorithm: 'crc32c'}));
+  });
+
+  it('should match the known answers of wyhash final version 4', function() {
+    expect(StringBuilder.from('').hash({algorithm: 'wyhash'})).to.equal(0x93228a4de0eec5a2n);
+    expect(StringBuilder.from('abcdefghijklmnopqrstuvwxyz').hash({algorithm: 'wyhash'})).to.equal(9494390041693995203n);
+    var sb = StringBuilder.from('ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789');
+    expect(sb.hash({algorithm: 'wyhash'})).to.equal(17175786112570084501n);
+  });
+
+  it('should update CRC-32C incrementally', function() {
+    var sb = StringBuilder.from('Hello');
+    sb.hash({algorithm: 'crc32c'});
+    sb.append(', world').appendLine();
+    var expected = StringBuilder.from('Hello, world\n').hash({algorithm: 'crc32c'});
+    expect(sb.hash({algorithm: 'crc32c'})).to.equal(expected);
+    sb.reverse().reverse();
+    expect(sb.hash({algorithm: 'crc32c'})).to.equal(expected);
+  });
+});
+
+describe('#lines', function() {
+  it('should look up lines and columns', function() {
+    var sb = StringBuilder.from('first\nsecond\n\nfourth');
+    expect(sb.lineCount()).to.equal(4);
+    expect(sb.getLine(1)).to.equal('second');
+    expect(sb.getLine(-1)).to.equal('fourth');
+    expect(sb.getLine(4)).to.equal(undefined);
+    expect(sb.lineOf(9)).to.equal(1);
+    expect(sb.columnOf(9)).to.equal(3);
+  });
+
+  it('should keep the line index up to date', function() {
+    var sb = StringBuilder.from('a\nb');
+    expect(sb.lineCount()).to.equal(2);
+    sb.appendLine().append('c\nd');
+    expect(sb.lineCount()).to.equal(4);
+    sb.insert(1, '\n').delete(-2);
+    expect(sb.lineCount()).to.equal(4);
+    expect(sb.getLine(3)).to.equal('c');
+  });
+});
+
+describe('#split', function() {
+  it('should split like String.prototype.split', function() {
+    var text = 'a,b,,c--d,';
+    var sb = StringBuilder.from(text);
+    expect(sb.split(',')).to.deep.equal(text.split(','));
+    expect(sb.split('--')).to.deep.equal(text.split('--'));
+    expect(sb.split(',', 2)).to.deep.equal(['a', 'b']);
+    expect(sb.split('')).to.deep.equal(text.split(''));
+    expect(sb.split(/,+/)).to.deep.equal(text.split(/,+/));
+  });
+
+  it('should iterate over tokens and lines lazily', function() {
+    var sb = StringBuilder.from('first\nsecond\n\nfourth');
+    expect(Array.from(sb.lines())).to.deep.equal(['first', 'second', '', 'fourth']);
+    expect(Array.from(sb.tokens('n', {offsets: true}))).to.deep.equal([[0, 10], [11, 20]]);
+    var lines = sb.lines();
+    lines.next();
+    sb.append('!');
+    expect(() => lines.next()).to.throw();
+  });
+});